@@ -61,6 +61,14 @@ class EmscriptenDebugServerHandler(BaseHTTPRequestHandler):
             return
         self._did_start = True
 
+    def end_headers(self):
+        # Make pages cross-origin isolated, which browsers require before
+        # offering SharedArrayBuffer, and thus before pthreads-enabled
+        # builds (FSTUFF_EMSCRIPTEN_THREADS) can run.
+        self.send_header('Cross-Origin-Opener-Policy', 'same-origin')
+        self.send_header('Cross-Origin-Embedder-Policy', 'require-corp')
+        BaseHTTPRequestHandler.end_headers(self)
+
     def _end_response(self):
         client_state = self._get_client_state()
         client_state["last_path"] = self.path
@@ -15,7 +15,11 @@
 #include <ctime>
 #include <chrono>
 #include <cctype>
+#include <cstring>
+#include <limits>
 #include <sstream>
+#include <algorithm>
+#include <vector>
 
 // part of the utf8cpp library (at https://github.com/nemtrif/utfcpp)
 #if (__clang__ || __GNUC__) && !__cpp_exceptions       // Some builds, such as for web/Emscripten, use -fno-exceptions
@@ -33,6 +37,17 @@
 #include <emscripten.h>
 #endif
 
+#if _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX        // keeping std::min() and std::max() usable
+#endif
+#include <windows.h>    // MoveFileExA()
+#endif
+
+#if FSTUFF_USE_HASTY_SPACE
+#include <chipmunk/cpHastySpace.h>     // Chipmunk's multithreaded solver
+#endif
+
 // #define FSTUFF_USE_DEBUG_PEGS 1
 
 #pragma mark - Global state
@@ -98,8 +113,11 @@ extern "C" {
 
 cpFloat FSTUFF_RandRangeF(std::mt19937 &rng, cpFloat a, cpFloat b)
 {
-    std::uniform_real_distribution<cpFloat> distribution(a, b);
-    return distribution(rng);
+    // Always draw doubles, which consume the same amount of 'rng' state
+    // regardless of cpFloat's type.  That way, single- and double-precision
+    // builds make the same worlds, given the same seed.
+    std::uniform_real_distribution<double> distribution(a, b);
+    return (cpFloat) distribution(rng);
 }
 
 int FSTUFF_RandRangeI(std::mt19937 & rng, int a, int b)
@@ -119,23 +137,547 @@ void FSTUFF_OpenWebPage(const char * url) {
 #endif
 }
 
+bool FSTUFF_WriteFileAtomically(const std::string & path, bool (*write)(FILE * file, void * userdata), void * userdata)
+{
+    // The suffix only needs to differ between concurrent writers
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%llx.%llx.tmp",
+        (unsigned long long) std::chrono::steady_clock::now().time_since_epoch().count(),
+        (unsigned long long) std::hash<std::thread::id>()(std::this_thread::get_id()));
+    const std::string tempPath = path + suffix;
+
+    FILE * file = fopen(tempPath.c_str(), "wb");
+    if ( ! file) {
+        return false;
+    }
+    bool didWrite = write(file, userdata);
+    didWrite = (fclose(file) == 0) && didWrite;
+    if (didWrite) {
+#if _WIN32
+        // Windows' rename() won't replace an existing file.  The 'A' variant
+        // takes paths as fopen() does.
+        didWrite = (MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+        // Replaces any existing file, atomically, or else leaves it be
+        didWrite = (rename(tempPath.c_str(), path.c_str()) == 0);
+#endif
+    }
+    if ( ! didWrite) {
+        remove(tempPath.c_str());
+    }
+    return didWrite;
+}
+
+#pragma mark - Frame Timing
+
+void FSTUFF_FrameTimeStats::Add(double frameTimeS)
+{
+    const float frameTimeMS = (float)(frameTimeS * 1000.);
+    this->samplesMS[this->count % kMaxSamples] = frameTimeMS;
+    this->minMS = (this->count == 0) ? frameTimeMS : std::min(this->minMS, frameTimeMS);
+    this->maxMS = (this->count == 0) ? frameTimeMS : std::max(this->maxMS, frameTimeMS);
+    this->totalMS += frameTimeMS;
+    this->count += 1;
+}
+
+void FSTUFF_FrameTimeStats::Log(const char * label) const
+{
+    if (this->count == 0) {
+        FSTUFF_Log("%s: no frames\n", label);
+        return;
+    }
+
+    std::vector<float> sorted(this->samplesMS.begin(), this->samplesMS.begin() + std::min<uint64_t>(this->count, kMaxSamples));
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted] (double p) {
+        return sorted[std::min(sorted.size() - 1, (size_t)(p * (double)sorted.size()))];
+    };
+
+    const double avgMS = this->totalMS / (double)this->count;
+    FSTUFF_Log("%s: %llu frames, avg %.2f ms (%.1f fps); min %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f ms\n",
+        label,
+        (unsigned long long)this->count,
+        avgMS,
+        (avgMS > 0.) ? (1000. / avgMS) : 0.,
+        this->minMS,
+        percentile(0.50),
+        percentile(0.90),
+        percentile(0.99),
+        this->maxMS);
+}
+
+#pragma mark - Startup Profiling
+
+FSTUFF_StartupProfile & FSTUFF_GetStartupProfile()
+{
+    static FSTUFF_StartupProfile profile;
+    return profile;
+}
+
+double FSTUFF_StartupProfile::NowS()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FSTUFF_StartupProfile::Begin()
+{
+    if (this->beginS == 0.) {
+        this->beginS = NowS();
+    }
+}
+
+size_t FSTUFF_StartupProfile::StartStep(const char * name)
+{
+    if (this->isDone || this->numSteps >= kMaxSteps) {
+        return kMaxSteps;
+    }
+    this->Begin();
+    Step & step = this->steps[this->numSteps];
+    step.name = name;
+    step.startS = NowS() - this->beginS;
+    step.durationS = -1.;
+    step.depth = this->depth;
+    this->depth += 1;
+    return this->numSteps++;
+}
+
+void FSTUFF_StartupProfile::EndStep(size_t index)
+{
+    if (this->isDone || index >= this->numSteps) {
+        return;
+    }
+    this->steps[index].durationS = (NowS() - this->beginS) - this->steps[index].startS;
+    this->depth -= 1;
+}
+
+void FSTUFF_StartupProfile::FirstFrame()
+{
+    if (this->isDone) {
+        return;
+    }
+    this->Begin();
+    const double firstPixelS = NowS() - this->beginS;
+    this->isDone = true;
+
+    FSTUFF_Log("Startup: time-to-first-pixel, %.2f ms\n", firstPixelS * 1000.);
+    for (size_t i = 0; i < this->numSteps; ++i) {
+        const Step & step = this->steps[i];
+        FSTUFF_Log("Startup: %*s%-*s %8.2f ms, at %8.2f ms\n",
+            step.depth * 2, "",
+            32 - (step.depth * 2), step.name,
+            (step.durationS >= 0. ? step.durationS : 0.) * 1000.,
+            step.startS * 1000.);
+    }
+}
+
+
+#pragma mark - Instances
+
+// World-space rectangle that instances must overlap, to get drawn
+struct FSTUFF_CullRect {
+    float minX, minY, maxX, maxY;
+    bool enabled;       // if false, nothing gets culled
+
+    bool Overlaps(const FSTUFF_WorldSnapshot::Shape & shape) const {
+        return
+            ! enabled || (
+                (shape.x + shape.cullRadius) >= minX &&
+                (shape.x - shape.cullRadius) <= maxX &&
+                (shape.y + shape.cullRadius) >= minY &&
+                (shape.y - shape.cullRadius) <= maxY
+            );
+    }
+};
+
+static const size_t kInstanceChunkSize = 256;
+
+// Culls a snapshot's shapes, then gathers the survivors, in order, into
+// 'batch', building their transforms and copying their colors into
+// 'instances'.  Each bucket (pegs, marbles, boxes, segments) gets
+// split into chunks, which get spread across 'jobs': first, each chunk
+// counts its survivors; then, with every chunk's destination known, each
+// copies its survivors into place, and builds their transforms.  Returns
+// each bucket's number of survivors via 'visibleCounts'.
+static void FSTUFF_GatherInstances(
+    FSTUFF_JobPool & jobs,
+    const FSTUFF_WorldSnapshot & snapshot,
+    const FSTUFF_CullRect & view,
+    FSTUFF_InstanceBatch & batch,
+    FSTUFF_ShapeInstance * instances,
+    size_t visibleCounts[4])
+{
+    // Buckets, in the order that their shapes appear in the snapshot
+    const size_t bucketSizes[4] = {
+        snapshot.numPegs,
+        snapshot.numCircles - snapshot.numPegs,
+        snapshot.numBoxes,
+        snapshot.numSegments,
+    };
+
+    struct Chunk {
+        size_t srcBegin;
+        size_t srcEnd;
+        size_t numVisible;
+        size_t dstBegin;
+    };
+    Chunk chunks[(FSTUFF_MaxShapes / kInstanceChunkSize) + FSTUFF_countof(bucketSizes)];
+    size_t chunkBuckets[FSTUFF_countof(chunks)];
+    size_t numChunks = 0;
+    size_t src = 0;
+    for (size_t bucket = 0; bucket < FSTUFF_countof(bucketSizes); ++bucket) {
+        const size_t bucketEnd = src + bucketSizes[bucket];
+        for (; src < bucketEnd; src += kInstanceChunkSize) {
+            FSTUFF_Assert(numChunks < FSTUFF_countof(chunks));
+            chunkBuckets[numChunks] = bucket;
+            chunks[numChunks++] = {src, std::min(bucketEnd, src + kInstanceChunkSize), 0, 0};
+        }
+    }
+
+    jobs.ParallelFor(numChunks, 1, [&] (size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            for (size_t i = chunks[c].srcBegin; i < chunks[c].srcEnd; ++i) {
+                chunks[c].numVisible += view.Overlaps(snapshot.shapes[i]) ? 1 : 0;
+            }
+        }
+    });
+
+    size_t dst = 0;
+    for (size_t bucket = 0; bucket < FSTUFF_countof(bucketSizes); ++bucket) {
+        visibleCounts[bucket] = 0;
+    }
+    for (size_t c = 0; c < numChunks; ++c) {
+        chunks[c].dstBegin = dst;
+        dst += chunks[c].numVisible;
+        visibleCounts[chunkBuckets[c]] += chunks[c].numVisible;
+    }
+    batch.count = dst;
+
+    jobs.ParallelFor(numChunks, 1, [&] (size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            size_t out = chunks[c].dstBegin;
+            for (size_t i = chunks[c].srcBegin; i < chunks[c].srcEnd; ++i) {
+                const FSTUFF_WorldSnapshot::Shape & shape = snapshot.shapes[i];
+                if (view.Overlaps(shape)) {
+                    batch.Set(out, shape.x, shape.y, shape.angle, shape.scaleX, shape.scaleY);
+                    instances[out].color = shape.color;
+                    ++out;
+                }
+            }
+            FSTUFF_BuildTransforms(batch.Inputs(chunks[c].dstBegin), chunks[c].numVisible, &instances[chunks[c].dstBegin].transform, sizeof(FSTUFF_ShapeInstance));
+        }
+    });
+}
+
+
+#pragma mark - Benchmarks
+
+// Runs 'fn' repeatedly, for a fixed number of rounds, and returns the
+// fastest round's time, in nanoseconds per item.
+template <typename Fn>
+static double FSTUFF_TimeNSPerItem(size_t numItems, Fn fn)
+{
+    double bestS = INFINITY;
+    for (int round = 0; round < 200; ++round) {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const double durationS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        bestS = std::min(bestS, durationS);
+    }
+    return (bestS * 1e9) / (double)numItems;
+}
+
+static void FSTUFF_BenchmarkTransforms()
+{
+    std::vector<float> x(FSTUFF_MaxShapes), y(FSTUFF_MaxShapes), angle(FSTUFF_MaxShapes), scaleX(FSTUFF_MaxShapes), scaleY(FSTUFF_MaxShapes);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> positions(0.f, 1000.f);
+    std::uniform_real_distribution<float> angles(-1000.f, 1000.f);
+    std::uniform_real_distribution<float> scales(0.5f, 50.f);
+    for (size_t i = 0; i < FSTUFF_MaxShapes; ++i) {
+        x[i] = positions(rng);
+        y[i] = positions(rng);
+        angle[i] = angles(rng);
+        scaleX[i] = scales(rng);
+        scaleY[i] = scales(rng);
+    }
+    const FSTUFF_TransformInputs in = {x.data(), y.data(), angle.data(), scaleX.data(), scaleY.data()};
+
+    std::vector<gbMat4> reference(FSTUFF_MaxShapes), scalar(FSTUFF_MaxShapes), vectorized(FSTUFF_MaxShapes);
+    const double referenceNS  = FSTUFF_TimeNSPerItem(FSTUFF_MaxShapes, [&] { FSTUFF_BuildTransforms_Reference(in, FSTUFF_MaxShapes, reference.data()); });
+    const double scalarNS     = FSTUFF_TimeNSPerItem(FSTUFF_MaxShapes, [&] { FSTUFF_BuildTransforms_Scalar(in, FSTUFF_MaxShapes, scalar.data()); });
+    const double vectorizedNS = FSTUFF_TimeNSPerItem(FSTUFF_MaxShapes, [&] { FSTUFF_BuildTransforms(in, FSTUFF_MaxShapes, vectorized.data()); });
+
+    // Errors are relative to each column's scale, as an absolute error in a
+    // 50x scaled shape is 50x that of its unit-sized rotation.
+    float maxError = 0.f;
+    bool scalarMatches = true;
+    for (size_t i = 0; i < FSTUFF_MaxShapes; ++i) {
+        for (int e = 0; e < 16; ++e) {
+            const float scale = (e < 4) ? scaleX[i] : ((e < 8) ? scaleY[i] : 1.f);
+            maxError = std::max(maxError, std::abs(vectorized[i].e[e] - reference[i].e[e]) / scale);
+            scalarMatches = scalarMatches && (vectorized[i].e[e] == scalar[i].e[e] || (vectorized[i].e[e] == 0.f && scalar[i].e[e] == 0.f));
+        }
+    }
+
+    FSTUFF_Log("transforms: %d instances; reference %.2f ns, scalar %.2f ns, %s %.2f ns, per instance (%.1fx vs reference)\n",
+        (int)FSTUFF_MaxShapes, referenceNS, scalarNS, FSTUFF_SIMDName(), vectorizedNS, referenceNS / vectorizedNS);
+    FSTUFF_Log("transforms: max error vs reference, %g; %s matches scalar: %s\n",
+        maxError, FSTUFF_SIMDName(), scalarMatches ? "yes" : "NO");
+}
+
+// Largest difference between two runs of floats, each relative to the
+// larger of 'scale' (the magnitude that the computation's intermediate sums
+// can reach) and the values themselves
+static float FSTUFF_MaxRelativeError(const float * a, const float * b, size_t count, float scale)
+{
+    float maxError = 0.f;
+    for (size_t i = 0; i < count; ++i) {
+        const float magnitude = std::max(scale, std::max(std::abs(a[i]), std::abs(b[i])));
+        maxError = std::max(maxError, std::abs(a[i] - b[i]) / magnitude);
+    }
+    return maxError;
+}
+
+// gb_math's 4x4 operations, via its SIMD backend, vs. its scalar code.
+// Compilers may contract the scalar code's a*b+c into FMAs (GCC and Clang
+// do, by default, on AArch64), changing its last bits, so results get
+// compared within a few ulps, rather than bit for bit.
+static void FSTUFF_BenchmarkGBMath()
+{
+    const float kMaxError = 8.f * std::numeric_limits<float>::epsilon();
+    const float kProductScale = 4.f * 10.f * 10.f;     // i.e. a dot product of 4 values in [-10, 10]
+    const size_t count = 4096;
+    std::vector<gbMat4> a(count), b(count), scalar(count), vectorized(count);
+    std::vector<gbVec4> v(count), scalarV(count), vectorizedV(count);
+    std::vector<gbVec3> axes(count);
+    std::vector<float> angles(count);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> values(-10.f, 10.f);
+    for (size_t i = 0; i < count; ++i) {
+        for (int e = 0; e < 16; ++e) {
+            a[i].e[e] = values(rng);
+            b[i].e[e] = values(rng);
+        }
+        v[i] = {values(rng), values(rng), values(rng), values(rng)};
+        axes[i] = {values(rng), values(rng), values(rng)};
+        angles[i] = values(rng);
+    }
+
+    struct Result {
+        const char * name;
+        double scalarNS;
+        double vectorizedNS;
+        float maxError;
+    } results[3];
+
+    results[0] = {
+        "mat4_mul",
+        FSTUFF_TimeNSPerItem(count, [&] { for (size_t i = 0; i < count; ++i) { gb_float44_mul_scalar(gb_float44_m(&scalar[i]), gb_float44_m(&a[i]), gb_float44_m(&b[i])); } }),
+        FSTUFF_TimeNSPerItem(count, [&] { for (size_t i = 0; i < count; ++i) { gb_mat4_mul(&vectorized[i], &a[i], &b[i]); } }),
+        FSTUFF_MaxRelativeError(&scalar[0].e[0], &vectorized[0].e[0], count * 16, kProductScale),
+    };
+    results[1] = {
+        "mat4_mul_vec4",
+        FSTUFF_TimeNSPerItem(count, [&] { for (size_t i = 0; i < count; ++i) { gb_float44_mul_vec4_scalar(&scalarV[i], gb_float44_m(&a[i]), v[i]); } }),
+        FSTUFF_TimeNSPerItem(count, [&] { for (size_t i = 0; i < count; ++i) { gb_mat4_mul_vec4(&vectorizedV[i], &a[i], v[i]); } }),
+        FSTUFF_MaxRelativeError(&scalarV[0].e[0], &vectorizedV[0].e[0], count * 4, kProductScale),
+    };
+    results[2] = {
+        "mat4_rotate",
+        FSTUFF_TimeNSPerItem(count, [&] { for (size_t i = 0; i < count; ++i) { gb_mat4_rotate_scalar(&scalar[i], axes[i], angles[i]); } }),
+        FSTUFF_TimeNSPerItem(count, [&] { for (size_t i = 0; i < count; ++i) { gb_mat4_rotate(&vectorized[i], axes[i], angles[i]); } }),
+        0.f,
+    };
+    results[2].maxError = FSTUFF_MaxRelativeError(&scalar[0].e[0], &vectorized[0].e[0], count * 16, 1.f);    // a unit axis' rotation
+
+    for (const Result & result : results) {
+        FSTUFF_Log("gbmath: %-14s scalar %.2f ns, %s %.2f ns (%.1fx); results match: %s (max relative error, %g)\n",
+            result.name, result.scalarNS, gb_math_simd_name(), result.vectorizedNS,
+            result.scalarNS / result.vectorizedNS, (result.maxError <= kMaxError) ? "yes" : "NO", result.maxError);
+    }
+}
+
+// Culling + gathering of a full world's instances, via FSTUFF_GatherInstances(),
+// with job pools of 1 to N threads (N == the number of CPUs)
+static void FSTUFF_BenchmarkInstances()
+{
+    std::unique_ptr<FSTUFF_WorldSnapshot> snapshot(new FSTUFF_WorldSnapshot());
+    snapshot->numPegs = FSTUFF_MaxCircles / 4;
+    snapshot->numCircles = FSTUFF_MaxCircles;
+    snapshot->numBoxes = FSTUFF_MaxBoxes;
+    snapshot->numSegments = FSTUFF_MaxSegments;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> positions(-100.f, 1100.f);     // some get culled
+    std::uniform_real_distribution<float> angles(-1000.f, 1000.f);
+    std::uniform_real_distribution<float> scales(0.5f, 50.f);
+    for (FSTUFF_WorldSnapshot::Shape & shape : snapshot->shapes) {
+        shape = {positions(rng), positions(rng), angles(rng), scales(rng), scales(rng), 1.f, {0xff, 0xff, 0xff, 0xff}};
+    }
+    const FSTUFF_CullRect view = {0.f, 0.f, 1000.f, 1000.f, true};
+
+    std::unique_ptr<FSTUFF_InstanceBatch> batch(new FSTUFF_InstanceBatch());
+    std::vector<FSTUFF_ShapeInstance> expected(FSTUFF_MaxShapes), instances(FSTUFF_MaxShapes);
+    size_t expectedCount = 0;
+    size_t visibleCounts[4];
+    const int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    double oneThreadNS = 0.;
+    for (int numThreads = 1; numThreads <= maxThreads; ++numThreads) {
+        FSTUFF_JobPool jobs(numThreads);
+        std::vector<FSTUFF_ShapeInstance> & out = (numThreads == 1) ? expected : instances;
+        const double ns = FSTUFF_TimeNSPerItem(FSTUFF_MaxShapes, [&] { FSTUFF_GatherInstances(jobs, *snapshot, view, *batch, out.data(), visibleCounts); });
+        if (numThreads == 1) {
+            oneThreadNS = ns;
+            expectedCount = batch->count;
+        }
+        const bool matches =
+            batch->count == expectedCount &&
+            memcmp(out.data(), expected.data(), batch->count * sizeof(FSTUFF_ShapeInstance)) == 0;
+        FSTUFF_Log("instances: %d thread(s), %d of %d instances visible; %.2f ns per instance (%.2fx vs 1 thread); results match: %s\n",
+            jobs.NumThreads(), (int)batch->count, (int)FSTUFF_MaxShapes, ns, oneThreadNS / ns, matches ? "yes" : "NO");
+    }
+}
+
+static const struct {
+    const char * name;
+    void (*run)();
+} FSTUFF_Benchmarks[] = {
+    {"transforms", FSTUFF_BenchmarkTransforms},
+    {"gbmath", FSTUFF_BenchmarkGBMath},
+    {"instances", FSTUFF_BenchmarkInstances},
+};
+
+bool FSTUFF_RunBenchmark(const char * name)
+{
+    for (const auto & benchmark : FSTUFF_Benchmarks) {
+        if (strcmp(name, "list") == 0) {
+            FSTUFF_Log("%s\n", benchmark.name);
+        } else if (strcmp(name, benchmark.name) == 0 || strcmp(name, "all") == 0) {
+            benchmark.run();
+            if (strcmp(name, "all") != 0) {
+                return true;
+            }
+        }
+    }
+    return (strcmp(name, "list") == 0 || strcmp(name, "all") == 0);
+}
+
+
 #pragma mark - Rendering
 
 FSTUFF_Renderer::~FSTUFF_Renderer()
 {
 }
 
-constexpr gbVec4 FSTUFF_Color(uint32_t rgb, uint8_t a)
+std::vector<uint8_t> FSTUFF_ExpandAlpha8ToRGBA8(const uint8_t * srcAlpha8, int width, int height)
+{
+    const size_t numPixels = (size_t)width * (size_t)height;
+    std::vector<uint8_t> rgba(numPixels * 4);
+    for (size_t i = 0; i < numPixels; ++i) {
+        rgba[(i * 4) + 0] = 0xff;
+        rgba[(i * 4) + 1] = 0xff;
+        rgba[(i * 4) + 2] = 0xff;
+        rgba[(i * 4) + 3] = srcAlpha8[i];
+    }
+    return rgba;
+}
+
+void FSTUFF_Renderer::SetShapeInstances(FSTUFF_ShapeType shape, size_t offset, const FSTUFF_ShapeInstance * instances, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        this->SetShapeProperties(shape, offset + i, instances[i].transform, instances[i].color);
+    }
+}
+
+void FSTUFF_Renderer::RenderFrame(const FSTUFF_FramePacket & packet)
+{
+    FSTUFF_Assert( ! packet.instancesInRenderer);
+    this->SetProjectionMatrix(packet.projectionMatrix);
+    uint32_t first = 0;
+    for (size_t type = 0; type < FSTUFF_NumShapeTypes; ++type) {
+        this->SetShapeInstances((FSTUFF_ShapeType)type, 0, packet.instances + first, packet.numInstances[type]);
+        first += packet.numInstances[type];
+    }
+    for (uint32_t i = 0; i < packet.numDrawCommands; ++i) {
+        const FSTUFF_FramePacket::DrawCommand & command = packet.drawCommands[i];
+        this->RenderShapes(this->sim->GetShape(command.shape), command.offset, command.count, command.alpha);
+    }
+}
+
+#pragma mark - Frame Capture
+
+static const char kFramePacketMagic[4] = {'F', 'S', 'F', 'P'};
+static const uint32_t kFramePacketVersion = 3;
+
+bool FSTUFF_WriteFramePacket(FILE * file, const FSTUFF_FramePacket & packet)
+{
+    if (packet.instancesInRenderer) {
+        FSTUFF_Log("Frame packet's instances are in the renderer's memory; unable to capture it (see buildInstancesInPlace)\n");
+        return false;
+    }
+    const uint32_t numInstances = packet.TotalInstances();
+    bool ok = true;
+    ok = ok && fwrite(kFramePacketMagic, sizeof(kFramePacketMagic), 1, file) == 1;
+    ok = ok && fwrite(&kFramePacketVersion, sizeof(kFramePacketVersion), 1, file) == 1;
+    ok = ok && fwrite(&packet.projectionMatrix, sizeof(packet.projectionMatrix), 1, file) == 1;
+    ok = ok && fwrite(packet.numInstances, sizeof(packet.numInstances), 1, file) == 1;
+    ok = ok && fwrite(packet.instances, sizeof(FSTUFF_ShapeInstance), numInstances, file) == numInstances;
+    ok = ok && fwrite(&packet.numDrawCommands, sizeof(packet.numDrawCommands), 1, file) == 1;
+    ok = ok && fwrite(packet.drawCommands, sizeof(FSTUFF_FramePacket::DrawCommand), packet.numDrawCommands, file) == packet.numDrawCommands;
+    return ok;
+}
+
+bool FSTUFF_ReadFramePacket(FILE * file, FSTUFF_FramePacket & packet)
+{
+    char magic[sizeof(kFramePacketMagic)];
+    uint32_t version = 0;
+    if (fread(magic, sizeof(magic), 1, file) != 1) {
+        return false;   // end-of-file
+    }
+    if (memcmp(magic, kFramePacketMagic, sizeof(magic)) != 0 ||
+        fread(&version, sizeof(version), 1, file) != 1 ||
+        version != kFramePacketVersion)
+    {
+        FSTUFF_Log("Frame packet has an unknown format\n");
+        return false;
+    }
+
+    bool ok = true;
+    packet.instancesInRenderer = false;
+    ok = ok && fread(&packet.projectionMatrix, sizeof(packet.projectionMatrix), 1, file) == 1;
+    ok = ok && fread(packet.numInstances, sizeof(packet.numInstances), 1, file) == 1;
+    uint64_t numInstances = 0;
+    for (size_t type = 0; ok && type < FSTUFF_NumShapeTypes; ++type) {
+        numInstances += packet.numInstances[type];
+    }
+    ok = ok && numInstances <= FSTUFF_FramePacket::kMaxInstances;
+    ok = ok && fread(packet.instances, sizeof(FSTUFF_ShapeInstance), (size_t)numInstances, file) == numInstances;
+    ok = ok && fread(&packet.numDrawCommands, sizeof(packet.numDrawCommands), 1, file) == 1;
+    ok = ok && packet.numDrawCommands <= FSTUFF_FramePacket::kMaxDrawCommands;
+    ok = ok && fread(packet.drawCommands, sizeof(FSTUFF_FramePacket::DrawCommand), packet.numDrawCommands, file) == packet.numDrawCommands;
+    for (uint32_t i = 0; ok && i < packet.numDrawCommands; ++i) {
+        const FSTUFF_FramePacket::DrawCommand & command = packet.drawCommands[i];
+        ok =
+            command.shape < FSTUFF_NumShapeIDs &&
+            ((uint64_t)command.offset + command.count) <= packet.numInstances[FSTUFF_ShapeTypeForID(command.shape)];
+    }
+    if ( ! ok) {
+        FSTUFF_Log("Frame packet is truncated, or malformed\n");
+        packet.numDrawCommands = 0;
+    }
+    return ok;
+}
+
+constexpr FSTUFF_RGBA8 FSTUFF_Color(uint32_t rgb, uint8_t a)
 {
     return {
-        ((((uint32_t)rgb) >> 16) & 0xFF) / 255.0f,
-        ((((uint32_t)rgb) >> 8) & 0xFF) / 255.0f,
-        (rgb & 0xFF) / 255.0f,
-        (a) / 255.0f
+        (uint8_t) ((rgb >> 16) & 0xFF),
+        (uint8_t) ((rgb >> 8) & 0xFF),
+        (uint8_t) (rgb & 0xFF),
+        a
     };
 }
 
-constexpr gbVec4 FSTUFF_Color(uint32_t rgb)
+constexpr FSTUFF_RGBA8 FSTUFF_Color(uint32_t rgb)
 {
     return FSTUFF_Color(rgb, 0xff);
 }
@@ -145,6 +687,12 @@ constexpr gbVec4 FSTUFF_Color(uint32_t rgb)
 
 static const unsigned kNumCircleParts = 64; //32;
 
+// Circle meshes come in FSTUFF_NumCircleLODs levels of detail, starting with
+// this many parts, then doubling.  The lowest level that keeps a mesh within
+// kCircleLODMaxErrorPixels of a true circle gets used.
+static const unsigned kCircleLODMinParts = 8;
+static const double kCircleLODMaxErrorPixels = 0.25;
+
 #define RAD_IDX(I) (((float)I) * kRadianStep)
 #define COS_IDX(I) ((float)cos(RAD_IDX(I)))
 #define SIN_IDX(I) ((float)sin(RAD_IDX(I)))
@@ -251,6 +799,16 @@ void FSTUFF_ShapeInit(FSTUFF_Shape * shape, FSTUFF_Renderer * renderer)
             didSet = true;
             shape->primitiveType = FSTUFF_PrimitiveTriangles;
             FSTUFF_MakeCircleFilledTriangles(vertices, maxElements, &shape->numVertices, shape->circle.numParts, 1.f, 0.f, 0.f);
+        } else if (shape->appearance == FSTUFF_ShapeAppearanceSDF) {
+            // A quad that bounds the unit circle.  The renderer's SDF shader
+            // grows it slightly, to make room for antialiasing.
+            didSet = true;
+            shape->primitiveType = FSTUFF_PrimitiveTriangleFan;
+            shape->numVertices = 4;
+            vertices[0] = {-1.f, -1.f, 0, 1};
+            vertices[1] = {-1.f,  1.f, 0, 1};
+            vertices[2] = { 1.f, -1.f, 0, 1};
+            vertices[3] = { 1.f,  1.f, 0, 1};
         }
     }
     
@@ -329,121 +887,604 @@ void FSTUFF_ShapeInit(FSTUFF_Shape * shape, FSTUFF_Renderer * renderer)
 }
 
 
-#pragma mark - Simulation
+#pragma mark - Peg Layouts
 
-static const cpFloat FSTUFF_kPhysicsStepTimeS = 1./600.;
-static const cpFloat kMaxDeltaTimeS = 1.0;
-static const cpFloat kFriction = 1.0;
-static const cpFloat kElasticity = 0.8;
-static const cpVect kSurfaceVelocity = cpVect { 0.0, 0.0 };
+static const cpFloat kPegScaleCircle = 2.5;
+static const cpFloat kPegScaleBox = 4.;
 
-void FSTUFF_Simulation::InitGPUShapes()
+// Largest possible reach, from its center, of a peg's FSTUFF_PegCapsule
+static const cpFloat kPegReachMax = std::max(kPegScaleCircle * 10., ((kPegScaleBox * 14.) + (kPegScaleBox * 2.)) / 2.);
+
+static const int kPegColors[] = {
+    FSTUFF_Colors::Red,
+    FSTUFF_Colors::Red,
+    FSTUFF_Colors::Lime,
+    FSTUFF_Colors::Lime,
+    FSTUFF_Colors::Blue,
+    FSTUFF_Colors::Blue,
+    FSTUFF_Colors::Yellow,
+    FSTUFF_Colors::Cyan,
+};
+
+// Picks a peg's size, angle, and color, per its type; but not its position
+static void FSTUFF_RandPegShape(std::mt19937 & rng, FSTUFF_Peg & peg)
 {
-    //
-    // GPU init
-    //
-    this->circleFilled.debugName = "FSTUFF_CircleFilled";
-    this->circleFilled.type = FSTUFF_ShapeCircle;
-    this->circleFilled.appearance = FSTUFF_ShapeAppearanceFilled;
-    this->circleFilled.circle.numParts = kNumCircleParts;
-    FSTUFF_ShapeInit(&(this->circleFilled), this->renderer);
+    switch (peg.type) {
+        case FSTUFF_ShapeCircle:
+            peg.radius = kPegScaleCircle * FSTUFF_RandRangeF(rng, 6., 10.);
+            break;
+        case FSTUFF_ShapeBox:
+            peg.width = kPegScaleBox * FSTUFF_RandRangeF(rng, 6., 14.);
+            peg.height = kPegScaleBox * FSTUFF_RandRangeF(rng, 1., 2.);
+            peg.angle = FSTUFF_RandRangeF(rng, 0., (cpFloat) M_PI);
+            break;
+        default:
+            break;
+    }
+    peg.color = FSTUFF_Color(kPegColors[FSTUFF_RandRangeI(rng, 0, FSTUFF_countof(kPegColors)-1)]);
+}
 
-    this->circleDots.debugName = "FSTUFF_CircleDots";
-    this->circleDots.type = FSTUFF_ShapeCircle;
-    this->circleDots.appearance = FSTUFF_ShapeAppearanceFilled;
-    this->circleDots.circle.numParts = kNumCircleParts;
-    this->circleDots.primitiveType = FSTUFF_PrimitiveTriangles;
-    {
-        gbVec4 vertices[2048];
-        const int numCirclePartsForDot = 6;
-        const float dotRadius = 0.08f;  // size of dot: 0 to 1; 0 is no-size, 1 is as big as containing-circle
-        const float dotDistance = 0.7f; // from 0 to 1
-        int tmpVertexCount;
-        this->circleDots.numVertices = 0;
-        for (int i = 0, n = 6; i < n; ++i) {
-            const float rad = float(i) * ((M_PI * 2.f) / float(n));
-            FSTUFF_MakeCircleFilledTriangles(
-                &vertices[this->circleDots.numVertices],
-                0,
-                &tmpVertexCount,
-                numCirclePartsForDot,
-                dotRadius,
-                cosf(rad) * dotDistance,
-                sinf(rad) * dotDistance
-            );
-            this->circleDots.numVertices += tmpVertexCount;
+// A peg's outline, padded out to a capsule: every point within 'radius' of
+// the segment a-b.  Circles make zero-length capsules; boxes, capsules along
+// their length, as thick as they are.  Either way, the capsule covers the
+// whole peg, but hugs a long, thin box far better than a bounding circle.
+struct FSTUFF_PegCapsule {
+    cpFloat ax, ay;
+    cpFloat bx, by;
+    cpFloat radius;
+
+    explicit FSTUFF_PegCapsule(const FSTUFF_Peg & peg) {
+        cpFloat dx = 0, dy = 0;
+        if (peg.type == FSTUFF_ShapeBox) {
+            dx = std::cos(peg.angle) * (peg.width / 2.);
+            dy = std::sin(peg.angle) * (peg.width / 2.);
+            this->radius = peg.height / 2.;
+        } else {
+            this->radius = peg.radius;
         }
-        this->circleDots.gpuVertexBuffer = this->renderer->NewVertexBuffer(vertices, (this->circleDots.numVertices * sizeof(gbVec4)));
+        this->ax = peg.x - dx;
+        this->ay = peg.y - dy;
+        this->bx = peg.x + dx;
+        this->by = peg.y + dy;
     }
 
-    this->circleEdged.debugName = "FSTUFF_CircleEdged";
-    this->circleEdged.type = FSTUFF_ShapeCircle;
-    this->circleEdged.appearance = FSTUFF_ShapeAppearanceEdged;
-    this->circleEdged.circle.numParts = kNumCircleParts;
-    FSTUFF_ShapeInit(&(this->circleEdged), this->renderer);
+    cpFloat ReachX() const { return (std::abs(this->bx - this->ax) / 2.) + this->radius; }
+    cpFloat ReachY() const { return (std::abs(this->by - this->ay) / 2.) + this->radius; }
+};
 
-    this->boxFilled.debugName = "FSTUFF_BoxEdged";
-    this->boxFilled.type = FSTUFF_ShapeBox;
-    this->boxFilled.appearance = FSTUFF_ShapeAppearanceFilled;
-    FSTUFF_ShapeInit(&(this->boxFilled), this->renderer);
-    
-    this->boxEdged.debugName = "FSTUFF_BoxEdged";
-    this->boxEdged.type = FSTUFF_ShapeBox;
-    this->boxEdged.appearance = FSTUFF_ShapeAppearanceEdged;
-    FSTUFF_ShapeInit(&(this->boxEdged), this->renderer);
+// Squared distance from point p to segment a-b
+static cpFloat FSTUFF_PointSegmentDistanceSq(cpFloat px, cpFloat py, cpFloat ax, cpFloat ay, cpFloat bx, cpFloat by)
+{
+    const cpFloat abx = bx - ax;
+    const cpFloat aby = by - ay;
+    const cpFloat lengthSq = (abx * abx) + (aby * aby);
+    cpFloat t = 0;
+    if (lengthSq > 0) {
+        t = std::min(std::max((((px - ax) * abx) + ((py - ay) * aby)) / lengthSq, (cpFloat) 0), (cpFloat) 1);
+    }
+    const cpFloat dx = px - (ax + (abx * t));
+    const cpFloat dy = py - (ay + (aby * t));
+    return (dx * dx) + (dy * dy);
+}
 
-    this->segmentFilled.debugName = "FSTUFF_SegmentEdged";
-    this->segmentFilled.type = FSTUFF_ShapeSegment;
-    this->segmentFilled.appearance = FSTUFF_ShapeAppearanceFilled;
-    FSTUFF_ShapeInit(&(this->segmentFilled), this->renderer);
+// Gap between two capsules' outlines; <= 0 if they overlap
+static cpFloat FSTUFF_PegCapsuleGap(const FSTUFF_PegCapsule & p, const FSTUFF_PegCapsule & q)
+{
+    // Segments that cross are 0 apart.  Otherwise, the closest approach is
+    // from one of the four endpoints.
+    auto cross = [] (cpFloat ox, cpFloat oy, cpFloat ax, cpFloat ay, cpFloat bx, cpFloat by) {
+        return ((ax - ox) * (by - oy)) - ((ay - oy) * (bx - ox));
+    };
+    const cpFloat d1 = cross(p.ax, p.ay, p.bx, p.by, q.ax, q.ay);
+    const cpFloat d2 = cross(p.ax, p.ay, p.bx, p.by, q.bx, q.by);
+    const cpFloat d3 = cross(q.ax, q.ay, q.bx, q.by, p.ax, p.ay);
+    const cpFloat d4 = cross(q.ax, q.ay, q.bx, q.by, p.bx, p.by);
+    cpFloat distanceSq = 0;
+    if ( ! (((d1 * d2) < 0) && ((d3 * d4) < 0))) {
+        distanceSq = std::min(
+            std::min(FSTUFF_PointSegmentDistanceSq(p.ax, p.ay, q.ax, q.ay, q.bx, q.by),
+                     FSTUFF_PointSegmentDistanceSq(p.bx, p.by, q.ax, q.ay, q.bx, q.by)),
+            std::min(FSTUFF_PointSegmentDistanceSq(q.ax, q.ay, p.ax, p.ay, p.bx, p.by),
+                     FSTUFF_PointSegmentDistanceSq(q.bx, q.by, p.ax, p.ay, p.bx, p.by))
+        );
+    }
+    return std::sqrt(distanceSq) - p.radius - q.radius;
+}
 
-    this->segmentEdged.debugName = "FSTUFF_SegmentEdged";
-    this->segmentEdged.type = FSTUFF_ShapeSegment;
-    this->segmentEdged.appearance = FSTUFF_ShapeAppearanceEdged;
-    FSTUFF_ShapeInit(&(this->segmentEdged), this->renderer);
+// Pegs, bucketed by center into square cells, each as wide as the farthest
+// apart two pegs' centers can be, while still being too close.  Any peg too
+// close to a new one is then in the new one's cell, or in one of its 8
+// neighbors.
+struct FSTUFF_PegGrid {
+    cpFloat cellSize = 1;
+    int numColumns = 0;
+    int numRows = 0;
+    std::vector<int> cellFirst;     // per cell: index of its first peg; -1 == none
+    std::vector<int> pegNext;       // per peg: index of the next peg in its cell; -1 == none
+
+    FSTUFF_PegGrid(cpFloat worldWidth, cpFloat worldHeight, cpFloat minSpacing) {
+        this->cellSize = (2. * kPegReachMax) + minSpacing;
+        this->numColumns = std::max(1, (int) std::ceil(worldWidth / this->cellSize));
+        this->numRows = std::max(1, (int) std::ceil(worldHeight / this->cellSize));
+        this->cellFirst.assign((size_t) this->numColumns * (size_t) this->numRows, -1);
+    }
 
-    this->debugShape.debugName = "FSTUFF_DebugShape";
-    this->debugShape.type = FSTUFF_ShapeDebug;
-    this->debugShape.appearance = FSTUFF_ShapeAppearanceFilled;
-    FSTUFF_ShapeInit(&(this->debugShape), this->renderer);
-}
+    int Column(cpFloat x) const { return std::min(std::max((int) (x / this->cellSize), 0), this->numColumns - 1); }
+    int Row(cpFloat y) const    { return std::min(std::max((int) (y / this->cellSize), 0), this->numRows - 1); }
 
-void FSTUFF_Simulation::InitWorld()
-{
-    //
-    // Physics-world init
-    //
-    memset(&circles, 0, sizeof(circles));
-    memset(&circleColors, 0, sizeof(circleColors));
-    memset(&boxes, 0, sizeof(boxes));
-    memset(&boxColors, 0, sizeof(boxColors));
-    memset(&segments, 0, sizeof(segments));
-    memset(&segmentColors, 0, sizeof(segmentColors));
-    memset(&bodies, 0, sizeof(bodies));
-    this->physicsSpace = cpSpaceNew();
-    
-    cpSpaceSetIterations(this->physicsSpace, 2);
-    cpSpaceSetGravity(this->physicsSpace, this->game.gravity);
-    // TODO: try resizing cpSpace hashes
-    //cpSpaceUseSpatialHash(this->world.physicsSpace, 2, 10);
+    void Add(const std::vector<FSTUFF_Peg> & pegs, int index) {
+        int & first = this->cellFirst[(this->Row(pegs[index].y) * this->numColumns) + this->Column(pegs[index].x)];
+        this->pegNext.resize(std::max(this->pegNext.size(), (size_t) index + 1), -1);
+        this->pegNext[index] = first;
+        first = index;
+    }
 
-    cpBody * body;
-    cpShape * shape;
-    
-    
-    //
-    // Walls
-    //
+    // Returns true if 'peg' is at least 'minSpacing' from each of 'pegs'
+    bool Fits(const std::vector<FSTUFF_Peg> & pegs, const FSTUFF_Peg & peg, cpFloat minSpacing) const {
+        const FSTUFF_PegCapsule capsule(peg);
+        const int column = this->Column(peg.x);
+        const int row = this->Row(peg.y);
+        for (int r = std::max(row - 1, 0); r <= std::min(row + 1, this->numRows - 1); ++r) {
+            for (int c = std::max(column - 1, 0); c <= std::min(column + 1, this->numColumns - 1); ++c) {
+                for (int i = this->cellFirst[(r * this->numColumns) + c]; i >= 0; i = this->pegNext[i]) {
+                    if (FSTUFF_PegCapsuleGap(capsule, FSTUFF_PegCapsule(pegs[i])) < minSpacing) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+};
 
-    static const cpFloat wallThickness = 5.0;
-    const cpFloat wallLeft   = -wallThickness / 2.;
-    const cpFloat wallRight  = this->GetWorldWidth() + (wallThickness / 2.);
-    const cpFloat wallBottom = -wallThickness / 2.;
-    const cpFloat wallTop    = this->GetWorldHeight() * 2.;   // use a high ceiling, to make sure off-screen falling things don't go over walls
-    
-#if ! FSTUFF_USE_DEBUG_PEGS
-    // Bottom
-    body = cpBodyInit(NewBody(), 0, 0);
+std::vector<FSTUFF_Peg> FSTUFF_GeneratePegs(std::mt19937 & rng, FSTUFF_PegLayout layout, cpFloat worldWidth, cpFloat worldHeight, size_t count, cpFloat minSpacing)
+{
+    std::vector<FSTUFF_Peg> pegs;
+    pegs.reserve(count);
+    switch (layout) {
+        case FSTUFF_PegLayoutUniform: {
+            for (size_t i = 0; i < count; ++i) {
+                FSTUFF_Peg peg;
+                peg.type = (FSTUFF_ShapeType) FSTUFF_RandRangeI(rng, FSTUFF_ShapeCircle, FSTUFF_ShapeBox);
+                peg.x = FSTUFF_RandRangeF(rng, 0., worldWidth);
+                peg.y = FSTUFF_RandRangeF(rng, 0., worldHeight);
+                FSTUFF_RandPegShape(rng, peg);
+                pegs.push_back(peg);
+            }
+        } break;
+
+        case FSTUFF_PegLayoutPoissonDisk: {
+            // Dart-throwing: each peg gets a few tries at a random spot that's
+            // clear of the others.  Pegs that get no such spot are left out.
+            // Unlike growing outwards from a seed point, this spreads a
+            // less-than-full layout across the whole world.
+            static const int kTriesPerPeg = 100;
+            FSTUFF_PegGrid grid(worldWidth, worldHeight, minSpacing);
+            for (size_t i = 0; i < count; ++i) {
+                FSTUFF_Peg peg;
+                peg.type = (FSTUFF_ShapeType) FSTUFF_RandRangeI(rng, FSTUFF_ShapeCircle, FSTUFF_ShapeBox);
+                FSTUFF_RandPegShape(rng, peg);
+
+                // Keep clear of the side walls, and of the floor
+                const FSTUFF_PegCapsule capsule(peg);
+                const cpFloat marginX = capsule.ReachX() + minSpacing;
+                const cpFloat marginY = capsule.ReachY() + minSpacing;
+                if ((marginX * 2.) > worldWidth || marginY > worldHeight) {
+                    continue;
+                }
+                for (int tries = 0; tries < kTriesPerPeg; ++tries) {
+                    peg.x = FSTUFF_RandRangeF(rng, marginX, worldWidth - marginX);
+                    peg.y = FSTUFF_RandRangeF(rng, marginY, worldHeight);
+                    if (grid.Fits(pegs, peg, minSpacing)) {
+                        pegs.push_back(peg);
+                        grid.Add(pegs, (int) pegs.size() - 1);
+                        break;
+                    }
+                }
+            }
+        } break;
+    }
+    return pegs;
+}
+
+// Cached layouts' files are written field by field, in little-endian byte
+// order, with doubles as their IEEE-754 bits, so that they read the same on
+// any host, and regardless of cpFloat's type.  Each file is a header:
+//
+//   u32 magic (FSTUFF_PegLayoutFileMagic), u32 version,
+//   f64 worldWidth, f64 worldHeight, f64 minSpacing,
+//   u32 seed, u32 count, u32 layout, u32 numPegs
+//
+// ... followed by 'numPegs' records:
+//
+//   f64 x, f64 y, f64 radius, f64 width, f64 height, f64 angle,
+//   u32 type, u8 r, u8 g, u8 b, u8 a
+static const uint32_t FSTUFF_PegLayoutFileMagic = 0x4c505346;     // "FSPL", once written out
+static const size_t FSTUFF_PegLayoutFileHeaderSize = (8 * sizeof(uint32_t)) + (3 * sizeof(double));
+static const size_t FSTUFF_PegLayoutFileRecordSize = (6 * sizeof(double)) + sizeof(uint32_t) + sizeof(FSTUFF_RGBA8);
+
+struct FSTUFF_PegLayoutWriter {
+    std::vector<uint8_t> bytes;
+
+    void U8(uint8_t value) {
+        this->bytes.push_back(value);
+    }
+    void U32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            this->bytes.push_back((uint8_t)(value >> (i * 8)));
+        }
+    }
+    void F64(double value) {
+        static_assert(sizeof(double) == sizeof(uint64_t), "doubles must be 64 bits");
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 8; ++i) {
+            this->bytes.push_back((uint8_t)(bits >> (i * 8)));
+        }
+    }
+};
+
+// Reads fields as written by FSTUFF_PegLayoutWriter.  Callers check sizes
+// beforehand, so reads past the end only happen on bugs.
+struct FSTUFF_PegLayoutReader {
+    const uint8_t * pos = nullptr;
+    const uint8_t * end = nullptr;
+
+    uint8_t U8() {
+        FSTUFF_Assert(this->pos < this->end);
+        return *this->pos++;
+    }
+    uint32_t U32() {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) {
+            value |= ((uint32_t)this->U8()) << (i * 8);
+        }
+        return value;
+    }
+    double F64() {
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; ++i) {
+            bits |= ((uint64_t)this->U8()) << (i * 8);
+        }
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+bool FSTUFF_PegLayoutCache::Key::operator==(const Key & other) const
+{
+    return (this->worldWidth == other.worldWidth) &&
+        (this->worldHeight == other.worldHeight) &&
+        (this->minSpacing == other.minSpacing) &&
+        (this->seed == other.seed) &&
+        (this->count == other.count) &&
+        (this->layout == other.layout) &&
+        (this->version == other.version);
+}
+
+// FNV-1a, over each of the key's fields, as written to files
+uint64_t FSTUFF_PegLayoutCache::Key::Hash() const
+{
+    FSTUFF_PegLayoutWriter fields;
+    fields.F64(this->worldWidth);
+    fields.F64(this->worldHeight);
+    fields.F64(this->minSpacing);
+    fields.U32(this->seed);
+    fields.U32(this->count);
+    fields.U32((uint32_t)this->layout);
+    fields.U32(this->version);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint8_t byte : fields.bytes) {
+        hash = (hash ^ byte) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Keys share files, by hash, bounding the disk's use.  Each file's header
+// tells which key it is for.
+static std::string FSTUFF_PegLayoutPath(const std::string & dir, const FSTUFF_PegLayoutCache::Key & key)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "pegs-%02u.bin", (unsigned)(key.Hash() % FSTUFF_PegLayoutCache::kMaxOnDisk));
+    if ( ! dir.empty() && (dir.back() != '/') && (dir.back() != '\\')) {
+        return dir + '/' + name;
+    }
+    return dir + name;
+}
+
+// Returns true, and fills 'pegs', if a layout for 'key' was on disk
+static bool FSTUFF_LoadPegLayout(const std::string & dir, const FSTUFF_PegLayoutCache::Key & key, std::vector<FSTUFF_Peg> & pegs)
+{
+    FILE * file = fopen(FSTUFF_PegLayoutPath(dir, key).c_str(), "rb");
+    if ( ! file) {
+        return false;
+    }
+    std::vector<uint8_t> bytes;
+    bool didRead = (fseek(file, 0, SEEK_END) == 0);
+    const long fileSize = (didRead ? ftell(file) : -1);
+    didRead = didRead &&
+        (fileSize >= (long)FSTUFF_PegLayoutFileHeaderSize) &&
+        (fseek(file, 0, SEEK_SET) == 0);
+    if (didRead) {
+        bytes.resize((size_t)fileSize);
+        didRead = (fread(bytes.data(), 1, bytes.size(), file) == bytes.size());
+    }
+    fclose(file);
+    if ( ! didRead) {
+        return false;
+    }
+
+    FSTUFF_PegLayoutReader reader;
+    reader.pos = bytes.data();
+    reader.end = bytes.data() + bytes.size();
+    const uint32_t magic = reader.U32();
+    const uint32_t version = reader.U32();
+    const double worldWidth = reader.F64();
+    const double worldHeight = reader.F64();
+    const double minSpacing = reader.F64();
+    const uint32_t seed = reader.U32();
+    const uint32_t count = reader.U32();
+    const uint32_t layout = reader.U32();
+    const uint32_t numPegs = reader.U32();
+    const bool isMatch = (magic == FSTUFF_PegLayoutFileMagic) &&
+        (version == key.version) &&
+        (worldWidth == key.worldWidth) &&
+        (worldHeight == key.worldHeight) &&
+        (minSpacing == key.minSpacing) &&
+        (seed == key.seed) &&
+        (count == key.count) &&
+        (layout == (uint32_t)key.layout) &&
+        (numPegs <= count) &&
+        (bytes.size() == FSTUFF_PegLayoutFileHeaderSize + (numPegs * FSTUFF_PegLayoutFileRecordSize));
+    if ( ! isMatch) {
+        return false;
+    }
+
+    pegs.resize(numPegs);
+    for (FSTUFF_Peg & peg : pegs) {
+        peg.x = reader.F64();
+        peg.y = reader.F64();
+        peg.radius = reader.F64();
+        peg.width = reader.F64();
+        peg.height = reader.F64();
+        peg.angle = reader.F64();
+        const uint32_t type = reader.U32();
+        if (type != FSTUFF_ShapeCircle && type != FSTUFF_ShapeBox) {
+            return false;
+        }
+        peg.type = (FSTUFF_ShapeType) type;
+        peg.color.r = reader.U8();
+        peg.color.g = reader.U8();
+        peg.color.b = reader.U8();
+        peg.color.a = reader.U8();
+    }
+    return true;
+}
+
+static void FSTUFF_SavePegLayout(const std::string & dir, const FSTUFF_PegLayoutCache::Key & key, const std::vector<FSTUFF_Peg> & pegs)
+{
+    FSTUFF_PegLayoutWriter writer;
+    writer.bytes.reserve(FSTUFF_PegLayoutFileHeaderSize + (pegs.size() * FSTUFF_PegLayoutFileRecordSize));
+    writer.U32(FSTUFF_PegLayoutFileMagic);
+    writer.U32(key.version);
+    writer.F64(key.worldWidth);
+    writer.F64(key.worldHeight);
+    writer.F64(key.minSpacing);
+    writer.U32(key.seed);
+    writer.U32(key.count);
+    writer.U32((uint32_t)key.layout);
+    writer.U32((uint32_t)pegs.size());
+    for (const FSTUFF_Peg & peg : pegs) {
+        writer.F64(peg.x);
+        writer.F64(peg.y);
+        writer.F64(peg.radius);
+        writer.F64(peg.width);
+        writer.F64(peg.height);
+        writer.F64(peg.angle);
+        writer.U32(peg.type);
+        writer.U8(peg.color.r);
+        writer.U8(peg.color.g);
+        writer.U8(peg.color.b);
+        writer.U8(peg.color.a);
+    }
+
+    const std::string path = FSTUFF_PegLayoutPath(dir, key);
+    const bool didWrite = FSTUFF_WriteFileAtomically(path, [] (FILE * file, void * userdata) {
+        const std::vector<uint8_t> & bytes = *(const std::vector<uint8_t> *)userdata;
+        return (fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size());
+    }, &writer.bytes);
+    if ( ! didWrite) {
+        FSTUFF_Log("Unable to write to \"%s\"\n", path.c_str());
+    }
+}
+
+std::vector<FSTUFF_Peg> FSTUFF_PegLayoutCache::Generate(const Key & key)
+{
+    // A stream of its own, apart from the world's, so that the layout
+    // depends on nothing but the key
+    std::seed_seq seeds{key.seed, (uint32_t) 0x73676550};    // "Pegs", little-endian
+    std::mt19937 rng(seeds);
+    return FSTUFF_GeneratePegs(rng, key.layout, key.worldWidth, key.worldHeight, key.count, key.minSpacing);
+}
+
+std::vector<FSTUFF_Peg> FSTUFF_PegLayoutCache::Get(const Key & key, bool onDisk)
+{
+    onDisk = onDisk && ! this->dir.empty();
+    for (auto it = this->entries.begin(); it != this->entries.end(); ++it) {
+        if (it->key == key) {
+            std::rotate(it, it + 1, this->entries.end());   // now the most recently used
+            return this->entries.back().pegs;
+        }
+    }
+
+    Entry entry;
+    entry.key = key;
+    if ( ! onDisk || ! FSTUFF_LoadPegLayout(this->dir, key, entry.pegs)) {
+        entry.pegs = FSTUFF_PegLayoutCache::Generate(key);
+        if (onDisk) {
+            FSTUFF_SavePegLayout(this->dir, key, entry.pegs);
+        }
+    }
+    if (this->entries.size() >= kMaxInMemory) {
+        this->entries.erase(this->entries.begin());
+    }
+    this->entries.push_back(std::move(entry));
+    return this->entries.back().pegs;
+}
+
+
+#pragma mark - Simulation
+
+static const double kMaxDeltaTimeS = 1.0;
+static const cpFloat kFriction = 1.0;
+static const cpFloat kElasticity = 0.8;
+static const cpVect kSurfaceVelocity = cpVect { 0.0, 0.0 };
+
+void FSTUFF_Simulation::InitGPUShapes()
+{
+    //
+    // GPU init
+    //
+    for (int lod = 0; lod < FSTUFF_NumCircleLODs; ++lod) {
+        this->circleFilled[lod].debugName = "FSTUFF_CircleFilled";
+        this->circleFilled[lod].type = FSTUFF_ShapeCircle;
+        this->circleFilled[lod].appearance = FSTUFF_ShapeAppearanceFilled;
+        this->circleFilled[lod].circle.numParts = kCircleLODMinParts << lod;
+        FSTUFF_ShapeInit(&(this->circleFilled[lod]), this->renderer);
+
+        this->circleEdged[lod].debugName = "FSTUFF_CircleEdged";
+        this->circleEdged[lod].type = FSTUFF_ShapeCircle;
+        this->circleEdged[lod].appearance = FSTUFF_ShapeAppearanceEdged;
+        this->circleEdged[lod].circle.numParts = kCircleLODMinParts << lod;
+        FSTUFF_ShapeInit(&(this->circleEdged[lod]), this->renderer);
+    }
+
+    this->circleDots.debugName = "FSTUFF_CircleDots";
+    this->circleDots.type = FSTUFF_ShapeCircle;
+    this->circleDots.appearance = FSTUFF_ShapeAppearanceFilled;
+    this->circleDots.circle.numParts = kNumCircleParts;
+    this->circleDots.primitiveType = FSTUFF_PrimitiveTriangles;
+    {
+        gbVec4 vertices[2048];
+        const int numCirclePartsForDot = 6;
+        const float dotRadius = 0.08f;  // size of dot: 0 to 1; 0 is no-size, 1 is as big as containing-circle
+        const float dotDistance = 0.7f; // from 0 to 1
+        int tmpVertexCount;
+        this->circleDots.numVertices = 0;
+        for (int i = 0, n = 6; i < n; ++i) {
+            const float rad = float(i) * ((M_PI * 2.f) / float(n));
+            FSTUFF_MakeCircleFilledTriangles(
+                &vertices[this->circleDots.numVertices],
+                0,
+                &tmpVertexCount,
+                numCirclePartsForDot,
+                dotRadius,
+                cosf(rad) * dotDistance,
+                sinf(rad) * dotDistance
+            );
+            this->circleDots.numVertices += tmpVertexCount;
+        }
+        this->circleDots.gpuVertexBuffer = this->renderer->NewVertexBuffer(vertices, (this->circleDots.numVertices * sizeof(gbVec4)));
+    }
+
+    this->circleSDF.debugName = "FSTUFF_CircleSDF";
+    this->circleSDF.type = FSTUFF_ShapeCircle;
+    this->circleSDF.appearance = FSTUFF_ShapeAppearanceSDF;
+    this->circleSDF.circle.numDots = 0;
+    FSTUFF_ShapeInit(&(this->circleSDF), this->renderer);
+
+    this->circleSDFDotted.debugName = "FSTUFF_CircleSDFDotted";
+    this->circleSDFDotted.type = FSTUFF_ShapeCircle;
+    this->circleSDFDotted.appearance = FSTUFF_ShapeAppearanceSDF;
+    this->circleSDFDotted.circle.numDots = 6;
+    FSTUFF_ShapeInit(&(this->circleSDFDotted), this->renderer);
+
+    this->boxFilled.debugName = "FSTUFF_BoxEdged";
+    this->boxFilled.type = FSTUFF_ShapeBox;
+    this->boxFilled.appearance = FSTUFF_ShapeAppearanceFilled;
+    FSTUFF_ShapeInit(&(this->boxFilled), this->renderer);
+    
+    this->boxEdged.debugName = "FSTUFF_BoxEdged";
+    this->boxEdged.type = FSTUFF_ShapeBox;
+    this->boxEdged.appearance = FSTUFF_ShapeAppearanceEdged;
+    FSTUFF_ShapeInit(&(this->boxEdged), this->renderer);
+
+    this->segmentFilled.debugName = "FSTUFF_SegmentEdged";
+    this->segmentFilled.type = FSTUFF_ShapeSegment;
+    this->segmentFilled.appearance = FSTUFF_ShapeAppearanceFilled;
+    FSTUFF_ShapeInit(&(this->segmentFilled), this->renderer);
+
+    this->segmentEdged.debugName = "FSTUFF_SegmentEdged";
+    this->segmentEdged.type = FSTUFF_ShapeSegment;
+    this->segmentEdged.appearance = FSTUFF_ShapeAppearanceEdged;
+    FSTUFF_ShapeInit(&(this->segmentEdged), this->renderer);
+
+    this->debugShape.debugName = "FSTUFF_DebugShape";
+    this->debugShape.type = FSTUFF_ShapeDebug;
+    this->debugShape.appearance = FSTUFF_ShapeAppearanceFilled;
+    FSTUFF_ShapeInit(&(this->debugShape), this->renderer);
+}
+
+void FSTUFF_Simulation::InitWorld()
+{
+    //
+    // Random number generation init
+    //
+    const uint32_t worldSeed = this->seed ? this->seed : std::random_device()();
+    this->game.rng.seed(worldSeed);
+
+    //
+    // Physics-world init
+    //
+    memset(&circles, 0, sizeof(circles));
+    memset(&circleColors, 0, sizeof(circleColors));
+    memset(&boxes, 0, sizeof(boxes));
+    memset(&boxColors, 0, sizeof(boxColors));
+    memset(&segments, 0, sizeof(segments));
+    memset(&segmentColors, 0, sizeof(segmentColors));
+    memset(&bodies, 0, sizeof(bodies));
+#if FSTUFF_USE_HASTY_SPACE
+    if (this->physicsThreads != 1) {
+        this->physicsSpace = cpHastySpaceNew();
+        cpHastySpaceSetThreads(this->physicsSpace, (unsigned long) std::max(this->physicsThreads, 0));
+        this->game.physicsSpaceIsHasty = true;
+    } else
+#endif
+    {
+        this->physicsSpace = cpSpaceNew();
+    }
+    
+    cpSpaceSetIterations(this->physicsSpace, 2);
+    cpSpaceSetGravity(this->physicsSpace, this->game.gravity);
+    cpSpaceSetSleepTimeThreshold(this->physicsSpace, this->sleepTimeThresholdS);
+    switch (this->broadphase) {
+        case FSTUFF_BroadphaseBBTree:
+            break;
+        case FSTUFF_BroadphaseSpatialHash:
+            // Cells are sized to fit the largest marble; Chipmunk recommends
+            // ~10x as many cells as there are shapes.
+            cpSpaceUseSpatialHash(this->physicsSpace, this->game.marbleRadius_Range[1] * 2., 10 * FSTUFF_MaxShapes);
+            break;
+    }
+
+    cpBody * body;
+    cpShape * shape;
+    
+    
+    //
+    // Walls
+    //
+
+    static const cpFloat wallThickness = 5.0;
+    const cpFloat wallLeft   = -wallThickness / 2.;
+    const cpFloat wallRight  = this->GetWorldWidth() + (wallThickness / 2.);
+    const cpFloat wallBottom = -wallThickness / 2.;
+    const cpFloat wallTop    = this->GetWorldHeight() * 2.;   // use a high ceiling, to make sure off-screen falling things don't go over walls
+    
+#if ! FSTUFF_USE_DEBUG_PEGS
+    // Bottom
+    body = cpBodyInit(NewBody(), 0, 0);
     cpBodySetType(body, CP_BODY_TYPE_STATIC);
     cpSpaceAddBody(this->physicsSpace, body);
     cpBodySetPosition(body, cpv(0, 0));
@@ -483,104 +1524,64 @@ void FSTUFF_Simulation::InitWorld()
     //
     // Pegs
     //
-    using namespace FSTUFF_Colors;
-    const int pegColors[] = {
-        Red,
-        Red,
-        Lime,
-        Lime,
-        Blue,
-        Blue,
-        Yellow,
-        Cyan,
-    };
 #if FSTUFF_USE_DEBUG_PEGS
-//    const int numPegs = 1;
-    const int numPegs = 2;
-#else
-    const int numPegs = round((this->GetWorldWidth() * this->GetWorldHeight()) * 0.0005);
-#endif
-    const cpFloat kPegScaleCircle = 2.5;
-    const cpFloat kPegScaleBox = 4.;
-    cpFloat cx, cy, radius, w, h, angleRad;
-    int pegColorIndex;
-    for (int i = 0; i < numPegs; ++i) {
-#if FSTUFF_USE_DEBUG_PEGS
-        // const int which_peg_type = 0;
-        const int which_peg_type = 1;
-#else
-        const int which_peg_type = rand() % 2;
-#endif
-        switch (which_peg_type) {
-            case 0:
-            {
-#if FSTUFF_USE_DEBUG_PEGS
-                cx = (this->GetWorldWidth() / 4.) + (i * (this->GetWorldWidth() / 2));
-                cy = this->GetWorldHeight() / 2.;
-                radius = (this->GetWorldWidth() / 4.) + 10.f;
-                pegColorIndex = 0;
+    std::vector<FSTUFF_Peg> pegs(2);
+    for (size_t i = 0; i < pegs.size(); ++i) {
+        // pegs[i].type = FSTUFF_ShapeCircle;
+        pegs[i].type = FSTUFF_ShapeBox;
+        switch (pegs[i].type) {
+            case FSTUFF_ShapeCircle:
+                pegs[i].x = (this->GetWorldWidth() / 4.) + (i * (this->GetWorldWidth() / 2));
+                pegs[i].y = this->GetWorldHeight() / 2.;
+                pegs[i].radius = (this->GetWorldWidth() / 4.) + 10.f;
+                pegs[i].color = FSTUFF_Color((i % 2) ? FSTUFF_Colors::Green : FSTUFF_Colors::Blue);
+                break;
+            default:
+                pegs[i].x = this->GetWorldWidth() / 2.;
+                pegs[i].y = this->GetWorldHeight() / 2.;
+                pegs[i].width = 20;
+                pegs[i].height = 50;
+                pegs[i].angle = M_PI / 2.;
+                pegs[i].color = FSTUFF_Color(FSTUFF_Colors::Red);
+                break;
+        }
+    }
 #else
-                cx = FSTUFF_RandRangeF(this->game.rng, 0., this->GetWorldWidth());
-                cy = FSTUFF_RandRangeF(this->game.rng, 0., this->GetWorldHeight());
-                radius = kPegScaleCircle * FSTUFF_RandRangeF(this->game.rng, 6., 10.);
-                pegColorIndex = FSTUFF_RandRangeI(this->game.rng, 0, FSTUFF_countof(pegColors)-1);
+    FSTUFF_PegLayoutCache::Key pegsKey;
+    pegsKey.worldWidth = this->GetWorldWidth();
+    pegsKey.worldHeight = this->GetWorldHeight();
+    pegsKey.minSpacing = this->pegSpacing * this->game.marbleRadius_Range[1] * 2.;
+    while ( ! this->seed && ! this->pegsSeed) {
+        this->pegsSeed = std::random_device()();
+    }
+    pegsKey.seed = (this->seed ? worldSeed : this->pegsSeed);
+    pegsKey.count = (uint32_t) round((this->GetWorldWidth() * this->GetWorldHeight()) * 0.0005);
+    pegsKey.layout = this->pegLayout;
+    const std::vector<FSTUFF_Peg> pegs = this->pegLayouts.Get(pegsKey, (this->seed != 0));
 #endif
-
-                body = cpBodyInit(NewBody(), 0, 0);
-                cpBodySetType(body, CP_BODY_TYPE_STATIC);
-                cpSpaceAddBody(this->physicsSpace, body);
-                cpBodySetPosition(body, cpv(cx, cy));
-                shape = (cpShape*)cpCircleShapeInit(NewCircle(), body, radius, cpvzero);
+    for (const FSTUFF_Peg & peg : pegs) {
+        body = cpBodyInit(NewBody(), 0, 0);
+        cpBodySetType(body, CP_BODY_TYPE_STATIC);
+        cpSpaceAddBody(this->physicsSpace, body);
+        cpBodySetPosition(body, cpv(peg.x, peg.y));
+        switch (peg.type) {
+            case FSTUFF_ShapeCircle: {
+                shape = (cpShape*)cpCircleShapeInit(NewCircle(), body, peg.radius, cpvzero);
                 ++this->game.numPegs;
-                cpSpaceAddShape(this->physicsSpace, shape);
-                cpShapeSetElasticity(shape, kElasticity);
-                cpShapeSetFriction(shape, kFriction);
-                cpShapeSetSurfaceVelocity(shape, kSurfaceVelocity);
-#if FSTUFF_USE_DEBUG_PEGS
-                switch (i % 2) {
-                    case 0:
-                        this->circleColors[IndexOfCircle(shape)] = FSTUFF_Color(Blue);
-                        break;
-                    case 1:
-                        this->circleColors[IndexOfCircle(shape)] = FSTUFF_Color(Green);
-                        break;
-                }
-#else
-                this->circleColors[IndexOfCircle(shape)] = FSTUFF_Color(pegColors[pegColorIndex]);
-#endif
+                this->game.pegRadiusMax = std::max(this->game.pegRadiusMax, peg.radius);
+                this->circleColors[IndexOfCircle(shape)] = peg.color;
             } break;
-            
-            case 1:
-            {
-#if FSTUFF_USE_DEBUG_PEGS
-                cx = this->GetWorldWidth() / 2.;
-                cy = this->GetWorldHeight() / 2.;
-                w = 20;
-                h = 50;
-                angleRad = M_PI / 2.;
-                pegColorIndex = 0;
-#else
-                cx = FSTUFF_RandRangeF(this->game.rng, 0., this->GetWorldWidth());
-                cy = FSTUFF_RandRangeF(this->game.rng, 0., this->GetWorldHeight());
-                w = kPegScaleBox * FSTUFF_RandRangeF(this->game.rng, 6., 14.);
-                h = kPegScaleBox * FSTUFF_RandRangeF(this->game.rng, 1., 2.);
-                angleRad = FSTUFF_RandRangeF(this->game.rng, 0., M_PI);
-                pegColorIndex = FSTUFF_RandRangeI(this->game.rng, 0, FSTUFF_countof(pegColors)-1);
-#endif
 
-                body = cpBodyInit(NewBody(), 0, 0);
-                cpBodySetType(body, CP_BODY_TYPE_STATIC);
-                cpSpaceAddBody(this->physicsSpace, body);
-                cpBodySetPosition(body, cpv(cx, cy));
-                cpBodySetAngle(body, angleRad);
-                shape = (cpShape*)cpBoxShapeInit(NewBox(), body, w, h, 0.);
-                cpSpaceAddShape(this->physicsSpace, shape);
-                cpShapeSetElasticity(shape, kElasticity);
-                cpShapeSetFriction(shape, kFriction);
-                cpShapeSetSurfaceVelocity(shape, kSurfaceVelocity);
-                this->boxColors[IndexOfBox(shape)] = FSTUFF_Color(pegColors[pegColorIndex]);
+            default: {
+                cpBodySetAngle(body, peg.angle);
+                shape = (cpShape*)cpBoxShapeInit(NewBox(), body, peg.width, peg.height, 0.);
+                this->boxColors[IndexOfBox(shape)] = peg.color;
             } break;
         }
+        cpSpaceAddShape(this->physicsSpace, shape);
+        cpShapeSetElasticity(shape, kElasticity);
+        cpShapeSetFriction(shape, kFriction);
+        cpShapeSetSurfaceVelocity(shape, kSurfaceVelocity);
     }
     
 //    for (int i = 0; i < 1500; i++) {
@@ -602,6 +1603,7 @@ void FSTUFF_Simulation::AddMarble()
     cpShapeSetSurfaceVelocity(shape, kSurfaceVelocity);
     this->circleColors[IndexOfCircle(shape)] = FSTUFF_Color(FSTUFF_Colors::White);
     this->game.marblesCount += 1;
+    this->game.awakeBodies += 1;    // keeping AdvanceWorld() from skipping its steps, until the next recount
 }
 
 
@@ -616,6 +1618,7 @@ FSTUFF_Simulation::FSTUFF_Simulation() {
 
 FSTUFF_Simulation::~FSTUFF_Simulation() {
     // FSTUFF_Log("%s, this:%p, this->state:%d\n", __FUNCTION__, this, this->state);
+    this->StopPhysicsThread();
 }
 
 
@@ -670,7 +1673,9 @@ void FSTUFF_Simulation::Init() //, void * gpuDevice, void * nativeView)
         return;
     }
     
-    srand(time(nullptr));
+    if ( ! this->instanceJobs) {
+        this->instanceJobs.reset(new FSTUFF_JobPool(this->instanceThreads));
+    }
 
     // Reset relevant variables (in 'this->game')
     game = FSTUFF_Simulation::Resettable();
@@ -682,15 +1687,36 @@ void FSTUFF_Simulation::Init() //, void * gpuDevice, void * nativeView)
     this->keysPressed.reset();  // Mark all keys as being down/un-pressed
     FSTUFF_Assert(this->viewSize.widthPixels > 0);
     FSTUFF_Assert(this->viewSize.heightPixels > 0);
-    this->InitGPUShapes();
-    this->InitWorld();
+    {
+        FSTUFF_StartupStep step("InitGPUShapes");
+        this->InitGPUShapes();
+    }
+    {
+        FSTUFF_StartupStep step("InitWorld");
+        this->InitWorld();
+    }
 }
 
-void FSTUFF_Simulation::ResetWorld()
+void FSTUFF_Simulation::ResetWorld(bool keepPegs)
 {
+    const bool wasThreaded = this->StopPhysicsThread();
+    if ( ! keepPegs) {
+        this->pegsSeed = 0;     // i.e. pick another
+    }
     this->ShutdownWorld();
     this->game = FSTUFF_Simulation::Resettable();
     this->InitWorld();
+    if (wasThreaded) {
+        this->StartPhysicsThread();
+    }
+}
+
+// Current time, in seconds since UNIX epoch
+static double FSTUFF_NowUTCS()
+{
+    return
+        static_cast<double>(std::chrono::high_resolution_clock::now().time_since_epoch().count()) *
+        ((double) std::chrono::high_resolution_clock::period::num / (double) std::chrono::high_resolution_clock::period::den);
 }
 
 void FSTUFF_Simulation::Update()
@@ -708,47 +1734,151 @@ void FSTUFF_Simulation::Update()
     }
 #endif
 
-    // Compute current time
-    //
-    // nowS == current time, in seconds since UNIX epoch
-    const cpFloat nowS =
-        static_cast<cpFloat>(std::chrono::high_resolution_clock::now().time_since_epoch().count()) *
-        ((cpFloat) std::chrono::high_resolution_clock::period::num / (cpFloat) std::chrono::high_resolution_clock::period::den);
+    if (this->threadedPhysics && ! this->IsPhysicsThreadRunning()) {
+        this->StartPhysicsThread();
+    }
 
-    // Initialize simulation time vars, on first tick
-    if (this->game.lastUpdateUTCTimeS == 0.) {
-        this->game.lastUpdateUTCTimeS = nowS;
+    double deltaTimeS = 0.;
+    if (this->IsPhysicsThreadRunning()) {
+#if FSTUFF_ENABLE_PHYSICS_THREAD
+        // The physics thread keeps its own time.  This one's clock only
+        // drives the GUI.
+        const double nowS = FSTUFF_NowUTCS();
+        if (this->lastFrameUTCTimeS == 0.) {
+            this->lastFrameUTCTimeS = nowS;
+        }
+        deltaTimeS = std::min(nowS - this->lastFrameUTCTimeS, kMaxDeltaTimeS);
+        this->lastFrameUTCTimeS = nowS;
+
+        {
+            std::lock_guard<std::mutex> lock(this->physicsParamsMutex);
+            const bool restartSpawnTimer = this->physicsParamsPending.restartSpawnTimer || this->restartSpawnTimer;
+            this->physicsParamsPending = this->CurrentWorldParams();
+            this->physicsParamsPending.restartSpawnTimer = restartSpawnTimer;
+        }
+        this->restartSpawnTimer = false;
+
+        if (this->physicsResetWanted.load()) {
+            this->ResetWorld(true);     // as requested by a view size change
+        }
+#endif
+    } else {
+        // Compute current time
+        //
+        // nowS == current time, in seconds since UNIX epoch; or, if a fixed
+        // time-step is in use, in seconds since the world was created.
+        double nowS;
+        if (this->fixedTimeStepS > 0.) {
+            this->game.fixedClockS += this->fixedTimeStepS;
+            nowS = this->game.fixedClockS;
+        } else {
+            nowS = FSTUFF_NowUTCS();
+        }
+
+        this->ApplyWorldParams(this->CurrentWorldParams());
+        this->restartSpawnTimer = false;
+        if (this->AdvanceWorld(nowS, &deltaTimeS)) {
+            this->ResetWorld(true);     // as requested by a view size change
+        }
+        this->CaptureSnapshot(this->snapshots.WriteBuffer());
+        this->snapshots.Publish();
     }
 
-    // Compute delta-time, adjusting it down to kMaxDeltaTimeS as necessary.
-    // Adjustments down to kMaxDeltaTimeS are done as a sort of fix whereby
-    // large delta-time values, such as those generated when hiding and resuming
-    // an app (or web-page!).
-    double deltaTimeS = nowS - this->game.lastUpdateUTCTimeS;
-    if (deltaTimeS > kMaxDeltaTimeS) {
-        // const auto oldUpdateTimeS = this->game.lastUpdateUTCTimeS;
-        // const auto oldDtS = deltaTimeS;
-        this->game.lastUpdateUTCTimeS = nowS - kMaxDeltaTimeS;
-        deltaTimeS = kMaxDeltaTimeS;
-        // FSTUFF_Log("... adjusted last-update time (seconds) down to %f (from %f; now=%f)\n",
-        //     this->game.lastUpdateUTCTimeS, oldUpdateTimeS, nowS);
-        // FSTUFF_Log("... adjusted dt (seconds) down to %f (from %f)\n", deltaTimeS, oldDtS);
+    // Pick up the world's latest state
+    this->snapshots.Acquire();
+    const FSTUFF_WorldSnapshot & snapshot = this->snapshots.ReadBuffer();
+    this->stats.awakeBodies = snapshot.stats.awakeBodies;
+    this->stats.kineticEnergy = snapshot.stats.kineticEnergy;
+    this->stats.idle = snapshot.stats.idle;
+    this->stats.nextChangeInS = snapshot.stats.nextChangeInS;
+
+    this->BeginGUIFrame(deltaTimeS);
+
+    // Process GUI
+    if (this->showSettings) {
+//        ImGui::SetNextWindowSize(ImVec2(450, 200));
+//        ImGui::Begin("Settings", NULL, ImVec2(500, 200));
+        bool * closeBoxState = NULL;
+        if (this->configurationMode) {
+            closeBoxState = NULL;   // Don't show the close box, in Screen Saver configuration mode.
+        } else {
+            closeBoxState = &this->showSettings;
+        }
+        ImGui::Begin("Settings", closeBoxState, ImGuiWindowFlags_AlwaysAutoResize);
+        ImGui::SliderInt("Marbles, Max", &this->marblesMax, 0, 1000);
+        if (ImGui::SliderFloat("Spawn Rate (marbles/second)", &this->addNumMarblesPerSecond, 0, 10, "%.3f", 3.0f)) {
+            this->restartSpawnTimer = true;
+        }
+        ImGui::InvisibleButton("padding1", ImVec2(8, 8));
+        ImGui::Separator();
+        ImGui::InvisibleButton("padding2", ImVec2(8, 8));
+        if (ImGui::Button("Restart Simulation", ImVec2(400, 32))) {
+            this->ResetWorld();
+        }
+        if (this->configurationMode) {
+            ImGui::InvisibleButton("padding1", ImVec2(8, 8));
+            ImGui::Separator();
+            ImGui::InvisibleButton("padding2", ImVec2(8, 8));
+            if (ImGui::Button("OK", ImVec2(400, 32))) {
+//                FSTUFF_Log("%s, doEndConfiguration set to true for sim:%p\n", __PRETTY_FUNCTION__, this);
+                this->doEndConfiguration = true;
+            }
+        }
+        ImGui::InvisibleButton("padding2", ImVec2(8, 8));
+        ImGui::Separator();
+        ImGui::AlignTextToFramePadding();
+        ImGui::Text("written by David Lee Ludwig");
+        ImGui::SameLine();
+        if (ImGui::Button("http://dll.software")) {
+            FSTUFF_OpenWebPage("http://dll.software");
+        }
+        ImGui::End();
     }
-    this->game.elapsedTimeS += deltaTimeS;
 
+    // Build the frame's packet.  This reads the snapshot acquired above,
+    // which a "Restart Simulation" click won't have changed; the new world
+    // shows up next frame.
+    this->PrepareInstances(this->snapshots.ReadBuffer(), this->framePacket);
+    this->RecordDrawCommands(this->framePacket);
+    
+/*
+	self.unlit_peg_fill_alpha_min = 0.25
+	self.unlit_peg_fill_alpha_max = 0.45
+
+ pb.fill_alpha = rand_in_range(self.unlit_peg_fill_alpha_min, self.unlit_peg_fill_alpha_max)
+*/
+}
+
+bool FSTUFF_Simulation::IsGUIShown() const
+{
+    return this->showSettings || (FSTUFF_ENABLE_IMGUI_DEMO && this->showGUIDemo);
+}
+
+// Starts the renderer's frame, then ImGui's, if any of it is shown
+void FSTUFF_Simulation::BeginGUIFrame(double deltaTimeS)
+{
     // Rendering-initialization.  This is done *BEFORE* ImGui calls start,
     // which may involve texture-creation.  (Is this necessary?)
     this->renderer->BeginFrame();
 
+    // Skip ImGui entirely while none of it is shown, as is usual for
+    // screensavers.  Its font atlas doesn't get built, nor uploaded, until
+    // then.
+    this->isGUIFrameActive = this->IsGUIShown();
+    if ( ! this->isGUIFrameActive) {
+        return;
+    }
+
     // Update ImGui's low-level state
     ImGuiIO & io = ImGui::GetIO();
     if ( ! io.Fonts->TexID) {
+        FSTUFF_StartupStep step("ImGui font atlas");
         unsigned char *pixels;
         int width, height;
-        io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height); // Load as RGBA 32-bits (75% of the memory is wasted, but default font is so small) because it is more likely to be compatible with user's existing shaders. If your ImTextureId represent a higher-level concept than just a GL texture id, consider calling GetTexDataAsAlpha8() instead to save on GPU memory.
-        io.Fonts->TexID = this->renderer->NewTexture(pixels, width, height);
+        io.Fonts->GetTexDataAsAlpha8(&pixels, &width, &height);     // 1/4 the memory of RGBA32; the font only needs coverage
+        io.Fonts->TexID = this->renderer->NewTexture(pixels, width, height, FSTUFF_TextureFormat::Alpha8);
     }
-    io.DeltaTime = deltaTimeS;
+    io.DeltaTime = (float) deltaTimeS;
     io.DisplaySize.x = this->viewSize.widthOS;
     io.DisplaySize.y = this->viewSize.heightOS;
     io.DisplayFramebufferScale.x = (float)this->viewSize.widthPixels / (float)this->viewSize.widthOS;
@@ -765,105 +1895,140 @@ void FSTUFF_Simulation::Update()
         ImGui::ShowDemoWindow();
     }
 #endif
+}
+
+void FSTUFF_Simulation::UpdateFromPacket()
+{
+    if (this->state == FSTUFF_DEAD) {
+        this->Init();
+    }
+
+    const double nowS = FSTUFF_NowUTCS();
+    if (this->lastFrameUTCTimeS == 0.) {
+        this->lastFrameUTCTimeS = nowS;
+    }
+    const double deltaTimeS = std::min(nowS - this->lastFrameUTCTimeS, kMaxDeltaTimeS);
+    this->lastFrameUTCTimeS = nowS;
+
+    this->BeginGUIFrame(deltaTimeS);
+}
+
+FSTUFF_WorldParams FSTUFF_Simulation::CurrentWorldParams() const
+{
+    FSTUFF_WorldParams params;
+    params.marblesMax = this->marblesMax;
+    params.addNumMarblesPerSecond = this->addNumMarblesPerSecond;
+    params.restartSpawnTimer = this->restartSpawnTimer;
+    return params;
+}
+
+void FSTUFF_Simulation::ApplyWorldParams(const FSTUFF_WorldParams & params)
+{
+    this->worldParams = params;
+    if (params.restartSpawnTimer) {
+        this->game.addMarblesInS = 1.f / params.addNumMarblesPerSecond;
+    }
+}
+
+// Advances the world up to 'nowS': adds marbles, steps physics, and counts
+// down to resets.  Returns true if the world is due for a reset, which the
+// caller must do.  Only call this from whichever thread owns the world.
+bool FSTUFF_Simulation::AdvanceWorld(double nowS, double * deltaTimeS)
+{
+    // Initialize simulation time vars, on first tick
+    if (this->game.lastUpdateUTCTimeS == 0.) {
+        this->game.lastUpdateUTCTimeS = nowS;
+    }
+
+    // Compute delta-time, adjusting it down to kMaxDeltaTimeS as necessary.
+    // Adjustments down to kMaxDeltaTimeS are done as a sort of fix whereby
+    // large delta-time values, such as those generated when hiding and resuming
+    // an app (or web-page!).
+    double dt = nowS - this->game.lastUpdateUTCTimeS;
+    if (dt > kMaxDeltaTimeS) {
+        this->game.lastUpdateUTCTimeS = nowS - kMaxDeltaTimeS;
+        dt = kMaxDeltaTimeS;
+    }
+    this->game.elapsedTimeS += dt;
+    *deltaTimeS = dt;
 
     // Add marbles, as warranted
-    if (this->game.marblesCount < this->marblesMax) {
-        if (this->addNumMarblesPerSecond > 0) {
-            this->game.addMarblesInS -= deltaTimeS;
+    if (this->game.marblesCount < this->worldParams.marblesMax) {
+        if (this->worldParams.addNumMarblesPerSecond > 0) {
+            this->game.addMarblesInS -= (float) dt;
             if (this->game.addMarblesInS <= 0) {
                 this->AddMarble();
-                this->game.addMarblesInS = 1.f / this->addNumMarblesPerSecond;
+                this->game.addMarblesInS = 1.f / this->worldParams.addNumMarblesPerSecond;
             }
         }
     }
 
-    // Update physics
-    while ((this->game.lastUpdateUTCTimeS + FSTUFF_kPhysicsStepTimeS) <= nowS) {
-        cpSpaceStep(this->physicsSpace, FSTUFF_kPhysicsStepTimeS);
-        this->game.lastUpdateUTCTimeS += FSTUFF_kPhysicsStepTimeS;
+    // Update physics.  This gets skipped if the scene was idle, and remains
+    // so (nothing new got added).  Once every marble has gone to sleep,
+    // stepping would change nothing.  Awake bodies got counted by the last
+    // CaptureSnapshot(), which follows every pass, so they needn't get
+    // walked again, here.  AddMarble() counts its marble, right away, so
+    // a marble added above gets stepped, even if all others sleep.
+    FSTUFF_SimulationStats activity;
+    activity.awakeBodies = this->game.awakeBodies;
+    this->UpdateStats(activity);
+    if (activity.idle) {
+        this->game.lastUpdateUTCTimeS = nowS;
+    }
+    while ((this->game.lastUpdateUTCTimeS + this->physicsStepS) <= nowS) {
+        this->StepPhysics(this->physicsStepS);
+        this->game.lastUpdateUTCTimeS += this->physicsStepS;
     }
 
-    // Reset world, if warranted
-    if (this->game.marblesCount >= this->marblesMax) {
+    // Count down to a reset, if one is warranted
+    bool resetDue = false;
+    if (this->game.marblesCount >= this->worldParams.marblesMax) {
         if (this->game.resetInS_default > 0) {
             if (this->game.resetInS <= 0) {
                 this->game.resetInS = this->game.resetInS_default;
             } else {
-                this->game.resetInS -= deltaTimeS;
+                this->game.resetInS -= dt;
             }
         }
         if (this->game.resetInS <= 0) {
-            this->ResetWorld();
+            resetDue = true;
         }
     }
     if (this->game.forceResetEnabled) {
-        this->game.forceResetInS -= deltaTimeS;
+        this->game.forceResetInS -= dt;
         if (this->game.forceResetInS <= 0.) {
-            this->ResetWorld();
+            resetDue = true;
         }
     }
-    
-    // Process GUI
-    if (this->showSettings) {
-//        ImGui::SetNextWindowSize(ImVec2(450, 200));
-//        ImGui::Begin("Settings", NULL, ImVec2(500, 200));
-        bool * closeBoxState = NULL;
-        if (this->configurationMode) {
-            closeBoxState = NULL;   // Don't show the close box, in Screen Saver configuration mode.
-        } else {
-            closeBoxState = &this->showSettings;
-        }
-        ImGui::Begin("Settings", closeBoxState, ImGuiWindowFlags_AlwaysAutoResize);
-        ImGui::SliderInt("Marbles, Max", &this->marblesMax, 0, 1000);
-        if (ImGui::SliderFloat("Spawn Rate (marbles/second)", &this->addNumMarblesPerSecond, 0, 10, "%.3f", 3.0f)) {
-            this->game.addMarblesInS = 1.f / this->addNumMarblesPerSecond;
-        }
-        ImGui::InvisibleButton("padding1", ImVec2(8, 8));
-        ImGui::Separator();
-        ImGui::InvisibleButton("padding2", ImVec2(8, 8));
-        if (ImGui::Button("Restart Simulation", ImVec2(400, 32))) {
-            this->ResetWorld();
-        }
-        if (this->configurationMode) {
-            ImGui::InvisibleButton("padding1", ImVec2(8, 8));
-            ImGui::Separator();
-            ImGui::InvisibleButton("padding2", ImVec2(8, 8));
-            if (ImGui::Button("OK", ImVec2(400, 32))) {
-//                FSTUFF_Log("%s, doEndConfiguration set to true for sim:%p\n", __PRETTY_FUNCTION__, this);
-                this->doEndConfiguration = true;
-            }
-        }
-        ImGui::InvisibleButton("padding2", ImVec2(8, 8));
-        ImGui::Separator();
-        ImGui::AlignTextToFramePadding();
-        ImGui::Text("written by David Lee Ludwig");
-        ImGui::SameLine();
-        if (ImGui::Button("http://dll.software")) {
-            FSTUFF_OpenWebPage("http://dll.software");
-        }
-        ImGui::End();
-    }
+    return resetDue;
+}
 
-    // Copy simulation/game data to GPU-accessible buffers
-    this->renderer->SetProjectionMatrix(this->projectionMatrix);
-    for (size_t i = 0; i < this->game.numCircles; ++i) {
-        cpFloat shapeRadius = cpCircleShapeGetRadius((cpShape*)GetCircle(i));
+// Copies every shape's placement, plus physics stats, out of the world
+void FSTUFF_Simulation::CaptureSnapshot(FSTUFF_WorldSnapshot & snapshot)
+{
+    // Marbles' activity gets measured in the same pass as their placement
+    snapshot.stats.awakeBodies = 0;
+    snapshot.stats.kineticEnergy = 0.;
+    FSTUFF_WorldSnapshot::Shape * dest = snapshot.shapes;
+    for (size_t i = 0; i < this->game.numCircles; ++i, ++dest) {
+        const cpFloat radius = cpCircleShapeGetRadius((cpShape*)GetCircle(i));
         cpBody * body = cpShapeGetBody((cpShape*)GetCircle(i));
-        cpVect bodyCenter = cpBodyGetPosition(body);
-        cpFloat bodyAngle = cpBodyGetAngle(body);
-        
-        gbMat4 dest, tmp;
-        gb_mat4_identity(&dest);
-        gb_mat4_translate(&tmp, {(float)bodyCenter.x, (float)bodyCenter.y, 0.});
-        dest *= tmp;
-        gb_mat4_rotate(&tmp, {0., 0., 1.}, bodyAngle);
-        dest *= tmp;
-        gb_mat4_scale(&tmp, {(float)shapeRadius, (float)shapeRadius, 1});
-        dest *= tmp;
-
-        this->renderer->SetShapeProperties(FSTUFF_ShapeCircle, i, dest, this->circleColors[i]);
+        const cpVect bodyCenter = cpBodyGetPosition(body);
+        if (i >= this->game.numPegs && cpBodyGetType(body) == CP_BODY_TYPE_DYNAMIC && ! cpBodyIsSleeping(body)) {
+            const cpFloat angularVelocity = cpBodyGetAngularVelocity(body);
+            snapshot.stats.awakeBodies += 1;
+            snapshot.stats.kineticEnergy +=
+                (0.5 * cpBodyGetMass(body) * cpvlengthsq(cpBodyGetVelocity(body))) +
+                (0.5 * cpBodyGetMoment(body) * angularVelocity * angularVelocity);
+        }
+        *dest = {
+            (float)bodyCenter.x, (float)bodyCenter.y, (float)cpBodyGetAngle(body),
+            (float)radius, (float)radius, (float)radius,
+            this->circleColors[i]
+        };
     }
-    for (size_t i = 0; i < this->game.numBoxes; ++i) {
+
+    for (size_t i = 0; i < this->game.numBoxes; ++i, ++dest) {
         FSTUFF_Assert(cpPolyShapeGetCount((cpShape*)GetBox(i)) == 4);
         const cpVect bottomRight = cpPolyShapeGetVert((cpShape*)GetBox(i), 0);
         const cpVect topRight    = cpPolyShapeGetVert((cpShape*)GetBox(i), 1);
@@ -874,88 +2039,290 @@ void FSTUFF_Simulation::Update()
         FSTUFF_Assert(h >= 0);
         const cpBody * body      = cpShapeGetBody((cpShape*)GetBox(i));
         const cpVect bodyCenter  = cpBodyGetPosition(body);
-        const cpFloat bodyAngle  = cpBodyGetAngle(body);
-
-        gbMat4 dest, tmp;
-        gb_mat4_identity(&dest);
-        gb_mat4_translate(&tmp, {(float)bodyCenter.x, (float)bodyCenter.y, 0.});
-        dest *= tmp;
-        gb_mat4_rotate(&tmp, {0., 0., 1.}, bodyAngle);
-        dest *= tmp;
-        gb_mat4_scale(&tmp, {(float)w, (float)h, 1.});
-        dest *= tmp;
-
-        this->renderer->SetShapeProperties(FSTUFF_ShapeBox, i, dest, this->boxColors[i]);
+        *dest = {
+            (float)bodyCenter.x, (float)bodyCenter.y, (float)cpBodyGetAngle(body),
+            (float)w, (float)h, (float)(0.5 * sqrt((w * w) + (h * h))),
+            this->boxColors[i]
+        };
     }
-    for (size_t i = 0; i < this->game.numSegments; ++i) {
+
+    for (size_t i = 0; i < this->game.numSegments; ++i, ++dest) {
         cpVect a = cpSegmentShapeGetA((cpShape*)GetSegment(i));
         cpVect b = cpSegmentShapeGetB((cpShape*)GetSegment(i));
         cpVect center = cpvlerp(a, b, 0.5);
         cpFloat radius = cpSegmentShapeGetRadius((cpShape*)GetSegment(i));
         cpBody * body = cpShapeGetBody((cpShape*)GetSegment(i));
-        cpVect bodyCenter = cpBodyGetPosition(body);
-        cpFloat bodyAngle = cpBodyGetAngle(body);
-
-        gbMat4 dest, tmp;
-        gb_mat4_identity(&dest);
-        gb_mat4_translate(&tmp, {(float)bodyCenter.x, (float)bodyCenter.y, 0.});
-        dest *= tmp;
-        gb_mat4_rotate(&tmp, {0., 0., 1.}, bodyAngle);
-        dest *= tmp;
-        gb_mat4_translate(&tmp, {(float)center.x, (float)center.y, 0.});
-        dest *= tmp;
-        gb_mat4_rotate(&tmp, {0., 0., 1.}, cpvtoangle(b-a));
-        dest *= tmp;
-        gb_mat4_scale(&tmp, {(float)cpvlength(b-a), (float)(radius*2.), 1.});
-        dest *= tmp;
-        
-        this->renderer->SetShapeProperties(FSTUFF_ShapeSegment, i, dest, this->segmentColors[i]);
+        cpVect worldCenter = cpBodyLocalToWorld(body, center);
+
+        // Body transform * segment's local transform, folded into a
+        // single translate + rotate + scale
+        const cpFloat angle = cpBodyGetAngle(body) + cpvtoangle(b-a);
+        *dest = {
+            (float)worldCenter.x, (float)worldCenter.y, (float)angle,
+            (float)cpvlength(b-a), (float)(radius*2.), (float)((0.5 * cpvlength(b-a)) + radius),
+            this->segmentColors[i]
+        };
+    }
+
+    snapshot.numPegs = this->game.numPegs;
+    snapshot.numCircles = this->game.numCircles;
+    snapshot.numBoxes = this->game.numBoxes;
+    snapshot.numSegments = this->game.numSegments;
+    snapshot.pegRadiusMax = this->game.pegRadiusMax;
+    snapshot.marbleRadiusMax = this->game.marbleRadius_Range[1];
+    this->game.awakeBodies = snapshot.stats.awakeBodies;
+    this->UpdateStats(snapshot.stats);
+}
+
+// Fills a packet's instances from a snapshot's shapes.  Shapes whose
+// bounding circles are outside the visible world rectangle get culled;
+// survivors get compacted, in order, to the front of their bucket.  If the
+// renderer allows it, instances get built directly into its memory, rather
+// than into the packet.
+void FSTUFF_Simulation::PrepareInstances(const FSTUFF_WorldSnapshot & snapshot, FSTUFF_FramePacket & packet)
+{
+    packet.projectionMatrix = this->projectionMatrix;
+    FSTUFF_CullRect view;
+    view.minX = (float) -this->game.viewTranslation.x;
+    view.minY = (float) -this->game.viewTranslation.y;
+    view.maxX = (float) (view.minX + this->GetWorldWidth());
+    view.maxY = (float) (view.minY + this->GetWorldHeight());
+    view.enabled = this->cullInstances;
+
+    FSTUFF_ShapeInstance * dest = this->buildInstancesInPlace ? this->renderer->MapShapeInstances() : nullptr;
+    packet.instancesInRenderer = (dest != nullptr);
+    if ( ! dest) {
+        dest = packet.instances;
     }
 
+    size_t visibleCounts[4];
+    FSTUFF_InstanceBatch & batch = this->instances;
+    FSTUFF_GatherInstances(*this->instanceJobs, snapshot, view, batch, dest, visibleCounts);
+    this->visible.pegs = visibleCounts[0];
+    this->visible.marbles = visibleCounts[1];
+    this->visible.boxes = visibleCounts[2];
+    this->visible.segments = visibleCounts[3];
+    packet.numInstances[FSTUFF_ShapeCircle] = (uint32_t) (this->visible.pegs + this->visible.marbles);
+    packet.numInstances[FSTUFF_ShapeBox] = (uint32_t) this->visible.boxes;
+    packet.numInstances[FSTUFF_ShapeSegment] = (uint32_t) this->visible.segments;
+    packet.numInstances[FSTUFF_ShapeDebug] = 0;
 
 #if FSTUFF_USE_DEBUG_PEGS
     {
-        gbMat4 dest, tmp;
-        gb_mat4_identity(&dest);
+        gbMat4 transform, tmp;
+        gb_mat4_identity(&transform);
         gb_mat4_translate(&tmp, {20., 50., 0.});
-        dest *= tmp;
+        transform *= tmp;
         gb_mat4_rotate(&tmp, {0., 0., 1.}, 0.);
-        dest *= tmp;
+        transform *= tmp;
         gb_mat4_scale(&tmp, {20., 20., 1.});
-        dest *= tmp;
+        transform *= tmp;
 
-        this->renderer->SetShapeProperties(FSTUFF_ShapeDebug, 0, dest, FSTUFF_Color(0x00ff00));
+        dest[packet.FirstInstance(FSTUFF_ShapeDebug)] = {transform, FSTUFF_Color(0x00ff00)};
+        packet.numInstances[FSTUFF_ShapeDebug] = 1;
     }
 #endif
-    
-/*
-	self.unlit_peg_fill_alpha_min = 0.25
-	self.unlit_peg_fill_alpha_max = 0.45
 
- pb.fill_alpha = rand_in_range(self.unlit_peg_fill_alpha_min, self.unlit_peg_fill_alpha_max)
-*/
+    const uint32_t numInstances = packet.TotalInstances();
+    if (packet.instancesInRenderer) {
+        this->renderer->UnmapShapeInstances(numInstances);
+    }
+    this->stats.instanceBytes = numInstances * (uint32_t) sizeof(FSTUFF_ShapeInstance);
+    this->stats.instanceBytesInPlace = packet.instancesInRenderer ? this->stats.instanceBytes : 0;
+    this->stats.culledInstances = (int32_t) (
+        (snapshot.numCircles + snapshot.numBoxes + snapshot.numSegments) -
+        batch.count
+    );
 }
 
-void FSTUFF_Simulation::Render()
+bool FSTUFF_Simulation::IsPhysicsThreadRunning() const
 {
-    renderer->RenderShapes(&circleFilled, 0,            game.numCircles,                0.35f);
-    renderer->RenderShapes(&circleDots,   game.numPegs, game.numCircles - game.numPegs, 1.0f);
-    renderer->RenderShapes(&circleEdged,  0,            game.numCircles,                1.0f);
-    renderer->RenderShapes(&boxFilled,    0,            game.numBoxes,                  0.35f);
-    renderer->RenderShapes(&boxEdged,     0,            game.numBoxes,                  1.0f);
-    renderer->RenderShapes(&segmentFilled,0,            game.numSegments,               0.35f);
-    renderer->RenderShapes(&segmentEdged, 0,            game.numSegments,               1.0f);
+#if FSTUFF_ENABLE_PHYSICS_THREAD
+    return this->physicsThread.joinable();
+#else
+    return false;
+#endif
+}
 
-#if FSTUFF_USE_DEBUG_PEGS
-    renderer->RenderShapes(&debugShape, 0, 1, 0.5678);
+// Moves physics onto its own thread, which advances the world every
+// physicsPublishIntervalS, publishing an FSTUFF_WorldSnapshot each time.
+// Update() then renders whichever snapshot is latest, without waiting on the
+// solver.  Falls back to running physics inline, if threading isn't possible.
+void FSTUFF_Simulation::StartPhysicsThread()
+{
+    if (this->IsPhysicsThreadRunning() || this->state == FSTUFF_DEAD) {
+        return;
+    }
+#if FSTUFF_ENABLE_PHYSICS_THREAD
+    if (this->fixedTimeStepS > 0.) {
+        FSTUFF_Log("Threaded physics can't be used with a fixed time-step; running physics inline\n");
+        this->threadedPhysics = false;
+        return;
+    }
+
+    // Publish the world as it stands, so that rendering has something
+    // current, even before the thread's first pass.
+    this->ApplyWorldParams(this->CurrentWorldParams());
+    this->physicsParamsPending = this->worldParams;
+    this->physicsParamsPending.restartSpawnTimer = false;
+    this->restartSpawnTimer = false;
+    this->CaptureSnapshot(this->snapshots.WriteBuffer());
+    this->snapshots.Publish();
+
+    this->physicsThreadQuit.store(false);
+    this->physicsResetWanted.store(false);
+    this->physicsThread = std::thread(&FSTUFF_Simulation::PhysicsThreadMain, this);
+#else
+    FSTUFF_Log("Threaded physics is not supported by this build; running physics inline\n");
+    this->threadedPhysics = false;
 #endif
+}
 
-    ImGui::EndFrame();
-    ImGui::Render();
+bool FSTUFF_Simulation::StopPhysicsThread()
+{
+#if FSTUFF_ENABLE_PHYSICS_THREAD
+    if (this->physicsThread.joinable()) {
+        this->physicsThreadQuit.store(true);
+        this->physicsThread.join();
+        return true;
+    }
+#endif
+    return false;
+}
+
+void FSTUFF_Simulation::PhysicsThreadMain()
+{
+#if FSTUFF_ENABLE_PHYSICS_THREAD
+    double nextPassS = FSTUFF_NowUTCS();
+    while ( ! this->physicsThreadQuit.load()) {
+        {
+            std::lock_guard<std::mutex> lock(this->physicsParamsMutex);
+            this->ApplyWorldParams(this->physicsParamsPending);
+            this->physicsParamsPending.restartSpawnTimer = false;
+        }
+
+        // Once a reset is due, the world stays put until the main thread
+        // does it (after stopping this thread).
+        if ( ! this->physicsResetWanted.load()) {
+            double deltaTimeS = 0.;
+            if (this->AdvanceWorld(FSTUFF_NowUTCS(), &deltaTimeS)) {
+                this->physicsResetWanted.store(true);
+            }
+            this->CaptureSnapshot(this->snapshots.WriteBuffer());
+            this->snapshots.Publish();
+        }
+
+        // Wait for the next pass.  Passes that ran long don't get caught up
+        // on; AdvanceWorld() steps through however much time has passed.
+        nextPassS += this->physicsPublishIntervalS;
+        const double nowS = FSTUFF_NowUTCS();
+        if (nextPassS < nowS) {
+            nextPassS = nowS;
+        } else {
+            std::this_thread::sleep_for(std::chrono::duration<double>(nextPassS - nowS));
+        }
+    }
+#endif
+}
+
+// Judges scene activity, given s.awakeBodies (as counted by
+// CaptureSnapshot()).  The scene is idle if every marble is asleep, and
+// none are getting added.  Resets are still timed while idle; nextChangeInS
+// tells hosts how long they may wait, before the next Update() is needed.
+void FSTUFF_Simulation::UpdateStats(FSTUFF_SimulationStats & s)
+{
+    const bool addingMarbles = (this->game.marblesCount < this->worldParams.marblesMax) && (this->worldParams.addNumMarblesPerSecond > 0);
+    s.idle = (this->physicsSpace != nullptr) && (s.awakeBodies == 0) && ! addingMarbles;
+    s.nextChangeInS = INFINITY;
+    if (addingMarbles) {
+        s.nextChangeInS = std::max(0., (double)this->game.addMarblesInS);
+    }
+    if (this->game.marblesCount >= this->worldParams.marblesMax && this->game.resetInS_default > 0) {
+        s.nextChangeInS = std::min(s.nextChangeInS, std::max(0., (this->game.resetInS > 0) ? this->game.resetInS : this->game.resetInS_default));
+    }
+    if (this->game.forceResetEnabled) {
+        s.nextChangeInS = std::min(s.nextChangeInS, std::max(0., this->game.forceResetInS));
+    }
+}
+
+void FSTUFF_Simulation::StepPhysics(cpFloat dt)
+{
+#if FSTUFF_USE_HASTY_SPACE
+    if (this->game.physicsSpaceIsHasty) {
+        cpHastySpaceStep(this->physicsSpace, dt);
+        return;
+    }
+#endif
+    cpSpaceStep(this->physicsSpace, dt);
+}
+
+// Records the draws for a packet's instances, picking circles' appearance
+void FSTUFF_Simulation::RecordDrawCommands(FSTUFF_FramePacket & packet)
+{
+    packet.numDrawCommands = 0;
+    if (this->useSDFCircles && renderer->SupportsSDFCircles()) {
+        // One pass each for pegs and marbles; 'alpha' applies to fills, only
+        packet.AddDrawCommand(FSTUFF_ShapeIDCircleSDF,       0,            visible.pegs,    0.35f);
+        packet.AddDrawCommand(FSTUFF_ShapeIDCircleSDFDotted, visible.pegs, visible.marbles, 0.35f);
+        this->stats.pegCircleParts = 0;
+        this->stats.marbleCircleParts = 0;
+    } else {
+        // Meshes get picked per bucket, from the bucket's largest radius
+        const FSTUFF_WorldSnapshot & snapshot = this->snapshots.ReadBuffer();
+        const int pegLOD = this->CircleLODForRadius(snapshot.pegRadiusMax);
+        const int marbleLOD = this->CircleLODForRadius(snapshot.marbleRadiusMax);
+        packet.AddDrawCommand((FSTUFF_ShapeID)(FSTUFF_ShapeIDCircleFilled + pegLOD),    0,            visible.pegs,    0.35f);
+        packet.AddDrawCommand((FSTUFF_ShapeID)(FSTUFF_ShapeIDCircleFilled + marbleLOD), visible.pegs, visible.marbles, 0.35f);
+        packet.AddDrawCommand(FSTUFF_ShapeIDCircleDots,                                 visible.pegs, visible.marbles, 1.0f);
+        packet.AddDrawCommand((FSTUFF_ShapeID)(FSTUFF_ShapeIDCircleEdged + pegLOD),     0,            visible.pegs,    1.0f);
+        packet.AddDrawCommand((FSTUFF_ShapeID)(FSTUFF_ShapeIDCircleEdged + marbleLOD),  visible.pegs, visible.marbles, 1.0f);
+        this->stats.pegCircleParts = circleFilled[pegLOD].circle.numParts;
+        this->stats.marbleCircleParts = circleFilled[marbleLOD].circle.numParts;
+    }
+    packet.AddDrawCommand(FSTUFF_ShapeIDBoxFilled,      0,  visible.boxes,      0.35f);
+    packet.AddDrawCommand(FSTUFF_ShapeIDBoxEdged,       0,  visible.boxes,      1.0f);
+    packet.AddDrawCommand(FSTUFF_ShapeIDSegmentFilled,  0,  visible.segments,   0.35f);
+    packet.AddDrawCommand(FSTUFF_ShapeIDSegmentEdged,   0,  visible.segments,   1.0f);
+    packet.AddDrawCommand(FSTUFF_ShapeIDDebug,          0,  packet.numInstances[FSTUFF_ShapeDebug], 0.5678f);
+}
+
+FSTUFF_Shape * FSTUFF_Simulation::GetShape(FSTUFF_ShapeID id)
+{
+    if (id >= FSTUFF_ShapeIDCircleFilled && id < FSTUFF_ShapeIDCircleEdged) {
+        return &this->circleFilled[id - FSTUFF_ShapeIDCircleFilled];
+    }
+    if (id >= FSTUFF_ShapeIDCircleEdged && id < FSTUFF_ShapeIDCircleDots) {
+        return &this->circleEdged[id - FSTUFF_ShapeIDCircleEdged];
+    }
+    switch (id) {
+        case FSTUFF_ShapeIDCircleDots:          return &this->circleDots;
+        case FSTUFF_ShapeIDCircleSDF:           return &this->circleSDF;
+        case FSTUFF_ShapeIDCircleSDFDotted:     return &this->circleSDFDotted;
+        case FSTUFF_ShapeIDBoxFilled:           return &this->boxFilled;
+        case FSTUFF_ShapeIDBoxEdged:            return &this->boxEdged;
+        case FSTUFF_ShapeIDSegmentFilled:       return &this->segmentFilled;
+        case FSTUFF_ShapeIDSegmentEdged:        return &this->segmentEdged;
+        case FSTUFF_ShapeIDDebug:               return &this->debugShape;
+        default:                                return nullptr;
+    }
+}
+
+void FSTUFF_Simulation::Render()
+{
+    renderer->RenderFrame(this->framePacket);
+
+    if (this->isGUIFrameActive) {
+        ImGui::EndFrame();
+        ImGui::Render();
+    }
 }
 
 void FSTUFF_Simulation::ViewChanged(const FSTUFF_ViewSize & viewSize)
 {
+    // The physics thread reads the world's size (see GetWorldWidth()), when
+    // adding marbles, so it must not be running while that changes.
+    const bool wasThreaded = this->StopPhysicsThread();
+
     this->viewChangedCount++;
     this->viewSize = viewSize;
     this->UpdateProjectionMatrix();
@@ -967,12 +2334,45 @@ void FSTUFF_Simulation::ViewChanged(const FSTUFF_ViewSize & viewSize)
         this->game.forceResetEnabled = true;
         this->game.forceResetInS = 2.0f; // Wait a little bit before resetting, in case multiple ViewChanged calls come in
     }
+
+    if (wasThreaded) {
+        this->StartPhysicsThread();
+    }
+}
+
+cpFloat FSTUFF_Simulation::GetPixelsPerWorldUnit() const
+{
+    const cpFloat worldWidth = this->GetWorldWidth();
+    if (worldWidth <= 0.) {
+        return 0.;
+    }
+    return (cpFloat)this->viewSize.widthPixels / worldWidth;
+}
+
+// Returns the index of the coarsest circle mesh whose sagitta (the largest
+// gap between a part's chord and the true circle) stays under
+// kCircleLODMaxErrorPixels, at the given radius.
+int FSTUFF_Simulation::CircleLODForRadius(cpFloat worldRadius) const
+{
+    const cpFloat radiusPixels = worldRadius * this->GetPixelsPerWorldUnit();
+    for (int lod = 0; lod < (FSTUFF_NumCircleLODs - 1); ++lod) {
+        const cpFloat numParts = (cpFloat)(kCircleLODMinParts << lod);
+        if (radiusPixels * (1. - cos(M_PI / numParts)) <= kCircleLODMaxErrorPixels) {
+            return lod;
+        }
+    }
+    return FSTUFF_NumCircleLODs - 1;
 }
 
 void FSTUFF_Simulation::SetGlobalScale(cpVect scale)
 {
+    // As with ViewChanged(), this changes the world's size
+    const bool wasThreaded = this->StopPhysicsThread();
     this->globalScale = scale;
     this->UpdateProjectionMatrix();
+    if (wasThreaded) {
+        this->StartPhysicsThread();
+    }
 }
 
 void FSTUFF_Simulation::UpdateProjectionMatrix()
@@ -1048,6 +2448,7 @@ void FSTUFF_Simulation::UpdateCursorInfo(const FSTUFF_CursorInfo & newInfo)
 
 void FSTUFF_Simulation::ShutdownWorld()
 {
+    this->StopPhysicsThread();
     for (size_t i = 0; i < this->game.numCircles; ++i) {
         cpShapeDestroy((cpShape*)GetCircle(i));
     }
@@ -1062,7 +2463,14 @@ void FSTUFF_Simulation::ShutdownWorld()
     }
 //    cpSpaceDestroy(this->world.physicsSpace);
     if (this->physicsSpace) {
-        cpSpaceFree(this->physicsSpace);
+#if FSTUFF_USE_HASTY_SPACE
+        if (this->game.physicsSpaceIsHasty) {
+            cpHastySpaceFree(this->physicsSpace);
+        } else
+#endif
+        {
+            cpSpaceFree(this->physicsSpace);
+        }
         this->physicsSpace = nullptr;
     }
 }
@@ -1072,11 +2480,19 @@ void FSTUFF_Simulation::ShutdownGPU()
     if (this->circleDots.gpuVertexBuffer) {
         this->renderer->DestroyVertexBuffer(this->circleDots.gpuVertexBuffer);
     }
-    if (this->circleEdged.gpuVertexBuffer) {
-        this->renderer->DestroyVertexBuffer(this->circleEdged.gpuVertexBuffer);
+    for (int lod = 0; lod < FSTUFF_NumCircleLODs; ++lod) {
+        if (this->circleEdged[lod].gpuVertexBuffer) {
+            this->renderer->DestroyVertexBuffer(this->circleEdged[lod].gpuVertexBuffer);
+        }
+        if (this->circleFilled[lod].gpuVertexBuffer) {
+            this->renderer->DestroyVertexBuffer(this->circleFilled[lod].gpuVertexBuffer);
+        }
+    }
+    if (this->circleSDF.gpuVertexBuffer) {
+        this->renderer->DestroyVertexBuffer(this->circleSDF.gpuVertexBuffer);
     }
-    if (this->circleFilled.gpuVertexBuffer) {
-        this->renderer->DestroyVertexBuffer(this->circleFilled.gpuVertexBuffer);
+    if (this->circleSDFDotted.gpuVertexBuffer) {
+        this->renderer->DestroyVertexBuffer(this->circleSDFDotted.gpuVertexBuffer);
     }
     if (this->boxEdged.gpuVertexBuffer) {
         this->renderer->DestroyVertexBuffer(this->boxEdged.gpuVertexBuffer);
@@ -13,16 +13,24 @@
 #include <cmath>
 
 #include <array>    // C++ std library, fixed-size arrays
+#include <atomic>   // C++ std library, atomic variables
 #include <bitset>	// C++ std library, bit-sets
 #include <cstdint>  // C++ std library, fixed-width integer types
+#include <cstdio>   // C++ std library, C-style file I/O
+#include <mutex>    // C++ std library, mutexes
 #include <random>   // C++ std library, random numbers
+#include <string>   // C++ std library, strings
+#include <thread>   // C++ std library, threads
 #include <tuple>    // C++ std library, tuples
+#include <vector>   // C++ std library, dynamic arrays
 #include <chipmunk/chipmunk.h>  // Physics library
 extern "C" {
     //#include <chipmunk/chipmunk_structs.h>
     #include <chipmunk/chipmunk_private.h>  // #include'd for allowing static cp* structs (cpSpace, cpBody, etc.)
 }
 #include "gb_math.h"            // Vector and Matrix math
+#include "FSTUFF_SIMD.h"         // Vectorized kernels
+#include "FSTUFF_Jobs.h"         // Worker thread pool
 #include "imgui.h"
 
 #ifndef FSTUFF_ENABLE_IMGUI_DEMO
@@ -43,6 +51,17 @@ extern "C" {
     #endif
 #endif
 
+#ifndef FSTUFF_ENABLE_PHYSICS_THREAD
+    // If 1, physics may be run on its own thread; see
+    // FSTUFF_Simulation::threadedPhysics.  Web builds only get this if built
+    // with pthreads (see FSTUFF_EMSCRIPTEN_THREADS).
+    #if __EMSCRIPTEN__ && ! __EMSCRIPTEN_PTHREADS__
+        #define FSTUFF_ENABLE_PHYSICS_THREAD 0
+    #else
+        #define FSTUFF_ENABLE_PHYSICS_THREAD 1
+    #endif
+#endif
+
 #include "FSTUFF_Constants.h"   // Miscellaneous constants
 
 #define FSTUFF_countof(arr) (sizeof(arr) / sizeof(arr[0]))
@@ -89,6 +108,16 @@ void FSTUFF_DefaultFatalErrorHandler(const char * formattedMessage, void *);
 
 void FSTUFF_OpenWebPage(const char * url);
 
+// Writes a file by way of a uniquely-named, temporary file, beside 'path',
+// which gets renamed into place once 'write' succeeds.  Readers, including
+// other processes, never see a partially-written file.  Returns false, and
+// removes the temporary file, on failure.
+bool FSTUFF_WriteFileAtomically(const std::string & path, bool (*write)(FILE * file, void * userdata), void * userdata);
+
+// Runs a CPU micro-benchmark, logging its results.  Returns false if no
+// benchmark has the given name.  "list" logs all benchmarks' names.
+bool FSTUFF_RunBenchmark(const char * name);
+
 enum FSTUFF_ShapeType : uint8_t {
     FSTUFF_ShapeCircle = 0,
     FSTUFF_ShapeBox,
@@ -96,9 +125,36 @@ enum FSTUFF_ShapeType : uint8_t {
     FSTUFF_ShapeDebug,
 };
 
+static const size_t FSTUFF_NumShapeTypes = FSTUFF_ShapeDebug + 1;
+
+// Every FSTUFF_Shape that a FSTUFF_Simulation owns, by index; see
+// FSTUFF_Simulation::GetShape()
+enum FSTUFF_ShapeID : uint8_t {
+    FSTUFF_ShapeIDCircleFilled = 0,     // + level of detail
+    FSTUFF_ShapeIDCircleEdged = FSTUFF_ShapeIDCircleFilled + FSTUFF_NumCircleLODs,    // + level of detail
+    FSTUFF_ShapeIDCircleDots = FSTUFF_ShapeIDCircleEdged + FSTUFF_NumCircleLODs,
+    FSTUFF_ShapeIDCircleSDF,
+    FSTUFF_ShapeIDCircleSDFDotted,
+    FSTUFF_ShapeIDBoxFilled,
+    FSTUFF_ShapeIDBoxEdged,
+    FSTUFF_ShapeIDSegmentFilled,
+    FSTUFF_ShapeIDSegmentEdged,
+    FSTUFF_ShapeIDDebug,
+    FSTUFF_NumShapeIDs
+};
+
+inline FSTUFF_ShapeType FSTUFF_ShapeTypeForID(FSTUFF_ShapeID id) {
+    return
+        (id < FSTUFF_ShapeIDBoxFilled)      ? FSTUFF_ShapeCircle :
+        (id < FSTUFF_ShapeIDSegmentFilled)  ? FSTUFF_ShapeBox :
+        (id < FSTUFF_ShapeIDDebug)          ? FSTUFF_ShapeSegment :
+                                              FSTUFF_ShapeDebug;
+}
+
 enum FSTUFF_ShapeAppearance : uint8_t {
     FSTUFF_ShapeAppearanceFilled = 0,
     FSTUFF_ShapeAppearanceEdged,
+    FSTUFF_ShapeAppearanceSDF,      // circles only: fill, edge, and dots in one quad, via a signed distance field
 };
 
 enum FSTUFF_PrimitiveType : uint8_t {
@@ -108,6 +164,16 @@ enum FSTUFF_PrimitiveType : uint8_t {
     FSTUFF_PrimitiveTriangleFan,
 };
 
+enum FSTUFF_Broadphase : uint8_t {
+    FSTUFF_BroadphaseBBTree = 0,        // Chipmunk's default: a bounding-box tree
+    FSTUFF_BroadphaseSpatialHash,
+};
+
+enum FSTUFF_PegLayout : uint8_t {
+    FSTUFF_PegLayoutUniform = 0,        // independent, uniformly random positions; pegs may overlap
+    FSTUFF_PegLayoutPoissonDisk,        // random, but with every peg at least a min spacing from the others, and from the walls
+};
+
 enum FSTUFF_SimulationState : uint8_t {
     FSTUFF_DEAD = 0,
     FSTUFF_ALIVE
@@ -119,9 +185,10 @@ struct FSTUFF_Shape {
     FSTUFF_ShapeType type = FSTUFF_ShapeCircle;
     FSTUFF_ShapeAppearance appearance = FSTUFF_ShapeAppearanceFilled;
     union {
-        uint32_t _shapeGenParamsRaw = 0;
+        uint64_t _shapeGenParamsRaw = 0;
         struct {
             uint32_t numParts;
+            uint32_t numDots;   // FSTUFF_ShapeAppearanceSDF only
         } circle;
     };
     FSTUFF_PrimitiveType primitiveType = FSTUFF_PrimitiveUnknown;
@@ -144,10 +211,278 @@ struct FSTUFF_CursorInfo {
     //bool contained;
 };
 
+// Collects frame times, for reporting their distribution.  Min, max, and
+// average cover every frame; percentiles cover the most recent kMaxSamples.
+struct FSTUFF_FrameTimeStats {
+    static constexpr size_t kMaxSamples = 16384;
+    std::array<float, kMaxSamples> samplesMS = {};
+    uint64_t count = 0;
+    double totalMS = 0.;
+    float minMS = 0.f;
+    float maxMS = 0.f;
+
+    void Add(double frameTimeS);
+    void Log(const char * label) const;
+};
+
+// Where startup's time goes, from the host's start, through to its first
+// presented frame, when the lot gets logged, along with time-to-first-pixel.
+// Steps get timed via FSTUFF_StartupStep, and may nest.  Main thread only.
+struct FSTUFF_StartupProfile {
+    static constexpr size_t kMaxSteps = 32;
+    struct Step {
+        const char * name = nullptr;    // must outlive the profile; i.e. a string literal
+        double startS = 0.;             // since Begin()
+        double durationS = -1.;         // -1 == not yet ended
+        int depth = 0;
+    };
+    std::array<Step, kMaxSteps> steps = {};
+    size_t numSteps = 0;
+    double beginS = 0.;     // steady clock, in seconds; 0 == not begun
+    int depth = 0;
+    bool isDone = false;
+
+    static double NowS();
+    void    Begin();                // as early as possible; else, the first step begins the profile
+    size_t  StartStep(const char * name);   // returns kMaxSteps if not recording
+    void    EndStep(size_t index);
+    void    FirstFrame();           // logs the profile, then stops recording
+    bool    IsRecording() const { return ! this->isDone; }
+};
+FSTUFF_StartupProfile & FSTUFF_GetStartupProfile();
+
+// Times a step of startup, from construction to destruction
+struct FSTUFF_StartupStep {
+    size_t index;
+    explicit FSTUFF_StartupStep(const char * name) : index(FSTUFF_GetStartupProfile().StartStep(name)) {}
+    ~FSTUFF_StartupStep() { FSTUFF_GetStartupProfile().EndStep(this->index); }
+    FSTUFF_StartupStep(const FSTUFF_StartupStep &) = delete;
+    FSTUFF_StartupStep & operator=(const FSTUFF_StartupStep &) = delete;
+};
+
+// Per-frame measurements of the simulation, as of its last Update()
+struct FSTUFF_SimulationStats {
+    int32_t awakeBodies = 0;        // dynamic bodies that Chipmunk hasn't put to sleep
+    double kineticEnergy = 0.;      // total, linear + rotational, of all marbles
+    bool idle = false;              // true if nothing moved, nor will move, until nextChangeInS passes (or input arrives)
+    double nextChangeInS = 0.;      // when idle, time until the next scheduled change (a new marble, or a reset)
+    uint32_t pegCircleParts = 0;    // circle mesh level-of-detail, as last rendered; 0 == SDF
+    uint32_t marbleCircleParts = 0;
+    int32_t culledInstances = 0;    // shapes that were outside of the view, and thus not sent to the renderer
+    uint32_t instanceBytes = 0;     // instance data sent to the renderer
+    uint32_t instanceBytesInPlace = 0;  // ... of which got built directly into the renderer's memory, sparing a copy
+};
+
+// Per-frame instance data, gathered in structure-of-arrays form, so that
+// transforms can get built in bulk, via FSTUFF_BuildTransforms().  Chunks of
+// it may get filled in by different threads; see FSTUFF_GatherInstances().
+struct FSTUFF_InstanceBatch {
+    float x[FSTUFF_MaxShapes];
+    float y[FSTUFF_MaxShapes];
+    float angle[FSTUFF_MaxShapes];
+    float scaleX[FSTUFF_MaxShapes];
+    float scaleY[FSTUFF_MaxShapes];
+    size_t count = 0;
+
+    void Set(size_t i, float posX, float posY, float angleRadians, float sX, float sY) {
+        x[i] = posX;
+        y[i] = posY;
+        angle[i] = angleRadians;
+        scaleX[i] = sX;
+        scaleY[i] = sY;
+    }
+
+    FSTUFF_TransformInputs Inputs(size_t first = 0) const { return {x + first, y + first, angle + first, scaleX + first, scaleY + first}; }
+};
+
+// A color, as 8-bit, unsigned, normalized channels, in R, G, B, A order.
+// Shape colors get stored this way from the start, and are sent to the GPU
+// as-is.
+struct FSTUFF_RGBA8 {
+    uint8_t r, g, b, a;
+};
+
+// One peg, as laid out by FSTUFF_GeneratePegs(), before it gets added to a world
+struct FSTUFF_Peg {
+    FSTUFF_ShapeType type = FSTUFF_ShapeCircle;     // FSTUFF_ShapeCircle or FSTUFF_ShapeBox
+    cpFloat x = 0, y = 0;                           // world-space center
+    cpFloat radius = 0;                             // circles only
+    cpFloat width = 0, height = 0, angle = 0;       // boxes only; angle is in radians
+    FSTUFF_RGBA8 color = {};
+};
+
+// Lays out 'count' pegs, at random, over a world of the given size.  The
+// Poisson-disk layout keeps 'minSpacing' between pegs' bounding circles, and
+// may return fewer pegs, if that many won't fit.
+std::vector<FSTUFF_Peg> FSTUFF_GeneratePegs(std::mt19937 & rng, FSTUFF_PegLayout layout, cpFloat worldWidth, cpFloat worldHeight, size_t count, cpFloat minSpacing);
+
+// Bump whenever FSTUFF_GeneratePegs() would make something different from
+// the same inputs, to keep old, cached layouts from getting used.
+static const uint32_t FSTUFF_PegLayoutVersion = 1;
+
+// Generated peg layouts, kept in memory, and, if 'dir' is set, on disk.  A
+// layout depends only on its key, as it gets its own random number
+// generator, seeded from the key's seed.  The disk holds at most kMaxOnDisk
+// files, with each key's hash picking its file, and newer layouts replacing
+// whatever older one shared it.
+struct FSTUFF_PegLayoutCache {
+    struct Key {
+        double worldWidth = 0;
+        double worldHeight = 0;
+        double minSpacing = 0;
+        uint32_t seed = 0;
+        uint32_t count = 0;
+        FSTUFF_PegLayout layout = FSTUFF_PegLayoutUniform;
+        uint32_t version = FSTUFF_PegLayoutVersion;
+
+        bool operator==(const Key & other) const;
+        uint64_t Hash() const;
+    };
+
+    struct Entry {
+        Key key;
+        std::vector<FSTUFF_Peg> pegs;
+    };
+
+    static constexpr size_t kMaxInMemory = 8;
+    static constexpr uint32_t kMaxOnDisk = 64;
+    std::string dir;                // where layout files go; "" == memory only
+    std::vector<Entry> entries;     // least recently used first
+
+    static std::vector<FSTUFF_Peg> Generate(const Key & key);
+
+    // Returns the layout for 'key', from memory, or from disk, or else newly
+    // generated, then saved to both.  If 'onDisk' is false, the disk is left
+    // alone, as for one-off seeds, which could never get reused.
+    std::vector<FSTUFF_Peg> Get(const Key & key, bool onDisk = true);
+};
+
+// Every shape's placement, as of one moment of simulated time.  Whichever
+// thread advances the world writes these; rendering only ever reads them.
+struct FSTUFF_WorldSnapshot {
+    struct Shape {
+        float x, y;             // world-space center
+        float angle;            // radians
+        float scaleX, scaleY;   // circles: radius; boxes: size; segments: length, thickness
+        float cullRadius;       // bounding circle, for culling
+        FSTUFF_RGBA8 color;
+    };
+    Shape shapes[FSTUFF_MaxShapes];     // pegs, then marbles, then boxes, then segments
+    size_t numPegs = 0;
+    size_t numCircles = 0;  // pegs + marbles
+    size_t numBoxes = 0;
+    size_t numSegments = 0;
+    cpFloat pegRadiusMax = 0;
+    cpFloat marbleRadiusMax = 0;
+    FSTUFF_SimulationStats stats;       // physics-side fields only
+};
+
+// Hands the latest of a series of values from one producer thread to one
+// consumer thread, without either ever waiting.  The producer fills
+// WriteBuffer(), then calls Publish(); the consumer calls Acquire(), then
+// reads ReadBuffer(), which stays put until its next Acquire().
+template <typename T>
+struct FSTUFF_TripleBuffer {
+    static constexpr uint8_t kFresh = 0x4;  // set in 'middle' if it holds a value the consumer hasn't seen
+
+    T buffers[3];
+    uint8_t back = 0;                   // producer's
+    uint8_t front = 2;                  // consumer's
+    std::atomic<uint8_t> middle{1};     // the one in-between; swapped with 'back' or 'front'
+
+    T &         WriteBuffer()       { return buffers[back]; }
+    const T &   ReadBuffer() const  { return buffers[front]; }
+
+    void Publish() {
+        back = middle.exchange(back | kFresh, std::memory_order_acq_rel) & ~kFresh;
+    }
+
+    // Returns true if ReadBuffer() changed
+    bool Acquire() {
+        if ( ! (middle.load(std::memory_order_relaxed) & kFresh)) {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~kFresh;
+        return true;
+    }
+};
+
+// User-adjustable parameters, as seen by whichever thread advances the world
+struct FSTUFF_WorldParams {
+    int32_t marblesMax = 0;
+    float addNumMarblesPerSecond = 0.f;
+    bool restartSpawnTimer = false;     // if true, the next marble gets added 1/addNumMarblesPerSecond from now
+};
+
+// One shape instance's per-instance GPU data.  Instances are passed to
+// renderers in contiguous runs of these, laid out so that backends can
+// upload them as-is: 16 floats of column-major transform, then an RGBA8
+// color.
+struct FSTUFF_ShapeInstance {
+    gbMat4 transform;
+    FSTUFF_RGBA8 color;
+};
+static_assert(sizeof(FSTUFF_ShapeInstance) == ((16 * sizeof(float)) + sizeof(FSTUFF_RGBA8)), "FSTUFF_ShapeInstance must not be padded");
+
+// A frame's worth of rendering: every instance's transform and color, plus
+// the draws that use them.  It's plain data, with no pointers, so that it
+// can get written out, and replayed (see FSTUFF_WriteFramePacket()).
+struct FSTUFF_FramePacket {
+    static const uint32_t kMaxInstances = FSTUFF_MaxShapes + 1;    // + 1 debug shape
+    static const uint32_t kMaxDrawCommands = 32;
+
+    struct DrawCommand {
+        FSTUFF_ShapeID shape;
+        uint32_t offset;        // first instance, counted from the start of the shape's type
+        uint32_t count;
+        float alpha;
+    };
+
+    gbMat4 projectionMatrix;
+    uint32_t numInstances[FSTUFF_NumShapeTypes];    // indexed by FSTUFF_ShapeType
+    FSTUFF_ShapeInstance instances[kMaxInstances];  // grouped by FSTUFF_ShapeType, in order
+    bool instancesInRenderer;       // if true, instances got built into the renderer's memory, rather than into 'instances' (see FSTUFF_Renderer::MapShapeInstances())
+    uint32_t numDrawCommands;
+    DrawCommand drawCommands[kMaxDrawCommands];
+
+    uint32_t FirstInstance(FSTUFF_ShapeType type) const {
+        uint32_t first = 0;
+        for (size_t t = 0; t < (size_t)type; ++t) {
+            first += numInstances[t];
+        }
+        return first;
+    }
+    uint32_t TotalInstances() const { return FirstInstance((FSTUFF_ShapeType)FSTUFF_NumShapeTypes); }
+
+    void AddDrawCommand(FSTUFF_ShapeID shape, size_t offset, size_t count, float alpha) {
+        if (count == 0) {
+            return;
+        }
+        FSTUFF_Assert(numDrawCommands < kMaxDrawCommands);
+        drawCommands[numDrawCommands++] = {shape, (uint32_t)offset, (uint32_t)count, alpha};
+    }
+};
+
+// Appends a packet to a capture file, omitting its unused instance and
+// command slots.  Packets are written in native byte order.
+bool FSTUFF_WriteFramePacket(FILE * file, const FSTUFF_FramePacket & packet);
+
+// Reads a capture file's next packet.  Returns false at end-of-file, or if
+// the packet is malformed.
+bool FSTUFF_ReadFramePacket(FILE * file, FSTUFF_FramePacket & packet);
+
 struct FSTUFF_Simulation;
 
 typedef void * FSTUFF_Texture;
 
+enum class FSTUFF_TextureFormat {
+    RGBA8,      // 4 bytes per pixel
+    Alpha8,     // 1 byte per pixel; samples as white, with that alpha
+};
+
+// For renderers that can't sample FSTUFF_TextureFormat::Alpha8 as-is
+std::vector<uint8_t> FSTUFF_ExpandAlpha8ToRGBA8(const uint8_t * srcAlpha8, int width, int height);
+
 struct FSTUFF_Renderer {
     FSTUFF_Simulation * sim = nullptr;
 
@@ -158,14 +493,37 @@ struct FSTUFF_Renderer {
     virtual void *  NewVertexBuffer(void * src, size_t size) = 0;
     virtual void    DestroyVertexBuffer(void * gpuVertexBuffer) = 0;
 
-    virtual FSTUFF_Texture NewTexture(const uint8_t * srcRGBA32, int width, int height) = 0;
+    virtual FSTUFF_Texture NewTexture(const uint8_t * src, int width, int height, FSTUFF_TextureFormat format) = 0;
     virtual void    DestroyTexture(FSTUFF_Texture tex) = 0;
 
     virtual void    ViewChanged() = 0;
     virtual void    RenderShapes(FSTUFF_Shape * shape, size_t offset, size_t count, float alpha) = 0;
     virtual void    SetProjectionMatrix(const gbMat4 & matrix) = 0;
-    virtual void    SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 & matrix, const gbVec4 & color) = 0;
+    virtual void    SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 & matrix, FSTUFF_RGBA8 color) = 0;
     virtual FSTUFF_CursorInfo GetCursorInfo() = 0;
+
+    // Sets 'count' instances of a shape type, starting at instance 'offset',
+    // in one call.  Backends should override this, to copy (or upload) the
+    // whole run at once; the default calls SetShapeProperties() per instance.
+    virtual void    SetShapeInstances(FSTUFF_ShapeType shape, size_t offset, const FSTUFF_ShapeInstance * instances, size_t count);
+
+    // Optional: returns writable, GPU-visible memory, with room for a whole
+    // frame's instances (FSTUFF_FramePacket::kMaxInstances of them, grouped
+    // by type, as in a packet), so that they can get built in place, rather
+    // than copied over by RenderFrame().  Returns nullptr if unsupported.
+    // Calls get paired with UnmapShapeInstances(), which is told how many
+    // instances got written.
+    virtual FSTUFF_ShapeInstance * MapShapeInstances() { return nullptr; }
+    virtual void    UnmapShapeInstances(size_t numWritten) {}
+
+    // Draws a whole frame's shapes, via SetProjectionMatrix(), one
+    // SetShapeInstances() call per shape type, and RenderShapes().  Backends
+    // that implement MapShapeInstances() must override this, to draw from
+    // their mapped memory, if packet.instancesInRenderer is set.
+    virtual void    RenderFrame(const FSTUFF_FramePacket & packet);
+
+    // Optional capabilities
+    virtual bool    SupportsSDFCircles() const { return false; }  // true if FSTUFF_ShapeAppearanceSDF circles can be rendered
 };
 
 enum FSTUFF_EventType : uint8_t {
@@ -215,9 +573,11 @@ struct FSTUFF_Simulation {
     //
     // Geometry + GPU
     //
-    FSTUFF_Shape circleFilled;
+    FSTUFF_Shape circleFilled[FSTUFF_NumCircleLODs];   // levels of detail; see CircleLODForRadius()
     FSTUFF_Shape circleDots;
-    FSTUFF_Shape circleEdged;
+    FSTUFF_Shape circleEdged[FSTUFF_NumCircleLODs];
+    FSTUFF_Shape circleSDF;         // pegs: fill + edge
+    FSTUFF_Shape circleSDFDotted;   // marbles: fill + edge + dots
     FSTUFF_Shape boxFilled;
     FSTUFF_Shape boxEdged;
     FSTUFF_Shape segmentFilled;
@@ -237,8 +597,11 @@ struct FSTUFF_Simulation {
         //
         // Timing
         //
-        cpFloat lastUpdateUTCTimeS = 0.0;       // set on FSTUFF_Update; UTC time in seconds
+        // Clocks are double, regardless of cpFloat, as a float can't hold
+        // seconds-since-epoch to better than a couple of minutes.
+        double lastUpdateUTCTimeS = 0.0;        // set on FSTUFF_Update; UTC time in seconds
         double elapsedTimeS = 0.0;              // elapsed time, in seconds; 0 == no time has passed
+        double fixedClockS = 0.0;               // simulated clock, in seconds; only used if 'fixedTimeStepS' is set
 
         //
         // Display
@@ -251,6 +614,7 @@ struct FSTUFF_Simulation {
         float addMarblesInS             = 0.0f;
         cpVect gravity                  = cpv(0, -196);
         cpFloat marbleRadius_Range[2]   = {2, 4};
+        cpFloat pegRadiusMax            = 0;
         int32_t marblesCount            = 0;
         double resetInS_default         = 15;
         double resetInS                 = 0;
@@ -260,9 +624,12 @@ struct FSTUFF_Simulation {
         size_t numBoxes     = 0;
         size_t numSegments  = 0;
         size_t numBodies    = 0;
+        int32_t awakeBodies = 0;     // as of the last CaptureSnapshot(), plus any marbles added since; gates AdvanceWorld()'s stepping
 
         bool forceResetEnabled = false;
         double forceResetInS = 0.0;
+
+        bool physicsSpaceIsHasty = false;   // true if physicsSpace was made by cpHastySpaceNew()
     } game;
 
     //
@@ -270,11 +637,72 @@ struct FSTUFF_Simulation {
     //
     float addNumMarblesPerSecond = 1.0f;
     int32_t marblesMax = 200;
+    bool useSDFCircles = true;      // if the renderer supports them, draw circles as SDF quads, rather than as meshes
+    bool cullInstances = true;      // if true, shapes outside of the view don't get sent to the renderer
+    bool buildInstancesInPlace = true;  // if true, and the renderer supports it, instances get built in its memory; must be false to capture packets
+    int32_t instanceThreads = 1;    // threads that cull + gather instances, counting the main one; 0 == one per CPU; set before Init()
+    bool threadedPhysics = false;   // if true, physics runs on its own thread; see StartPhysicsThread()
+    double physicsPublishIntervalS = 1. / 240.;     // if threaded, how often physics catches up to the clock, and publishes a snapshot
+
+    //
+    // Reproducibility
+    //
+    uint32_t seed = 0;              // if non-zero, every world's random number generator gets seeded with this; 0 == random seeds
+    double fixedTimeStepS = 0.0;    // if > 0, each Update() advances time by exactly this amount, rather than reading the system clock
+
+    //
+    // Physics parameters; changes take effect on the next world reset
+    //
+    cpFloat physicsStepS = 1. / 600.;                       // duration of each, fixed-size, physics step
+    cpFloat sleepTimeThresholdS = 0.5;                      // bodies that rest this long get put to sleep; INFINITY == never
+    FSTUFF_Broadphase broadphase = FSTUFF_BroadphaseBBTree;
+    int32_t physicsThreads = 1;                             // solver threads; != 1 requires FSTUFF_USE_HASTY_SPACE; 0 == one per CPU
+    FSTUFF_PegLayout pegLayout = FSTUFF_PegLayoutPoissonDisk;
+    cpFloat pegSpacing = 1.;                                // Poisson-disk pegs' min gap, in diameters of the largest marble (see marbleRadius_Range)
+    FSTUFF_PegLayoutCache pegLayouts;                       // set its 'dir' for a disk cache, which gets used only when 'seed' is set
+    uint32_t pegsSeed = 0;                                  // if 'seed' is 0, seeds the pegs; picked anew by ResetWorld(), but kept across resets for view size changes, which then hit 'pegLayouts'
+
+    FSTUFF_SimulationStats stats;
+
+    // Instances that survived culling, as of the last Update().  These get
+    // compacted, in order, to the front of each bucket's renderer data.
+    struct {
+        size_t pegs = 0;
+        size_t marbles = 0;
+        size_t boxes = 0;
+        size_t segments = 0;
+    } visible;
+    FSTUFF_InstanceBatch instances;     // circles, then boxes, then segments; visible ones only
+
+    // Filled by Update(), then drawn by Render().  There's just the one, as
+    // packets built in place (see instancesInRenderer) share the renderer's
+    // instance memory, and couldn't be kept in flight, two at a time.
+    FSTUFF_FramePacket framePacket;
+    std::unique_ptr<FSTUFF_JobPool> instanceJobs;
+
+    //
+    // Threading
+    //
+    // While the physics thread runs, it owns the world: the physics space,
+    // its shapes and bodies, and 'game' (save for viewTranslation).  The main
+    // thread stops it before changing any of those (see ResetWorld()).
+    FSTUFF_TripleBuffer<FSTUFF_WorldSnapshot> snapshots;   // world -> rendering; used when inline, too
+    FSTUFF_WorldParams worldParams;     // as applied to the world
+#if FSTUFF_ENABLE_PHYSICS_THREAD
+    std::thread physicsThread;
+    std::atomic<bool> physicsThreadQuit{false};
+    std::atomic<bool> physicsResetWanted{false};   // set by the physics thread; resets get done by the main thread
+    std::mutex physicsParamsMutex;
+    FSTUFF_WorldParams physicsParamsPending;        // main -> physics thread; guarded by physicsParamsMutex
+#endif
+    bool restartSpawnTimer = false;     // main thread's request, for the next FSTUFF_WorldParams
+    double lastFrameUTCTimeS = 0.0;     // main thread's clock, when physics is threaded
 
     //
     // Misc State
     //
     bool didSignalInit = false;
+    bool isGUIFrameActive = false;      // true if ImGui got a NewFrame() this frame; see IsGUIShown()
     int32_t viewChangedCount = 0;
 
     //
@@ -287,16 +715,23 @@ struct FSTUFF_Simulation {
     bool configurationMode = false;
     bool doEndConfiguration = false;
 
+    // ImGui only runs, and its font atlas only gets made, while something
+    // of it is shown.  Hosts should draw GetGUIDrawData(), which is nullptr
+    // on frames without ImGui, rather than ImGui::GetDrawData(), which would
+    // still hold the last such frame.
+    bool IsGUIShown() const;
+    ImDrawData * GetGUIDrawData() const { return this->isGUIFrameActive ? ImGui::GetDrawData() : nullptr; }
+
     //
     // Physics
     //
     cpSpace * physicsSpace = NULL;
     cpCircleShape circles[FSTUFF_MaxCircles] = {0};
-    gbVec4 circleColors[FSTUFF_MaxCircles] = {0};
+    FSTUFF_RGBA8 circleColors[FSTUFF_MaxCircles] = {};
     cpPolyShape boxes[FSTUFF_MaxBoxes] = {0};
-    gbVec4 boxColors[FSTUFF_MaxBoxes] = {0};
+    FSTUFF_RGBA8 boxColors[FSTUFF_MaxBoxes] = {};
     cpSegmentShape segments[FSTUFF_MaxSegments] = {0};
-    gbVec4 segmentColors[FSTUFF_MaxSegments] = {0};
+    FSTUFF_RGBA8 segmentColors[FSTUFF_MaxSegments] = {};
     cpBody bodies[FSTUFF_MaxShapes] = {0};
 
 
@@ -306,21 +741,41 @@ struct FSTUFF_Simulation {
     void    EventReceived(FSTUFF_Event * event);
     void    Render();
     void    Update();
+    void    UpdateFromPacket();     // like Update(), but leaves FramePacket(), as filled in by the caller, as-is, rather than drawing the world
+
+    FSTUFF_FramePacket &        FramePacket()               { return this->framePacket; }
+    const FSTUFF_FramePacket &  FramePacket() const         { return this->framePacket; }
+    FSTUFF_Shape *              GetShape(FSTUFF_ShapeID id);
     void    ViewChanged(const FSTUFF_ViewSize & viewSize);
     void    Init();
     bool    DidInit() const;
-    void    ResetWorld();
+    void    ResetWorld(bool keepPegs = false);  // 'keepPegs' keeps pegsSeed, as for resets after view size changes
+    void    StartPhysicsThread();
+    bool    StopPhysicsThread();    // returns true if it had been running
+    bool    IsPhysicsThreadRunning() const;
     cpVect  globalScale = {1., 1.};
     void    SetGlobalScale(cpVect scale);
     cpFloat GetWorldWidth() const { return viewSize.widthMM * (1. / globalScale.x); }
     cpFloat GetWorldHeight() const { return viewSize.heightMM * (1. / globalScale.y); }
     void    UpdateProjectionMatrix();
+    cpFloat GetPixelsPerWorldUnit() const;
+    int     CircleLODForRadius(cpFloat worldRadius) const;
     FSTUFF_CursorInfo cursorInfo;
     void    UpdateCursorInfo(const FSTUFF_CursorInfo & newInfo);
     
 private:
     void    InitWorld();
     void    InitGPUShapes();
+    void    StepPhysics(cpFloat dt);
+    void    UpdateStats(FSTUFF_SimulationStats & s);
+    FSTUFF_WorldParams CurrentWorldParams() const;
+    void    ApplyWorldParams(const FSTUFF_WorldParams & params);
+    bool    AdvanceWorld(double nowS, double * deltaTimeS);
+    void    CaptureSnapshot(FSTUFF_WorldSnapshot & snapshot);
+    void    PrepareInstances(const FSTUFF_WorldSnapshot & snapshot, FSTUFF_FramePacket & packet);
+    void    RecordDrawCommands(FSTUFF_FramePacket & packet);
+    void    BeginGUIFrame(double deltaTimeS);
+    void    PhysicsThreadMain();
 public: // public is needed, here, for FSTUFF_Shutdown
     void    ShutdownWorld();
     void    ShutdownGPU();
@@ -129,7 +129,7 @@ void * FSTUFF_AppleGL_GetProcAddress(const char * name)
     FSTUFF_Assert(sim);
     sim->Update();
     sim->Render();
-    ImDrawData * imGuiDrawData = ImGui::GetDrawData();
+    ImDrawData * imGuiDrawData = sim->GetGUIDrawData();
     renderer->RenderImGuiDrawData(imGuiDrawData);
 }
 
@@ -29,6 +29,14 @@ struct FSTUFF_AppleMetalRenderer : public FSTUFF_Renderer
     id <MTLTexture> imGuiTexture = nil;
     MTKView * nativeView = nil;
     FSTUFF_GPUData * appData = NULL;
+
+    // Where RenderShapes() finds each type's instances: an offset into
+    // FSTUFF_GPUData (which Metal needs to be 256-byte aligned), and the
+    // index, from there, of the type's first instance
+    struct {
+        NSUInteger offsetInGpuData;
+        NSUInteger firstInstance;
+    } shapeSources[FSTUFF_NumShapeTypes] = {};
     id <MTLCommandQueue> commandQueue;
     id <MTLLibrary> defaultLibrary;
     id <MTLRenderPipelineState> simulationPipelineState;
@@ -52,7 +60,7 @@ struct FSTUFF_AppleMetalRenderer : public FSTUFF_Renderer
     void *  NewVertexBuffer(void * src, size_t size) override;
     void    DestroyVertexBuffer(void * _gpuVertexBuffer) override;
 
-    FSTUFF_Texture NewTexture(const uint8_t * srcRGBA32, int width, int height) override;
+    FSTUFF_Texture NewTexture(const uint8_t * src, int width, int height, FSTUFF_TextureFormat format) override;
     void    DestroyTexture(FSTUFF_Texture tex) override;
 
     void    ViewChanged() override;
@@ -65,7 +73,11 @@ struct FSTUFF_AppleMetalRenderer : public FSTUFF_Renderer
         id<MTLBuffer> __strong & indexBuffer
     );
     void    SetProjectionMatrix(const gbMat4 & matrix) override;
-    void    SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 & matrix, const gbVec4 & color) override;
+    void    SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 & matrix, FSTUFF_RGBA8 color) override;
+    void    SetShapeInstances(FSTUFF_ShapeType shape, size_t offset, const FSTUFF_ShapeInstance * instances, size_t count) override;
+    FSTUFF_ShapeInstance * MapShapeInstances() override;
+    bool    SupportsBaseInstance() const;
+    void    RenderFrame(const FSTUFF_FramePacket & packet) override;
     FSTUFF_CursorInfo GetCursorInfo() override;
 };
 
@@ -92,7 +92,14 @@ void FSTUFF_AppleMetalRenderer::DestroyVertexBuffer(void * _gpuVertexBuffer)
     gpuVertexBuffer = nil;
 }
 
-FSTUFF_Texture FSTUFF_AppleMetalRenderer::NewTexture(const uint8_t * srcRGBA32, int width, int height) {
+FSTUFF_Texture FSTUFF_AppleMetalRenderer::NewTexture(const uint8_t * src, int width, int height, FSTUFF_TextureFormat format) {
+    // Metal's A8Unorm samples as black, rather than white, so expand Alpha8
+    // textures, which are small (just ImGui's font atlas, for now).
+    std::vector<uint8_t> expanded;
+    if (format == FSTUFF_TextureFormat::Alpha8) {
+        expanded = FSTUFF_ExpandAlpha8ToRGBA8(src, width, height);
+        src = expanded.data();
+    }
     MTLTextureDescriptor * desc = [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
                                                                                      width:width
                                                                                     height:height
@@ -100,7 +107,7 @@ FSTUFF_Texture FSTUFF_AppleMetalRenderer::NewTexture(const uint8_t * srcRGBA32,
     FSTUFF_Assert(this->device);
     id <MTLTexture> tex = [this->device newTextureWithDescriptor:desc];
     MTLRegion region = MTLRegionMake2D(0, 0, width, height);
-    [tex replaceRegion:region mipmapLevel:0 withBytes:srcRGBA32 bytesPerRow:(width * 4)];
+    [tex replaceRegion:region mipmapLevel:0 withBytes:src bytesPerRow:(width * 4)];
     return (__bridge_retained FSTUFF_Texture) tex;
 }
 
@@ -155,7 +162,6 @@ void FSTUFF_AppleMetalRenderer::RenderShapes(FSTUFF_Shape * shape, size_t offset
         return;
     }
 
-    id <MTLDevice> gpuDevice = this->device;
     id <MTLRenderCommandEncoder> renderCommandEncoder = this->simRenderCommandEncoder;
     id <MTLBuffer> gpuData = (__bridge id <MTLBuffer>) this->appData;
 
@@ -175,21 +181,17 @@ void FSTUFF_AppleMetalRenderer::RenderShapes(FSTUFF_Shape * shape, size_t offset
             return;
     }
 
-    NSUInteger shapesOffsetInGpuData;
     switch (shape->type) {
         case FSTUFF_ShapeCircle:
-            shapesOffsetInGpuData = offsetof(FSTUFF_GPUData, circles);
-            break;
         case FSTUFF_ShapeBox:
-            shapesOffsetInGpuData = offsetof(FSTUFF_GPUData, boxes);
-            break;
         case FSTUFF_ShapeSegment:
-            shapesOffsetInGpuData = offsetof(FSTUFF_GPUData, segments);
             break;
         default:
             FSTUFF_Log(@"Unknown or unmapped FSTUFF_ShapeType in shape: %u\n", shape->type);
             return;
     }
+    const NSUInteger shapesOffsetInGpuData = this->shapeSources[shape->type].offsetInGpuData;
+    const NSUInteger baseInstance = this->shapeSources[shape->type].firstInstance + offset;
 
     [renderCommandEncoder pushDebugGroup:[[NSString alloc] initWithUTF8String:shape->debugName]];
     [renderCommandEncoder setVertexBuffer:(__bridge id <MTLBuffer>)shape->gpuVertexBuffer offset:0 atIndex:0];   // 'position[<vertex id>]'
@@ -197,22 +199,17 @@ void FSTUFF_AppleMetalRenderer::RenderShapes(FSTUFF_Shape * shape, size_t offset
     [renderCommandEncoder setVertexBuffer:gpuData offset:shapesOffsetInGpuData atIndex:2];                       // 'gpuShapes[<instance id>]'
     [renderCommandEncoder setVertexBytes:&alpha length:sizeof(alpha) atIndex:3];                                 // 'alpha'
 
-#if TARGET_OS_IOS
-    const MTLFeatureSet featureSetForBaseInstance = MTLFeatureSet_iOS_GPUFamily3_v1;
-#else
-    const MTLFeatureSet featureSetForBaseInstance = MTLFeatureSet_OSX_GPUFamily1_v1;
-#endif
-    if (offset == 0) {
+    if (baseInstance == 0) {
         [renderCommandEncoder drawPrimitives:gpuPrimitiveType
                         vertexStart:0
                         vertexCount:shape->numVertices
                       instanceCount:count];
-    } else if ([gpuDevice supportsFeatureSet:featureSetForBaseInstance]) {
+    } else if (this->SupportsBaseInstance()) {
         [renderCommandEncoder drawPrimitives:gpuPrimitiveType
                                  vertexStart:0
                                  vertexCount:shape->numVertices
                                instanceCount:count
-                                baseInstance:offset];
+                                baseInstance:baseInstance];
     }
     [renderCommandEncoder popDebugGroup];
 
@@ -225,6 +222,10 @@ void FSTUFF_AppleMetalRenderer::RenderImGuiDrawData(
     id<MTLBuffer> __strong & vertexBuffer,
     id<MTLBuffer> __strong & indexBuffer
 ) {
+    if ( ! drawData) {
+        return;     // ImGui isn't shown (see FSTUFF_Simulation::GetGUIDrawData)
+    }
+
     // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
     ImGuiIO &io = ImGui::GetIO();
     int fb_width = (int)(drawData->DisplaySize.x * io.DisplayFramebufferScale.x);
@@ -341,25 +342,103 @@ void FSTUFF_AppleMetalRenderer::SetProjectionMatrix(const gbMat4 & matrix)
     FSTUFF_Apple_CopyMatrix(this->appData->globals.projection_matrix, matrix);
 }
 
-void FSTUFF_AppleMetalRenderer::SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 & matrix, const gbVec4 & color)
+// FSTUFF_ShapeInstance and FSTUFF_ShapeGPUInfo share a layout, so runs of
+// instances get copied over as-is.
+static_assert(sizeof(FSTUFF_ShapeGPUInfo) == ((16 * sizeof(float)) + 4), "FSTUFF_ShapeGPUInfo must be packed, to 68 bytes");
+static_assert(sizeof(FSTUFF_ShapeInstance) == sizeof(FSTUFF_ShapeGPUInfo), "FSTUFF_ShapeInstance's layout must match FSTUFF_ShapeGPUInfo's");
+static_assert(offsetof(FSTUFF_ShapeInstance, color) == offsetof(FSTUFF_ShapeGPUInfo, color), "FSTUFF_ShapeInstance's layout must match FSTUFF_ShapeGPUInfo's");
+static_assert(FSTUFF_countof(((FSTUFF_GPUData *)0)->frameInstances) == FSTUFF_FramePacket::kMaxInstances, "FSTUFF_GPUData must fit a whole frame's instances");
+static_assert(sizeof(FSTUFF_GPUData) <= FSTUFF_MaxBytesPerFrame, "FSTUFF_GPUData must fit in a constant buffer");
+static_assert((offsetof(FSTUFF_GPUData, globals) % FSTUFF_GPUBufferOffsetAlignment) == 0, "FSTUFF_GPUData's buffer offsets must be Metal-aligned");
+static_assert((offsetof(FSTUFF_GPUData, circles) % FSTUFF_GPUBufferOffsetAlignment) == 0, "FSTUFF_GPUData's buffer offsets must be Metal-aligned");
+static_assert((offsetof(FSTUFF_GPUData, boxes) % FSTUFF_GPUBufferOffsetAlignment) == 0, "FSTUFF_GPUData's buffer offsets must be Metal-aligned");
+static_assert((offsetof(FSTUFF_GPUData, segments) % FSTUFF_GPUBufferOffsetAlignment) == 0, "FSTUFF_GPUData's buffer offsets must be Metal-aligned");
+static_assert((offsetof(FSTUFF_GPUData, debugShapes) % FSTUFF_GPUBufferOffsetAlignment) == 0, "FSTUFF_GPUData's buffer offsets must be Metal-aligned");
+static_assert((offsetof(FSTUFF_GPUData, frameInstances) % FSTUFF_GPUBufferOffsetAlignment) == 0, "FSTUFF_GPUData's buffer offsets must be Metal-aligned");
+
+// Where each type's instances live in FSTUFF_GPUData, if not built in place
+static NSUInteger FSTUFF_Apple_ShapesOffsetInGpuData(FSTUFF_ShapeType shape)
 {
     switch (shape) {
-        case FSTUFF_ShapeCircle: {
-            FSTUFF_Apple_CopyMatrix(this->appData->circles[i].model_matrix, matrix);
-            FSTUFF_Apple_CopyVector(this->appData->circles[i].color, color);
-        } break;
-        case FSTUFF_ShapeBox: {
-            FSTUFF_Apple_CopyMatrix(this->appData->boxes[i].model_matrix, matrix);
-            FSTUFF_Apple_CopyVector(this->appData->boxes[i].color, color);
-        } break;
-        case FSTUFF_ShapeSegment: {
-            FSTUFF_Apple_CopyMatrix(this->appData->segments[i].model_matrix, matrix);
-            FSTUFF_Apple_CopyVector(this->appData->segments[i].color, color);
-        } break;
-        case FSTUFF_ShapeDebug: {
-            FSTUFF_Apple_CopyMatrix(this->appData->debugShapes[i].model_matrix, matrix);
-            FSTUFF_Apple_CopyVector(this->appData->debugShapes[i].color, color);
-        } break;
+        case FSTUFF_ShapeCircle:    return offsetof(FSTUFF_GPUData, circles);
+        case FSTUFF_ShapeBox:       return offsetof(FSTUFF_GPUData, boxes);
+        case FSTUFF_ShapeSegment:   return offsetof(FSTUFF_GPUData, segments);
+        case FSTUFF_ShapeDebug:     return offsetof(FSTUFF_GPUData, debugShapes);
+    }
+    return 0;
+}
+
+static void FSTUFF_Apple_CopyShapeInstances(FSTUFF_GPUData * gpuData, FSTUFF_ShapeType shape, size_t offset, const FSTUFF_ShapeInstance * instances, size_t count)
+{
+    FSTUFF_ShapeGPUInfo * dest = nullptr;
+    size_t max = 0;
+    switch (shape) {
+        case FSTUFF_ShapeCircle:    dest = gpuData->circles;        max = FSTUFF_countof(gpuData->circles);         break;
+        case FSTUFF_ShapeBox:       dest = gpuData->boxes;          max = FSTUFF_countof(gpuData->boxes);           break;
+        case FSTUFF_ShapeSegment:   dest = gpuData->segments;       max = FSTUFF_countof(gpuData->segments);        break;
+        case FSTUFF_ShapeDebug:     dest = gpuData->debugShapes;    max = FSTUFF_countof(gpuData->debugShapes);     break;
+    }
+    FSTUFF_Assert(dest != nullptr);
+    FSTUFF_Assert((offset + count) <= max);
+    memcpy(dest + offset, instances, count * sizeof(FSTUFF_ShapeInstance));
+}
+
+void FSTUFF_AppleMetalRenderer::SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 & matrix, FSTUFF_RGBA8 color)
+{
+    const FSTUFF_ShapeInstance instance = {matrix, color};
+    this->SetShapeInstances(shape, i, &instance, 1);
+}
+
+void FSTUFF_AppleMetalRenderer::SetShapeInstances(FSTUFF_ShapeType shape, size_t offset, const FSTUFF_ShapeInstance * instances, size_t count)
+{
+    FSTUFF_Apple_CopyShapeInstances(this->appData, shape, offset, instances, count);
+    this->shapeSources[shape] = {FSTUFF_Apple_ShapesOffsetInGpuData(shape), 0};
+}
+
+bool FSTUFF_AppleMetalRenderer::SupportsBaseInstance() const
+{
+#if TARGET_OS_IOS
+    const MTLFeatureSet featureSetForBaseInstance = MTLFeatureSet_iOS_GPUFamily3_v1;
+#else
+    const MTLFeatureSet featureSetForBaseInstance = MTLFeatureSet_OSX_GPUFamily1_v1;
+#endif
+    return [this->device supportsFeatureSet:featureSetForBaseInstance];
+}
+
+// During Update(), 'appData' points at this frame's constant buffer's
+// contents, which the GPU reads as-is; no unmapping is needed.  Every type
+// but the first gets drawn from a non-zero base instance, though, which
+// older GPUs can't do.
+FSTUFF_ShapeInstance * FSTUFF_AppleMetalRenderer::MapShapeInstances()
+{
+    if ( ! this->SupportsBaseInstance()) {
+        return nullptr;
+    }
+    return (FSTUFF_ShapeInstance *) this->appData->frameInstances;
+}
+
+void FSTUFF_AppleMetalRenderer::RenderFrame(const FSTUFF_FramePacket & packet)
+{
+    // By now, 'appData' refers to the MTLBuffer, rather than to its contents
+    // (see drawInMTKView:)
+    id <MTLBuffer> gpuBuffer = (__bridge id <MTLBuffer>) this->appData;
+    FSTUFF_GPUData * gpuData = (FSTUFF_GPUData *) [gpuBuffer contents];
+    FSTUFF_Apple_CopyMatrix(gpuData->globals.projection_matrix, packet.projectionMatrix);
+
+    uint32_t first = 0;
+    for (size_t type = 0; type < FSTUFF_NumShapeTypes; ++type) {
+        if (packet.instancesInRenderer) {
+            this->shapeSources[type] = {offsetof(FSTUFF_GPUData, frameInstances), first};
+        } else {
+            FSTUFF_Apple_CopyShapeInstances(gpuData, (FSTUFF_ShapeType)type, 0, packet.instances + first, packet.numInstances[type]);
+            this->shapeSources[type] = {FSTUFF_Apple_ShapesOffsetInGpuData((FSTUFF_ShapeType)type), 0};
+        }
+        first += packet.numInstances[type];
+    }
+
+    for (uint32_t i = 0; i < packet.numDrawCommands; ++i) {
+        const FSTUFF_FramePacket::DrawCommand & command = packet.drawCommands[i];
+        this->FSTUFF_AppleMetalRenderer::RenderShapes(sim->GetShape(command.shape), command.offset, command.count, command.alpha);
     }
 }
 
@@ -964,7 +1043,7 @@ static FSTUFF_Event FSTUFF_NewKeyEventForNSEvent(NSEvent * nsEvent) {
             imGuiRenderCommandEncoder.label = @"FSTUFF_ImGuiRenderEncoder";
 
             // Draw ImGui data
-            ImDrawData * imGuiDrawData = ImGui::GetDrawData();
+            ImDrawData * imGuiDrawData = self.sim->GetGUIDrawData();
             renderer->RenderImGuiDrawData(
                 imGuiDrawData,
                 commandBuffer,
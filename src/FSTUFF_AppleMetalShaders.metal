@@ -25,12 +25,19 @@ vertex FSTUFF_Vertex FSTUFF_VertexShader(constant float4 * position [[buffer(0)]
                                          uint shapeId [[instance_id]])
 {
     FSTUFF_Vertex vert;
-    vert.position = (gpuGlobals->projection_matrix * gpuShapes[shapeId].model_matrix) * position[vertexId];
+    const float4x4 model_matrix = float4x4(
+        float4(gpuShapes[shapeId].model_matrix[0]),
+        float4(gpuShapes[shapeId].model_matrix[1]),
+        float4(gpuShapes[shapeId].model_matrix[2]),
+        float4(gpuShapes[shapeId].model_matrix[3])
+    );
+    const float4 color = float4(gpuShapes[shapeId].color) / 255.0;
+    vert.position = (gpuGlobals->projection_matrix * model_matrix) * position[vertexId];
     vert.color = {
-        gpuShapes[shapeId].color[0],
-        gpuShapes[shapeId].color[1],
-        gpuShapes[shapeId].color[2],
-        gpuShapes[shapeId].color[3] * (*alpha),
+        color[0],
+        color[1],
+        color[2],
+        color[3] * (*alpha),
     };
     return vert;
 }
@@ -12,24 +12,36 @@
 #include <simd/simd.h>
 #include "FSTUFF_Constants.h"
 
-typedef struct __attribute__((__aligned__(256)))
+// Metal needs offsets, given to setVertexBuffer:offset:atIndex:, to be
+// multiples of this (for the constant address space, on macOS).  Each run of
+// shapes in FSTUFF_GPUData gets aligned to it, whatever the runs' lengths.
+#define FSTUFF_GPUBufferOffsetAlignment 256
+
+typedef struct __attribute__((__aligned__(FSTUFF_GPUBufferOffsetAlignment)))
 {
     matrix_float4x4 projection_matrix;
 } FSTUFF_GPUGlobals;
 
+// Laid out as FSTUFF_ShapeInstance is: a column-major matrix, with no
+// padding after it, then an RGBA8 color
 typedef struct
 {
-    matrix_float4x4 model_matrix;
-    vector_float4 color;
+#ifdef __METAL_VERSION__
+    packed_float4 model_matrix[4];
+#else
+    simd_packed_float4 model_matrix[4];
+#endif
+    vector_uchar4 color;
 } FSTUFF_ShapeGPUInfo;
 
 typedef struct
 {
     FSTUFF_GPUGlobals globals;
-    FSTUFF_ShapeGPUInfo circles[FSTUFF_MaxCircles];
-    FSTUFF_ShapeGPUInfo boxes[FSTUFF_MaxBoxes];
-    FSTUFF_ShapeGPUInfo segments[FSTUFF_MaxSegments];
-    FSTUFF_ShapeGPUInfo debugShapes[1];
+    FSTUFF_ShapeGPUInfo circles[FSTUFF_MaxCircles] __attribute__((__aligned__(FSTUFF_GPUBufferOffsetAlignment)));
+    FSTUFF_ShapeGPUInfo boxes[FSTUFF_MaxBoxes] __attribute__((__aligned__(FSTUFF_GPUBufferOffsetAlignment)));
+    FSTUFF_ShapeGPUInfo segments[FSTUFF_MaxSegments] __attribute__((__aligned__(FSTUFF_GPUBufferOffsetAlignment)));
+    FSTUFF_ShapeGPUInfo debugShapes[1] __attribute__((__aligned__(FSTUFF_GPUBufferOffsetAlignment)));
+    FSTUFF_ShapeGPUInfo frameInstances[FSTUFF_MaxShapes + 1] __attribute__((__aligned__(FSTUFF_GPUBufferOffsetAlignment)));  // a whole frame's, grouped by type, if built in place
 } FSTUFF_GPUData;
 
 typedef struct {
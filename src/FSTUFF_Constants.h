@@ -6,6 +6,7 @@
 #define FSTUFF_MaxCircles   2048
 #define FSTUFF_MaxSegments  64
 #define FSTUFF_MaxShapes    (FSTUFF_MaxCircles + FSTUFF_MaxBoxes + FSTUFF_MaxSegments)
+#define FSTUFF_NumCircleLODs 5      // circle meshes of 8, 16, 32, 64, and 128 parts
 
 namespace FSTUFF_Colors {
     enum : uint32_t {
@@ -0,0 +1,186 @@
+//
+//  FSTUFF_Jobs.h
+//  FallingStuff
+//
+//  Copyright © 2018 David Ludwig. All rights reserved.
+//
+
+#ifndef FSTUFF_Jobs_h
+#define FSTUFF_Jobs_h
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#ifndef FSTUFF_USE_JOB_THREADS
+    // If 0, FSTUFF_JobPool runs every job on its caller's thread.  Web
+    // builds only get worker threads if built with pthreads (see
+    // FSTUFF_EMSCRIPTEN_THREADS).
+    #if __EMSCRIPTEN__ && ! __EMSCRIPTEN_PTHREADS__
+        #define FSTUFF_USE_JOB_THREADS 0
+    #else
+        #define FSTUFF_USE_JOB_THREADS 1
+    #endif
+#endif
+
+// A fixed pool of worker threads, for splitting a loop into chunks, via
+// ParallelFor().  Each thread has its own deque of jobs: it takes from the
+// back of its own, and, once that's empty, steals from the front of others'.
+// The thread calling ParallelFor() works through chunks too, rather than
+// just waiting.
+struct FSTUFF_JobPool {
+    struct Job {
+        void (*run)(void * context, size_t begin, size_t end) = nullptr;
+        void * context = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+        std::atomic<size_t> * remaining = nullptr;     // decremented once the job is done
+    };
+
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    // numThreads counts the calling thread; 0 == one per CPU.
+    explicit FSTUFF_JobPool(int numThreads) {
+#if FSTUFF_USE_JOB_THREADS
+        if (numThreads <= 0) {
+            numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+#else
+        numThreads = 1;
+#endif
+        for (int i = 0; i < numThreads; ++i) {
+            queues.emplace_back(new Queue());
+        }
+#if FSTUFF_USE_JOB_THREADS
+        for (int i = 1; i < numThreads; ++i) {
+            workers.emplace_back(&FSTUFF_JobPool::WorkerMain, this, (size_t)i);
+        }
+#endif
+    }
+
+    ~FSTUFF_JobPool() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread & worker : workers) {
+            worker.join();
+        }
+    }
+
+    FSTUFF_JobPool(const FSTUFF_JobPool &) = delete;
+    FSTUFF_JobPool & operator=(const FSTUFF_JobPool &) = delete;
+
+    int NumThreads() const { return (int)queues.size(); }
+
+    // Calls fn(begin, end) over [0, count), in chunks of up to 'grain' items,
+    // spread across the pool.  Returns once every chunk is done.  Must not be
+    // called from within a job.
+    template <typename Fn>
+    void ParallelFor(size_t count, size_t grain, Fn && fn) {
+        grain = std::max<size_t>(grain, 1);
+        if (count <= grain || workers.empty()) {
+            if (count > 0) {
+                fn((size_t)0, count);
+            }
+            return;
+        }
+
+        auto run = [] (void * context, size_t begin, size_t end) {
+            (*static_cast<typename std::remove_reference<Fn>::type *>(context))(begin, end);
+        };
+        const size_t numChunks = (count + grain - 1) / grain;
+        std::atomic<size_t> remaining{numChunks};
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            queued += numChunks;
+        }
+        for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+            Job job;
+            job.run = run;
+            job.context = (void *)&fn;
+            job.begin = chunk * grain;
+            job.end = std::min(count, job.begin + grain);
+            job.remaining = &remaining;
+            Queue & queue = *queues[chunk % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        wake.notify_all();
+
+        // Help out, until every chunk is done
+        Job job;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (TryTake(0, job)) {
+                Run(job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<Queue>> queues;     // [0] is for ParallelFor()'s caller
+    std::vector<std::thread> workers;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    size_t queued = 0;      // jobs in all queues; guarded by wakeMutex
+    bool quit = false;      // guarded by wakeMutex
+
+    static void Run(const Job & job) {
+        job.run(job.context, job.begin, job.end);
+        job.remaining->fetch_sub(1, std::memory_order_release);
+    }
+
+    // Takes a job from the back of queue 'self', or else steals one from the
+    // front of another thread's queue.
+    bool TryTake(size_t self, Job & job) {
+        for (size_t i = 0; i < queues.size(); ++i) {
+            const size_t index = (self + i) % queues.size();
+            Queue & queue = *queues[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty()) {
+                continue;
+            }
+            if (index == self) {
+                job = queue.jobs.back();
+                queue.jobs.pop_back();
+            } else {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+            }
+            std::lock_guard<std::mutex> wakeLock(wakeMutex);
+            --queued;
+            return true;
+        }
+        return false;
+    }
+
+    void WorkerMain(size_t self) {
+        Job job;
+        for (;;) {
+            if (TryTake(self, job)) {
+                Run(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [this] { return quit || queued > 0; });
+            if (quit) {
+                return;
+            }
+        }
+    }
+};
+
+#endif /* FSTUFF_Jobs_h */
@@ -9,12 +9,58 @@
 #include "FSTUFF_OpenGL.h"
 #include "FSTUFF.h"
 #include "FSTUFF_Apple.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
 
 #if __has_include(<OpenGL/glu.h>)
     #include <OpenGL/glu.h>
     #define FSTUFF_HAS_GLU 1
 #endif
 
+#ifndef GL_ALPHA
+    #define GL_ALPHA 0x1906     // GLESv2-only, texture format; missing from some GL 3 core headers
+#endif
+
+
+// Defines FSTUFF_FetchInstance(), for vertex shaders that get their instances
+// from a texture, rather than from instanced vertex attributes.  This gets
+// inserted after the shader's #version line, and works as either GLSL 3.30
+// or GLSL ES 3.00.
+static const char * FSTUFF_GL_InstanceFetchCode = R"(
+    // Instances, as raw FSTUFF_ShapeInstance words (16 of column-major
+    // transform, then 1 of RGBA8 color), 4 per texel, row after row
+    uniform highp usampler2D instanceData;
+    uniform int instanceBase;   // index of the draw's first instance
+    void FSTUFF_FetchInstance(out mat4 modelMatrix, out vec4 colorRGBX)
+    {
+        // An instance's 17 words span, at most, 5 texels
+        int first = (instanceBase + gl_InstanceID) * 17;
+        int firstTexel = first / 4;
+        int width = textureSize(instanceData, 0).x;
+        uint words[20];
+        for (int i = 0; i < 5; ++i) {
+            int texel = firstTexel + i;
+            uvec4 t = texelFetch(instanceData, ivec2(texel % width, texel / width), 0);
+            words[(i * 4) + 0] = t.x;
+            words[(i * 4) + 1] = t.y;
+            words[(i * 4) + 2] = t.z;
+            words[(i * 4) + 3] = t.w;
+        }
+        int skip = first - (firstTexel * 4);
+        for (int c = 0; c < 4; ++c) {
+            int w = skip + (c * 4);
+            modelMatrix[c] = uintBitsToFloat(uvec4(words[w], words[w + 1], words[w + 2], words[w + 3]));
+        }
+        uint color = words[skip + 16];
+        colorRGBX = vec4(uvec4(color, color >> 8u, color >> 16u, color >> 24u) & 0xffu) / 255.0;
+    }
+)";
+static_assert(sizeof(FSTUFF_ShapeInstance) == (17 * 4), "FSTUFF_GL_InstanceFetchCode expects 17-word instances");
+static_assert(offsetof(FSTUFF_ShapeInstance, color) == (16 * 4), "FSTUFF_GL_InstanceFetchCode expects colors after transforms");
 
 static const FSTUFF_GL_ShaderCode FSTUFF_GL_ShaderCode_Core3 = {
 
@@ -71,6 +117,115 @@ R"(#version 330 core
     {
         Out_Color = Frag_Color * texture(Texture, Frag_UV.st);
     }
+)",
+
+    // SDF Circle, Vertex Shader
+R"(#version 330 core
+    uniform mat4 viewMatrix;
+    uniform vec2 viewportSize;
+    layout (location = 0) in vec4 position;
+    layout (location = 1) in vec4 colorRGBX;
+    layout (location = 2) in float alpha;
+    layout (location = 3) in mat4 modelMatrix;
+    out vec4 midColor;
+    out vec2 local;
+    out float pixelsPerUnit;
+    void main()
+    {
+        // Pixels per unit of radius.  Circles get scaled uniformly, and
+        // projected orthographically.
+        mat4 mvp = viewMatrix * modelMatrix;
+        pixelsPerUnit = length(mvp[0].xy * viewportSize) * 0.5;
+
+        // Grow the quad by a pixel, to leave room for antialiasing
+        local = position.xy * (1.0 + (1.0 / max(pixelsPerUnit, 0.001)));
+        gl_Position = mvp * vec4(local, 0.0, 1.0);
+        midColor = vec4(colorRGBX.rgb, alpha);
+    }
+)",
+
+    // SDF Circle, Fragment Shader
+R"(#version 330 core
+    uniform float dotCount;
+    in vec4 midColor;
+    in vec2 local;
+    in float pixelsPerUnit;
+    out vec4 finalColor;
+    void main()
+    {
+        // Fill, plus a one pixel edge just inside the circle, each with
+        // analytic, distance-based antialiasing
+        float d = (length(local) - 1.0) * pixelsPerUnit;
+        float a = max(clamp(0.5 - d, 0.0, 1.0) * midColor.a, clamp(1.0 - abs(d + 0.5), 0.0, 1.0));
+
+        // Dots, evenly spaced around the circle; only the nearest matters
+        if (dotCount > 0.0) {
+            float sector = 6.2831853 / dotCount;
+            float angle = floor((atan(local.y, local.x) / sector) + 0.5) * sector;
+            vec2 dotCenter = 0.7 * vec2(cos(angle), sin(angle));
+            float dotD = (length(local - dotCenter) - 0.08) * pixelsPerUnit;
+            a = max(a, clamp(0.5 - dotD, 0.0, 1.0));
+        }
+        if (a <= 0.0) {
+            discard;
+        }
+        finalColor = vec4(midColor.rgb, a);
+    }
+)",
+
+    // Simulation, Vertex Shader, with instances fetched from a texture
+R"(#version 330 core
+    uniform mat4 viewMatrix;
+    layout (location = 0) in vec4 position;
+    layout (location = 2) in float alpha;
+    out vec4 midColor;
+    void main()
+    {
+        mat4 modelMatrix;
+        vec4 colorRGBX;
+        FSTUFF_FetchInstance(modelMatrix, colorRGBX);
+        gl_Position = (viewMatrix * modelMatrix) * position;
+        midColor = vec4(colorRGBX.rgb, alpha);
+    }
+)",
+
+    // SDF Circle, Vertex Shader, with instances fetched from a texture
+R"(#version 330 core
+    uniform mat4 viewMatrix;
+    uniform vec2 viewportSize;
+    layout (location = 0) in vec4 position;
+    layout (location = 2) in float alpha;
+    out vec4 midColor;
+    out vec2 local;
+    out float pixelsPerUnit;
+    void main()
+    {
+        mat4 modelMatrix;
+        vec4 colorRGBX;
+        FSTUFF_FetchInstance(modelMatrix, colorRGBX);
+
+        // Pixels per unit of radius.  Circles get scaled uniformly, and
+        // projected orthographically.
+        mat4 mvp = viewMatrix * modelMatrix;
+        pixelsPerUnit = length(mvp[0].xy * viewportSize) * 0.5;
+
+        // Grow the quad by a pixel, to leave room for antialiasing
+        local = position.xy * (1.0 + (1.0 / max(pixelsPerUnit, 0.001)));
+        gl_Position = mvp * vec4(local, 0.0, 1.0);
+        midColor = vec4(colorRGBX.rgb, alpha);
+    }
+)",
+
+    // ImGui, Fragment Shader, for Alpha8 textures (stored as GL_R8)
+R"(#version 330 core
+    in vec2 Frag_UV;
+    in vec4 Frag_Color;
+    uniform sampler2D Texture;
+    layout (location = 0) out vec4 Out_Color;
+    void main()
+    {
+        Out_Color = Frag_Color * vec4(1.0, 1.0, 1.0, texture(Texture, Frag_UV.st).r);
+    }
 )"
 };
 
@@ -128,7 +283,84 @@ R"(
     {
     	gl_FragColor = Frag_Color * texture2D(Texture, Frag_UV);
     }
-)"};
+)",
+
+    // SDF Circle, Vertex Shader
+R"(
+    uniform mat4 viewMatrix;
+    uniform vec2 viewportSize;
+    attribute vec4 position;
+    attribute vec4 colorRGBX;
+    attribute float alpha;
+    attribute mat4 modelMatrix;
+    varying vec4 midColor;
+    varying vec2 local;
+    varying float pixelsPerUnit;
+    void main()
+    {
+        // Pixels per unit of radius.  Circles get scaled uniformly, and
+        // projected orthographically.
+        mat4 mvp = viewMatrix * modelMatrix;
+        pixelsPerUnit = length(mvp[0].xy * viewportSize) * 0.5;
+
+        // Grow the quad by a pixel, to leave room for antialiasing
+        local = position.xy * (1.0 + (1.0 / max(pixelsPerUnit, 0.001)));
+        gl_Position = mvp * vec4(local, 0.0, 1.0);
+        midColor = vec4(colorRGBX.rgb, alpha);
+    }
+)",
+
+    // SDF Circle, Fragment Shader
+R"(
+    #ifdef GL_FRAGMENT_PRECISION_HIGH
+    precision highp float;
+    #else
+    precision mediump float;
+    #endif
+    uniform float dotCount;
+    varying vec4 midColor;
+    varying vec2 local;
+    varying float pixelsPerUnit;
+    void main()
+    {
+        // Fill, plus a one pixel edge just inside the circle, each with
+        // analytic, distance-based antialiasing
+        float d = (length(local) - 1.0) * pixelsPerUnit;
+        float a = max(clamp(0.5 - d, 0.0, 1.0) * midColor.a, clamp(1.0 - abs(d + 0.5), 0.0, 1.0));
+
+        // Dots, evenly spaced around the circle; only the nearest matters
+        if (dotCount > 0.0) {
+            float sector = 6.2831853 / dotCount;
+            float angle = floor((atan(local.y, local.x) / sector) + 0.5) * sector;
+            vec2 dotCenter = 0.7 * vec2(cos(angle), sin(angle));
+            float dotD = (length(local - dotCenter) - 0.08) * pixelsPerUnit;
+            a = max(a, clamp(0.5 - dotD, 0.0, 1.0));
+        }
+        if (a <= 0.0) {
+            discard;
+        }
+        gl_FragColor = vec4(midColor.rgb, a);
+    }
+)",
+
+    // Simulation, Vertex Shader, with instances fetched from a texture
+    nullptr,
+
+    // SDF Circle, Vertex Shader, with instances fetched from a texture
+    nullptr,
+
+    // ImGui, Fragment Shader, for Alpha8 textures (stored as GL_ALPHA)
+R"(
+    precision mediump float;
+    uniform sampler2D Texture;
+    varying vec2 Frag_UV;
+    varying vec4 Frag_Color;
+    void main()
+    {
+    	gl_FragColor = Frag_Color * vec4(1.0, 1.0, 1.0, texture2D(Texture, Frag_UV).a);
+    }
+)"
+};
 
 static const FSTUFF_GL_ShaderCode FSTUFF_GL_ShaderCode_ES3 = {
 
@@ -160,10 +392,144 @@ static const FSTUFF_GL_ShaderCode FSTUFF_GL_ShaderCode_ES3 = {
 )",
 
     // ImGui, Vertex Shader
-    nullptr,
+    R"(#version 300 es
+    layout (location = 0) in vec2 Position;
+    layout (location = 1) in vec2 UV;
+    layout (location = 2) in vec4 Color;
+    uniform mat4 ProjMtx;
+    out vec2 Frag_UV;
+    out vec4 Frag_Color;
+    void main()
+    {
+        Frag_UV = UV;
+        Frag_Color = Color;
+        gl_Position = ProjMtx * vec4(Position.xy,0,1);
+    }
+)",
 
     // ImGui, Fragment Shader
-    nullptr
+    R"(#version 300 es
+    precision mediump float;
+    in vec2 Frag_UV;
+    in vec4 Frag_Color;
+    uniform sampler2D Texture;
+    layout (location = 0) out vec4 Out_Color;
+    void main()
+    {
+        Out_Color = Frag_Color * texture(Texture, Frag_UV.st);
+    }
+)",
+
+    // SDF Circle, Vertex Shader
+    R"(#version 300 es
+    uniform mat4 viewMatrix;
+    uniform vec2 viewportSize;
+    layout (location = 0) in vec4 position;
+    layout (location = 1) in vec4 colorRGBX;
+    layout (location = 2) in float alpha;
+    layout (location = 3) in mat4 modelMatrix;
+    out vec4 midColor;
+    out vec2 local;
+    out float pixelsPerUnit;
+    void main()
+    {
+        // Pixels per unit of radius.  Circles get scaled uniformly, and
+        // projected orthographically.
+        mat4 mvp = viewMatrix * modelMatrix;
+        pixelsPerUnit = length(mvp[0].xy * viewportSize) * 0.5;
+
+        // Grow the quad by a pixel, to leave room for antialiasing
+        local = position.xy * (1.0 + (1.0 / max(pixelsPerUnit, 0.001)));
+        gl_Position = mvp * vec4(local, 0.0, 1.0);
+        midColor = vec4(colorRGBX.rgb, alpha);
+    }
+)",
+
+    // SDF Circle, Fragment Shader
+    R"(#version 300 es
+    precision highp float;
+    uniform float dotCount;
+    in vec4 midColor;
+    in vec2 local;
+    in float pixelsPerUnit;
+    out vec4 finalColor;
+    void main()
+    {
+        // Fill, plus a one pixel edge just inside the circle, each with
+        // analytic, distance-based antialiasing
+        float d = (length(local) - 1.0) * pixelsPerUnit;
+        float a = max(clamp(0.5 - d, 0.0, 1.0) * midColor.a, clamp(1.0 - abs(d + 0.5), 0.0, 1.0));
+
+        // Dots, evenly spaced around the circle; only the nearest matters
+        if (dotCount > 0.0) {
+            float sector = 6.2831853 / dotCount;
+            float angle = floor((atan(local.y, local.x) / sector) + 0.5) * sector;
+            vec2 dotCenter = 0.7 * vec2(cos(angle), sin(angle));
+            float dotD = (length(local - dotCenter) - 0.08) * pixelsPerUnit;
+            a = max(a, clamp(0.5 - dotD, 0.0, 1.0));
+        }
+        if (a <= 0.0) {
+            discard;
+        }
+        finalColor = vec4(midColor.rgb, a);
+    }
+)",
+
+    // Simulation, Vertex Shader, with instances fetched from a texture
+    R"(#version 300 es
+    uniform mat4 viewMatrix;
+    layout (location = 0) in vec4 position;
+    layout (location = 2) in float alpha;
+    out vec4 midColor;
+    void main()
+    {
+        mat4 modelMatrix;
+        vec4 colorRGBX;
+        FSTUFF_FetchInstance(modelMatrix, colorRGBX);
+        gl_Position = (viewMatrix * modelMatrix) * position;
+        midColor = vec4(colorRGBX.rgb, alpha);
+    }
+)",
+
+    // SDF Circle, Vertex Shader, with instances fetched from a texture
+    R"(#version 300 es
+    uniform mat4 viewMatrix;
+    uniform vec2 viewportSize;
+    layout (location = 0) in vec4 position;
+    layout (location = 2) in float alpha;
+    out vec4 midColor;
+    out vec2 local;
+    out float pixelsPerUnit;
+    void main()
+    {
+        mat4 modelMatrix;
+        vec4 colorRGBX;
+        FSTUFF_FetchInstance(modelMatrix, colorRGBX);
+
+        // Pixels per unit of radius.  Circles get scaled uniformly, and
+        // projected orthographically.
+        mat4 mvp = viewMatrix * modelMatrix;
+        pixelsPerUnit = length(mvp[0].xy * viewportSize) * 0.5;
+
+        // Grow the quad by a pixel, to leave room for antialiasing
+        local = position.xy * (1.0 + (1.0 / max(pixelsPerUnit, 0.001)));
+        gl_Position = mvp * vec4(local, 0.0, 1.0);
+        midColor = vec4(colorRGBX.rgb, alpha);
+    }
+)",
+
+    // ImGui, Fragment Shader, for Alpha8 textures (stored as GL_R8)
+    R"(#version 300 es
+    precision mediump float;
+    in vec2 Frag_UV;
+    in vec4 Frag_Color;
+    uniform sampler2D Texture;
+    layout (location = 0) out vec4 Out_Color;
+    void main()
+    {
+        Out_Color = Frag_Color * vec4(1.0, 1.0, 1.0, texture(Texture, Frag_UV.st).r);
+    }
+)"
 };
 
 void FSTUFF_GLCheck_Inner(FSTUFF_CodeLocation location)
@@ -198,15 +564,31 @@ FSTUFF_GL_GetInfoLog(
 {
     std::string result;
     GLint numBytes = 0;
-    glGetShaderiv(src, GL_INFO_LOG_LENGTH, &numBytes);
+    getLength(src, GL_INFO_LOG_LENGTH, &numBytes);
     if (numBytes > 0) {
         result.resize(numBytes);
-        glGetShaderInfoLog(src, numBytes, NULL, &result[0]);
+        getLog(src, numBytes, NULL, &result[0]);
     }
     return result;
 }
 
-static GLuint FSTUFF_GL_CompileShader(GLenum shaderType, const GLbyte *shaderSrc, const char * debugName)
+// Logs, then clears, any pending GL errors, such that a failure that can be
+// recovered from doesn't trip a later FSTUFF_GLCheck().  Bounded, as a lost
+// context can report errors indefinitely.
+static void FSTUFF_GL_ClearErrors(const char * debugName)
+{
+    for (int i = 0; i < 16; ++i) {
+        const GLenum error = glGetError();
+        if (error == GL_NO_ERROR) {
+            return;
+        }
+        FSTUFF_Log("Cleared GL error 0x%x, after \"%s\" failed\n", (unsigned int)error, (debugName ? debugName : ""));
+    }
+}
+
+// If 'library' is set, it gets inserted into the shader's source, right after
+// the source's first (i.e. #version) line.
+static GLuint FSTUFF_GL_CompileShader(GLenum shaderType, const GLbyte *shaderSrc, const char * debugName, const char * library = nullptr)
 {
     // Create the shader object
     GLuint shader = glCreateShader(shaderType);
@@ -215,7 +597,16 @@ static GLuint FSTUFF_GL_CompileShader(GLenum shaderType, const GLbyte *shaderSrc
     }
 
     // Load the shader source
-    glShaderSource(shader, 1, (const GLchar* const *)&shaderSrc, NULL);
+    if (library) {
+        const char * src = (const char *) shaderSrc;
+        const char * body = strchr(src, '\n');
+        body = (body ? body + 1 : src + strlen(src));
+        const GLchar * parts[3] = {src, library, body};
+        const GLint lengths[3] = {(GLint)(body - src), -1, -1};
+        glShaderSource(shader, 3, parts, lengths);
+    } else {
+        glShaderSource(shader, 1, (const GLchar* const *)&shaderSrc, NULL);
+    }
 
     // Compile the shader
     glCompileShader(shader);
@@ -241,13 +632,214 @@ static GLuint FSTUFF_GL_CompileShader(GLenum shaderType, const GLbyte *shaderSrc
     return shader;
 }
 
+static double FSTUFF_GL_NowS()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#pragma mark - Program Binary Cache
+
+// Linked programs, saved to disk as driver-specific binaries, via
+// glGetProgramBinary(), and reloaded, on later runs, via glProgramBinary().
+// Each file gets named after a hash of the driver's identity, plus the
+// program's sources and attribute bindings.  Anything that fails to load
+// (i.e. from a driver update) just gets compiled, and re-saved.
+struct FSTUFF_GL_ProgramCache {
+    std::string dir;        // ends with a path separator
+    std::string driver;     // GL_VENDOR, GL_RENDERER, GL_VERSION, and GL_SHADING_LANGUAGE_VERSION
+    void (FSTUFF_stdcall * glGetProgramBinary)(GLuint, GLsizei, GLsizei *, GLenum *, void *) = nullptr;
+    void (FSTUFF_stdcall * glProgramBinary)(GLuint, GLenum, const void *, GLsizei) = nullptr;
+    void (FSTUFF_stdcall * glProgramParameteri)(GLuint, GLenum, GLint) = nullptr;   // nullptr on GLESv2
+};
+
+// Header for each cached program's file, which is followed by the binary
+struct FSTUFF_GL_ProgramCacheHeader {
+    uint32_t magic;         // FSTUFF_GL_ProgramCacheMagic
+    uint32_t format;        // as from glGetProgramBinary()
+    uint64_t key;           // as from FSTUFF_GL_ProgramCacheKey()
+    uint32_t length;        // of the binary, in bytes
+    uint32_t reserved;
+};
+static const uint32_t FSTUFF_GL_ProgramCacheMagic = 0x42505346;     // "FSPB", little-endian
+
+// FNV-1a, continuing from 'hash'
+static uint64_t FSTUFF_GL_HashBytes(uint64_t hash, const void * bytes, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        hash ^= ((const uint8_t *)bytes)[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t FSTUFF_GL_HashString(uint64_t hash, const char * str)
+{
+    str = (str ? str : "");
+    return FSTUFF_GL_HashBytes(hash, str, strlen(str) + 1);    // + 1, to separate strings
+}
+
+static uint64_t FSTUFF_GL_ProgramCacheKey(
+    const FSTUFF_GL_ProgramCache & cache,
+    const char * vertexShaderSrc,
+    const char * fragmentShaderSrc,
+    const char * vertexLibrary,
+    const std::vector<std::pair<std::string, GLint>> & attributeBindings)
+{
+    uint64_t key = 0xcbf29ce484222325ull;
+    key = FSTUFF_GL_HashString(key, cache.driver.c_str());
+    key = FSTUFF_GL_HashString(key, vertexShaderSrc);
+    key = FSTUFF_GL_HashString(key, fragmentShaderSrc);
+    key = FSTUFF_GL_HashString(key, vertexLibrary);
+    for (const auto & binding : attributeBindings) {
+        key = FSTUFF_GL_HashString(key, binding.first.c_str());
+        key = FSTUFF_GL_HashBytes(key, &binding.second, sizeof(binding.second));
+    }
+    return key;
+}
+
+static std::string FSTUFF_GL_ProgramCachePath(const FSTUFF_GL_ProgramCache & cache, uint64_t key)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "program-%016llx.bin", (unsigned long long)key);
+    return cache.dir + name;
+}
+
+// Returns a linked program, or 0 if none was cached (or if it was stale)
+static GLuint FSTUFF_GL_LoadCachedProgram(const FSTUFF_GL_ProgramCache & cache, uint64_t key)
+{
+    const std::string path = FSTUFF_GL_ProgramCachePath(cache, key);
+    FILE * file = fopen(path.c_str(), "rb");
+    if ( ! file) {
+        return 0;
+    }
+    FSTUFF_GL_ProgramCacheHeader header = {};
+    std::vector<uint8_t> binary;
+    bool didRead = (fread(&header, sizeof(header), 1, file) == 1) &&
+        (header.magic == FSTUFF_GL_ProgramCacheMagic) &&
+        (header.key == key) &&
+        (header.length > 0);
+    if (didRead) {
+        // Don't trust the header's length; the file may be truncated, or junk
+        const long binaryStart = ftell(file);
+        didRead = (binaryStart >= 0) && (fseek(file, 0, SEEK_END) == 0);
+        const long fileSize = (didRead ? ftell(file) : -1);
+        didRead = didRead &&
+            (fileSize >= binaryStart) &&
+            ((unsigned long)(fileSize - binaryStart) == header.length) &&
+            (fseek(file, binaryStart, SEEK_SET) == 0);
+    }
+    if (didRead) {
+        binary.resize(header.length);
+        didRead = (fread(binary.data(), 1, binary.size(), file) == binary.size());
+    }
+    fclose(file);
+    if ( ! didRead) {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    if ( ! program) {
+        return 0;
+    }
+    FSTUFF_GLCheck();   // so that the one error read below is glProgramBinary()'s
+    cache.glProgramBinary(program, (GLenum)header.format, binary.data(), (GLsizei)binary.size());
+    glGetError();       // i.e. GL_INVALID_ENUM, for an unknown format, which GL_LINK_STATUS also reports
+    GLint didLink = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &didLink);
+    if ( ! didLink) {
+        // The driver rejected it; compiling from source will replace it.
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static void FSTUFF_GL_SaveCachedProgram(const FSTUFF_GL_ProgramCache & cache, uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<uint8_t> binary((size_t)length);
+    GLenum format = 0;
+    GLsizei numWritten = 0;
+    cache.glGetProgramBinary(program, length, &numWritten, &format, binary.data());
+    if (numWritten <= 0) {
+        return;
+    }
+
+    struct Contents {
+        FSTUFF_GL_ProgramCacheHeader header;
+        const std::vector<uint8_t> & binary;
+    } contents = {{}, binary};
+    contents.header.magic = FSTUFF_GL_ProgramCacheMagic;
+    contents.header.format = (uint32_t)format;
+    contents.header.key = key;
+    contents.header.length = (uint32_t)numWritten;
+
+    const std::string path = FSTUFF_GL_ProgramCachePath(cache, key);
+    const bool didWrite = FSTUFF_WriteFileAtomically(path, [] (FILE * file, void * userdata) {
+        const Contents & contents = *(const Contents *)userdata;
+        return (fwrite(&contents.header, sizeof(contents.header), 1, file) == 1) &&
+            (fwrite(contents.binary.data(), 1, contents.header.length, file) == contents.header.length);
+    }, &contents);
+    if ( ! didWrite) {
+        FSTUFF_Log("Unable to write \"%s\"\n", path.c_str());
+    }
+}
+
+#pragma mark - Programs
+
+// If 'attributesLike' is set, then vertex attributes that share names with
+// those in 'attributesLike' get bound to the same locations, allowing the
+// two programs to share vertex attribute state.  'vertexLibrary' gets
+// inserted into the vertex shader, as per FSTUFF_GL_CompileShader().  If
+// 'cache' is set, the program gets loaded from it, if possible, or else saved
+// to it.
 static GLuint FSTUFF_GL_CreateProgram(
     const char * vertexShaderSrc,
     const char * fragmentShaderSrc,
-    const char * debugName
+    const char * debugName,
+    GLuint attributesLike = 0,
+    const char * vertexLibrary = nullptr,
+    const FSTUFF_GL_ProgramCache * cache = nullptr
 ) {
-    GLuint vertexShader = FSTUFF_GL_CompileShader(GL_VERTEX_SHADER, (const GLbyte *) vertexShaderSrc, debugName);
+    const double startS = FSTUFF_GL_NowS();
+
+    std::vector<std::pair<std::string, GLint>> attributeBindings;
+    if (attributesLike) {
+        GLint numAttributes = 0;
+        glGetProgramiv(attributesLike, GL_ACTIVE_ATTRIBUTES, &numAttributes);
+        for (GLint i = 0; i < numAttributes; ++i) {
+            char name[64];
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveAttrib(attributesLike, (GLuint)i, sizeof(name), nullptr, &size, &type, name);
+            const GLint location = glGetAttribLocation(attributesLike, name);
+            if (location >= 0) {
+                attributeBindings.emplace_back(name, location);
+            }
+        }
+    }
+
+    uint64_t cacheKey = 0;
+    if (cache) {
+        cacheKey = FSTUFF_GL_ProgramCacheKey(*cache, vertexShaderSrc, fragmentShaderSrc, vertexLibrary, attributeBindings);
+        if (GLuint program = FSTUFF_GL_LoadCachedProgram(*cache, cacheKey)) {
+            FSTUFF_Log("Program \"%s\": loaded from cache, in %.2f ms\n", debugName, (FSTUFF_GL_NowS() - startS) * 1000.);
+            return program;
+        }
+    }
+
+    GLuint vertexShader = FSTUFF_GL_CompileShader(GL_VERTEX_SHADER, (const GLbyte *) vertexShaderSrc, debugName, vertexLibrary);
     GLuint fragmentShader = FSTUFF_GL_CompileShader(GL_FRAGMENT_SHADER, (const GLbyte *) fragmentShaderSrc, debugName);
+    if ( ! vertexShader || ! fragmentShader) {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        FSTUFF_GL_ClearErrors(debugName);
+        return 0;
+    }
 
     // Create the simulation's program object
     GLuint program = glCreateProgram();
@@ -258,20 +850,52 @@ static GLuint FSTUFF_GL_CreateProgram(
     glAttachShader(program, vertexShader);
     glAttachShader(program, fragmentShader);
 
+    for (const auto & binding : attributeBindings) {
+        glBindAttribLocation(program, (GLuint)binding.second, binding.first.c_str());
+    }
+    if (cache && cache->glProgramParameteri) {
+        cache->glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     // Link the simulation's program
     glLinkProgram(program);
     GLint didLink = 0;
     glGetProgramiv(program, GL_LINK_STATUS, &didLink);
     if ( ! didLink) {
         std::string infoLog = FSTUFF_GL_GetInfoLog(program, glGetProgramiv, glGetProgramInfoLog);
-        FSTUFF_Log("Error linking program:\n%s\n\n", infoLog.c_str());
+        FSTUFF_Log("Error linking program (%s):\n%s\n\n", debugName, infoLog.c_str());
         glDeleteProgram(program);
+        FSTUFF_GL_ClearErrors(debugName);
         return 0;
     }
 
+    if (cache) {
+        const double compiledS = FSTUFF_GL_NowS();
+        FSTUFF_GL_SaveCachedProgram(*cache, cacheKey, program);
+        FSTUFF_Log("Program \"%s\": compiled in %.2f ms; cached in %.2f ms\n", debugName, (compiledS - startS) * 1000., (FSTUFF_GL_NowS() - compiledS) * 1000.);
+    } else {
+        FSTUFF_Log("Program \"%s\": compiled in %.2f ms\n", debugName, (FSTUFF_GL_NowS() - startS) * 1000.);
+    }
     return program;
 }
 
+// A vertex shader, with 'src''s #version line, that compiles, but that fails
+// to link, for want of a main().  See FSTUFF_GLESRenderer::failOptionalPrograms.
+static std::string FSTUFF_GL_UnlinkableVertexShader(const char * src)
+{
+    const char * body = strchr(src, '\n');
+    body = (body ? body + 1 : src + strlen(src));
+    return std::string(src, body) + "void FSTUFF_NotMain() {}\n";
+}
+
+// Capacity of each FSTUFF_ShapeType's instance buffer
+static const size_t FSTUFF_GL_MaxInstancesPerType[FSTUFF_NumShapeTypes] = {
+    FSTUFF_MaxCircles,      // FSTUFF_ShapeCircle
+    FSTUFF_MaxBoxes,        // FSTUFF_ShapeBox
+    FSTUFF_MaxSegments,     // FSTUFF_ShapeSegment
+    1,                      // FSTUFF_ShapeDebug
+};
+
 FSTUFF_GLESRenderer::FSTUFF_GLESRenderer() {
 }
 
@@ -286,39 +910,43 @@ void FSTUFF_GLESRenderer::Init() {
     // FSTUFF_GLCheck();
     
     FSTUFF_Assert((bool)this->getProcAddress);
-    this->glGetStringi = (decltype(this->glGetStringi)) this->getProcAddress("glGetStringi");
-    if ((this->glVersion != FSTUFF_GLVersion::GLESv2) &&
-        (this->glGetStringi != nullptr))
     {
-        int numExtensions = 0;
-        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
-        // FSTUFF_Log("GL num extensions: %d\n", numExtensions);
-        // FSTUFF_Log("GL extensions: ");
-        for (int i = 0; i < numExtensions; ++i) {
-            info = (const char *) this->glGetStringi(GL_EXTENSIONS, i);
-            FSTUFF_Log("%s ", (info ? info : ""));
-            if (info) {
-                this->glExtensionsCache.emplace(info);
+        FSTUFF_StartupStep step("GL extensions");
+        this->glGetStringi = (decltype(this->glGetStringi)) this->getProcAddress("glGetStringi");
+        if ((this->glVersion != FSTUFF_GLVersion::GLESv2) &&
+            (this->glGetStringi != nullptr))
+        {
+            int numExtensions = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+            // FSTUFF_Log("GL num extensions: %d\n", numExtensions);
+            for (int i = 0; i < numExtensions; ++i) {
+                info = (const char *) this->glGetStringi(GL_EXTENSIONS, i);
+                if (info) {
+                    this->glExtensionsCache.emplace(info);
+                }
             }
-        }
-        FSTUFF_Log("\n");
-    } else {
-        info = (const char *) glGetString(GL_EXTENSIONS);
-        // FSTUFF_Log("GL extensions: \"%s\"\n", (info ? info : ""));
-        if (info) {
-            // Copy the list of extensions into an indexed collection
-            const char * start = info;
-            const char * current = info;
-            while (*current != '\0') {
-                if (*current == ' ') {
-                    if (current != start) {
-                        this->glExtensionsCache.emplace(start, current - start);
-                        start = current + 1;
+        } else {
+            info = (const char *) glGetString(GL_EXTENSIONS);
+            // FSTUFF_Log("GL extensions: \"%s\"\n", (info ? info : ""));
+            if (info) {
+                // Copy the list of extensions into an indexed collection
+                const char * start = info;
+                const char * current = info;
+                while (*current != '\0') {
+                    if (*current == ' ') {
+                        if (current != start) {
+                            this->glExtensionsCache.emplace(start, current - start);
+                            start = current + 1;
+                        }
                     }
+                    ++current;
                 }
-                ++current;
             }
         }
+
+        if (this->logExtensions) {
+            this->LogExtensions();
+        }
     }
 
     FSTUFF_Assert(sim);
@@ -360,14 +988,27 @@ void FSTUFF_GLESRenderer::Init() {
             break;
     }
     
-    glGenBuffers(1, &circleMatricesBufID);
-    glGenBuffers(1, &circleColorsBufID);
-    glGenBuffers(1, &boxMatricesBufID);
-    glGenBuffers(1, &boxColorsBufID);
-    glGenBuffers(1, &segmentMatricesBufID);
-    glGenBuffers(1, &segmentColorsBufID);
-    glGenBuffers(1, &debugShapeMatricesBufID);
-    glGenBuffers(1, &debugShapeColorsBufID);
+    glGenBuffers(FSTUFF_NumShapeTypes, instanceBufIDs);
+    for (size_t type = 0; type < FSTUFF_NumShapeTypes; ++type) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBufIDs[type]);
+        glBufferData(GL_ARRAY_BUFFER, FSTUFF_GL_MaxInstancesPerType[type] * sizeof(FSTUFF_ShapeInstance), nullptr, GL_DYNAMIC_DRAW);
+        instanceSources[type] = {instanceBufIDs[type], 0};
+    }
+    if (this->glVersion != FSTUFF_GLVersion::GLESv2) {
+        // One row of texels holds 1024 * 4 words.  An instance's words get
+        // fetched as 5 whole texels, which may run one texel past its end.
+        const size_t numWords = FSTUFF_FramePacket::kMaxInstances * (sizeof(FSTUFF_ShapeInstance) / 4);
+        const size_t numTexels = ((numWords + 3) / 4) + 1;
+        this->instanceTexWidth = 1024;
+        this->instanceTexHeight = (GLsizei)((numTexels + this->instanceTexWidth - 1) / this->instanceTexWidth);
+        const size_t numBytes = (size_t)this->instanceTexWidth * (size_t)this->instanceTexHeight * 16;
+        FSTUFF_Assert(numBytes >= (FSTUFF_FramePacket::kMaxInstances * sizeof(FSTUFF_ShapeInstance)));
+
+        glGenBuffers(1, &frameInstancesBufID);
+        glBindBuffer(GL_ARRAY_BUFFER, frameInstancesBufID);
+        glBufferData(GL_ARRAY_BUFFER, numBytes, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     FSTUFF_GLCheck();
     
     // Load the vertex/fragment shaders
@@ -388,39 +1029,295 @@ void FSTUFF_GLESRenderer::Init() {
     FSTUFF_Assert(shadersSrc->simulationFragment != nullptr);
     FSTUFF_Assert(shadersSrc->imGuiVertex != nullptr);
     FSTUFF_Assert(shadersSrc->imGuiFragment != nullptr);
+    FSTUFF_Assert(shadersSrc->imGuiFragmentAlpha8 != nullptr);
+    FSTUFF_Assert(shadersSrc->sdfCircleVertex != nullptr);
+    FSTUFF_Assert(shadersSrc->sdfCircleFragment != nullptr);
+
+    // Cache linked programs, if asked to, and if the driver can.  (WebGL
+    // can't.)
+    FSTUFF_GL_ProgramCache programCache;
+    const FSTUFF_GL_ProgramCache * cache = nullptr;
+#if ! __EMSCRIPTEN__
+    if ( ! this->programCacheDir.empty()) {
+        switch (this->glVersion) {
+            case FSTUFF_GLVersion::GLESv2:
+                if (this->glExtensionsCache.find("GL_OES_get_program_binary") != this->glExtensionsCache.end()) {
+                    programCache.glGetProgramBinary = (decltype(programCache.glGetProgramBinary)) this->getProcAddress("glGetProgramBinaryOES");
+                    programCache.glProgramBinary = (decltype(programCache.glProgramBinary)) this->getProcAddress("glProgramBinaryOES");
+                }
+                break;
+            case FSTUFF_GLVersion::GLCorev3:
+                if (this->glExtensionsCache.find("GL_ARB_get_program_binary") == this->glExtensionsCache.end()) {
+                    break;
+                }
+                // Fall through
+            case FSTUFF_GLVersion::GLESv3:
+                programCache.glGetProgramBinary = (decltype(programCache.glGetProgramBinary)) this->getProcAddress("glGetProgramBinary");
+                programCache.glProgramBinary = (decltype(programCache.glProgramBinary)) this->getProcAddress("glProgramBinary");
+                programCache.glProgramParameteri = (decltype(programCache.glProgramParameteri)) this->getProcAddress("glProgramParameteri");
+                break;
+        }
+        GLint numFormats = 0;
+        if (programCache.glGetProgramBinary && programCache.glProgramBinary) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        }
+        if (numFormats > 0) {
+            programCache.dir = this->programCacheDir;
+            if ((programCache.dir.back() != '/') && (programCache.dir.back() != '\\')) {
+                programCache.dir += '/';
+            }
+            for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+                const char * value = (const char *) glGetString(name);
+                programCache.driver += (value ? value : "");
+                programCache.driver += '\n';
+            }
+            cache = &programCache;
+        } else {
+            FSTUFF_Log("GL program binaries are unsupported; programs will not get cached\n");
+        }
+        FSTUFF_GLCheck();
+    }
+#endif
+    const double programsStartS = FSTUFF_GL_NowS();
+    const size_t programsStep = FSTUFF_GetStartupProfile().StartStep("GL programs");
 
     this->simProgram = FSTUFF_GL_CreateProgram(
         shadersSrc->simulationVertex,
         shadersSrc->simulationFragment,
-        "simulation"
+        "simulation",
+        0,
+        nullptr,
+        cache
     );
     this->simVS_position = glGetAttribLocation(this->simProgram, "position");
     this->simVS_colorRGBX = glGetAttribLocation(this->simProgram, "colorRGBX");
     this->simVS_alpha = glGetAttribLocation(this->simProgram, "alpha");
     this->simVS_modelMatrix = glGetAttribLocation(this->simProgram, "modelMatrix");
 
+    // Optional programs' vertex shaders, or, to test falling back from them,
+    // ones that won't link
+    std::vector<std::string> unlinkableShaders;
+    auto optionalVertexShader = [&] (const char * src) -> const char * {
+        if ( ! this->failOptionalPrograms || ! src) {
+            return src;
+        }
+        unlinkableShaders.push_back(FSTUFF_GL_UnlinkableVertexShader(src));
+        return unlinkableShaders.back().c_str();
+    };
+    unlinkableShaders.reserve(3);   // keeping prior c_str()s valid
+    if (this->failOptionalPrograms) {
+        FSTUFF_Log("Making optional GL programs fail to link, to test their fallbacks\n");
+    }
+
+    // SDF circles are optional; circles get drawn as meshes, without them
+    this->sdfCircleProgram = FSTUFF_GL_CreateProgram(
+        optionalVertexShader(shadersSrc->sdfCircleVertex),
+        shadersSrc->sdfCircleFragment,
+        "SDF circle",
+        this->simProgram,
+        nullptr,
+        cache
+    );
+    if (this->sdfCircleProgram) {
+        this->sdfCircle_viewMatrix = glGetUniformLocation(this->sdfCircleProgram, "viewMatrix");
+        this->sdfCircle_viewportSize = glGetUniformLocation(this->sdfCircleProgram, "viewportSize");
+        this->sdfCircle_dotCount = glGetUniformLocation(this->sdfCircleProgram, "dotCount");
+    } else {
+        FSTUFF_Log("SDF circles are unavailable; using meshes\n");
+    }
+
+    // Texture-fetched instances, if the GL version allows
+    if (shadersSrc->simulationVertexTexFetch) {
+        this->simTexProgram = FSTUFF_GL_CreateProgram(
+            optionalVertexShader(shadersSrc->simulationVertexTexFetch),
+            shadersSrc->simulationFragment,
+            "simulation, texture-fetched",
+            this->simProgram,
+            FSTUFF_GL_InstanceFetchCode,
+            cache
+        );
+    }
+    if (this->simTexProgram) {
+        this->simTex_viewMatrix = glGetUniformLocation(this->simTexProgram, "viewMatrix");
+        this->simTex_instanceBase = glGetUniformLocation(this->simTexProgram, "instanceBase");
+        glUseProgram(this->simTexProgram);
+        glUniform1i(glGetUniformLocation(this->simTexProgram, "instanceData"), 1);
+    }
+    if (this->simTexProgram && this->sdfCircleProgram && shadersSrc->sdfCircleVertexTexFetch) {
+        this->sdfCircleTexProgram = FSTUFF_GL_CreateProgram(
+            optionalVertexShader(shadersSrc->sdfCircleVertexTexFetch),
+            shadersSrc->sdfCircleFragment,
+            "SDF circle, texture-fetched",
+            this->simProgram,
+            FSTUFF_GL_InstanceFetchCode,
+            cache
+        );
+        if (this->sdfCircleTexProgram) {
+            this->sdfCircleTex_viewMatrix = glGetUniformLocation(this->sdfCircleTexProgram, "viewMatrix");
+            this->sdfCircleTex_viewportSize = glGetUniformLocation(this->sdfCircleTexProgram, "viewportSize");
+            this->sdfCircleTex_dotCount = glGetUniformLocation(this->sdfCircleTexProgram, "dotCount");
+            this->sdfCircleTex_instanceBase = glGetUniformLocation(this->sdfCircleTexProgram, "instanceBase");
+            glUseProgram(this->sdfCircleTexProgram);
+            glUniform1i(glGetUniformLocation(this->sdfCircleTexProgram, "instanceData"), 1);
+        } else {
+            // SDF circles need both programs, or neither
+            glDeleteProgram(this->simTexProgram);
+            this->simTexProgram = 0;
+        }
+    }
+    glUseProgram(0);
+    if (this->simTexProgram) {
+        glGenTextures(1, &this->instanceTex);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, this->instanceTex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, this->instanceTexWidth, this->instanceTexHeight, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glActiveTexture(GL_TEXTURE0);
+        FSTUFF_GLCheck();
+    }
+
+    // Pick how instances get fetched.  Auto starts with attributes, and
+    // switches over to textures, if need be, once both have been timed.
+    if ( ! this->simTexProgram) {
+        if (this->instanceFetch == FSTUFF_GLInstanceFetch::Texture) {
+            FSTUFF_Log("Texture-fetched instances are unavailable; using vertex attributes\n");
+        }
+        this->instanceFetch = FSTUFF_GLInstanceFetch::Attributes;
+    }
+    switch (this->instanceFetch) {
+        case FSTUFF_GLInstanceFetch::Auto:
+        case FSTUFF_GLInstanceFetch::Attributes:
+            this->activeInstanceFetch = FSTUFF_GLInstanceFetch::Attributes;
+            break;
+        case FSTUFF_GLInstanceFetch::Texture:
+            this->activeInstanceFetch = FSTUFF_GLInstanceFetch::Texture;
+            break;
+    }
+
     this->imGuiProgram = FSTUFF_GL_CreateProgram(
         shadersSrc->imGuiVertex,
         shadersSrc->imGuiFragment,
-        "ImGui"
+        "ImGui",
+        0,
+        nullptr,
+        cache
     );
+    this->imGuiAlpha8Program = FSTUFF_GL_CreateProgram(
+        shadersSrc->imGuiVertex,
+        shadersSrc->imGuiFragmentAlpha8,
+        "ImGui, Alpha8",
+        this->imGuiProgram,
+        nullptr,
+        cache
+    );
+    FSTUFF_GetStartupProfile().EndStep(programsStep);
+    FSTUFF_Log("Programs ready in %.2f ms (%s)\n", (FSTUFF_GL_NowS() - programsStartS) * 1000., (cache ? "cache enabled" : "no cache"));
     this->imGui_tex = glGetUniformLocation(this->imGuiProgram, "Texture");
     this->imGui_projMtx = glGetUniformLocation(this->imGuiProgram, "ProjMtx");
     this->imGui_position = glGetAttribLocation(this->imGuiProgram, "Position");
     this->imGui_uv = glGetAttribLocation(this->imGuiProgram, "UV");
     this->imGui_color = glGetAttribLocation(this->imGuiProgram, "Color");
+    this->imGuiAlpha8_tex = glGetUniformLocation(this->imGuiAlpha8Program, "Texture");
+    this->imGuiAlpha8_projMtx = glGetUniformLocation(this->imGuiAlpha8Program, "ProjMtx");
     glGenBuffers(1, &this->imGuiVBO);
     glGenBuffers(1, &this->imGuiElements);
 
     FSTUFF_GLCheck();
 }
 
+void FSTUFF_GLESRenderer::LogExtensions() const {
+    // One log call, rather than one per extension; there can be hundreds.
+    std::string names;
+    for (const std::string & name : this->glExtensionsCache) {
+        names += name;
+        names += ' ';
+    }
+    FSTUFF_Log("GL extensions (%zu): %s\n", this->glExtensionsCache.size(), names.c_str());
+}
+
+void FSTUFF_GLESRenderer::InitOffscreen(int width, int height) {
+    FSTUFF_Assert(width > 0);
+    FSTUFF_Assert(height > 0);
+    FSTUFF_Assert(this->offscreenFBO == 0);
+    FSTUFF_GLCheck();
+
+    // Make sure the GPU can handle the requested size.  (8K, for example,
+    // needs a max texture size of at least 7680.)
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    GLint maxViewportDims[2] = {0, 0};
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewportDims);
+    if (width > maxTextureSize || height > maxTextureSize ||
+        width > maxViewportDims[0] || height > maxViewportDims[1])
+    {
+        FSTUFF_FatalError("Offscreen size of %dx%d is too large; max texture size is %d, max viewport is %dx%d",
+            width, height, (int)maxTextureSize, (int)maxViewportDims[0], (int)maxViewportDims[1]);
+    }
+
+    // Create a color-texture to render into.  A texture is used, rather than
+    // a renderbuffer, as GLESv2 does not require support for RGBA8
+    // renderbuffers.
+    glGenTextures(1, &this->offscreenColorTex);
+    glBindTexture(GL_TEXTURE_2D, this->offscreenColorTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    FSTUFF_GLCheck();
+
+    glGenFramebuffers(1, &this->offscreenFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, this->offscreenFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->offscreenColorTex, 0);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        FSTUFF_FatalError("Offscreen framebuffer is incomplete, status=0x%x", (unsigned int)status);
+    }
+    FSTUFF_GLCheck();
+
+    this->offscreenWidth = width;
+    this->offscreenHeight = height;
+    const size_t numBytes = (size_t)width * (size_t)height * 4;
+
+    // Asynchronous readback, via PBOs, needs GLESv3 or GLCorev3.  WebGL 2
+    // lacks glMapBufferRange, and thus gets synchronous readback.
+    switch (this->glVersion) {
+        case FSTUFF_GLVersion::GLESv2:
+            break;
+        case FSTUFF_GLVersion::GLESv3:
+        case FSTUFF_GLVersion::GLCorev3:
+#if ! __EMSCRIPTEN__
+            glGenBuffers(FSTUFF_GL_NumReadbackBuffers, this->offscreenPBOs);
+            for (int i = 0; i < FSTUFF_GL_NumReadbackBuffers; ++i) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, this->offscreenPBOs[i]);
+                glBufferData(GL_PIXEL_PACK_BUFFER, numBytes, nullptr, GL_STREAM_READ);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            FSTUFF_GLCheck();
+#endif
+            break;
+    }
+    if ( ! this->offscreenPBOs[0]) {
+        this->offscreenPixels.resize(numBytes);
+    }
+}
+
 void FSTUFF_GLESRenderer::BeginFrame() {
     FSTUFF_Assert(sim);
     FSTUFF_Assert(sim->viewSize.widthPixels > 0);
     FSTUFF_Assert(sim->viewSize.heightPixels > 0);
     FSTUFF_GLCheck();
 
+    // Render offscreen, if requested.  The default framebuffer is left alone,
+    // otherwise, as some platforms (such as iOS' GLKit) don't use zero for it.
+    if (this->offscreenFBO) {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->offscreenFBO);
+    }
+
     // Use the vertex array object
     switch (this->glVersion) {
         case FSTUFF_GLVersion::GLESv2:
@@ -451,6 +1348,9 @@ void FSTUFF_GLESRenderer::BeginFrame() {
 }
 
 void FSTUFF_GLESRenderer::RenderImGuiDrawData(ImDrawData * drawData) {
+    if ( ! drawData) {
+        return;     // ImGui isn't shown (see FSTUFF_Simulation::GetGUIDrawData)
+    }
     FSTUFF_GLCheck();
     // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
     ImGuiIO& io = ImGui::GetIO();
@@ -549,9 +1449,13 @@ void FSTUFF_GLESRenderer::RenderImGuiDrawData(ImDrawData * drawData) {
         { 0.0f,         0.0f,        -1.0f,   0.0f },
         { (R+L)/(L-R),  (T+B)/(B-T),  0.0f,   1.0f },
     };
+    glUseProgram(this->imGuiAlpha8Program);
+    glUniform1i(this->imGuiAlpha8_tex, 0);
+    glUniformMatrix4fv(this->imGuiAlpha8_projMtx, 1, GL_FALSE, &ortho_projection[0][0]);
     glUseProgram(this->imGuiProgram);
     glUniform1i(this->imGui_tex, 0);
     glUniformMatrix4fv(this->imGui_projMtx, 1, GL_FALSE, &ortho_projection[0][0]);
+    GLuint currentProgram = this->imGuiProgram;
     switch (this->glVersion) {
         case FSTUFF_GLVersion::GLESv2:
             break;
@@ -609,8 +1513,14 @@ void FSTUFF_GLESRenderer::RenderImGuiDrawData(ImDrawData * drawData) {
                     else
                         glScissor((int)clip_rect.x, (int)clip_rect.y, (int)clip_rect.z, (int)clip_rect.w); // Support for GL 4.5's glClipControl(GL_UPPER_LEFT)
 
-                    // Bind texture, Draw
-                    glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
+                    // Bind texture, and its format's program; Draw
+                    const GLuint texture = (GLuint)(intptr_t)pcmd->TextureId;
+                    const GLuint program = this->alpha8Textures.count(texture) ? this->imGuiAlpha8Program : this->imGuiProgram;
+                    if (program != currentProgram) {
+                        glUseProgram(program);
+                        currentProgram = program;
+                    }
+                    glBindTexture(GL_TEXTURE_2D, texture);
                     glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset);
                 }
             }
@@ -696,7 +1606,7 @@ void * FSTUFF_GLESRenderer::NewVertexBuffer(void * src, size_t size) {
     return (void *)(uintptr_t)newBuffer;
 }
 
-FSTUFF_Texture FSTUFF_GLESRenderer::NewTexture(const uint8_t *srcRGBA32, int width, int height)
+FSTUFF_Texture FSTUFF_GLESRenderer::NewTexture(const uint8_t *src, int width, int height, FSTUFF_TextureFormat format)
 {
     GLuint id = 0;
     glGenTextures(1, &id);
@@ -712,7 +1622,27 @@ FSTUFF_Texture FSTUFF_GLESRenderer::NewTexture(const uint8_t *srcRGBA32, int wid
         case FSTUFF_GLVersion::GLESv2:
             break;
     }
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, srcRGBA32);
+    switch (format) {
+        case FSTUFF_TextureFormat::RGBA8:
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, src);
+            break;
+        case FSTUFF_TextureFormat::Alpha8:
+            // One byte per pixel; sampled via imGuiAlpha8Program.  GLESv2
+            // lacks single-channel, red formats, and GL 3 core lacks GL_ALPHA.
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            switch (this->glVersion) {
+                case FSTUFF_GLVersion::GLCorev3:
+                case FSTUFF_GLVersion::GLESv3:
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, src);
+                    break;
+                case FSTUFF_GLVersion::GLESv2:
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, width, height, 0, GL_ALPHA, GL_UNSIGNED_BYTE, src);
+                    break;
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            this->alpha8Textures.insert(id);
+            break;
+    }
     FSTUFF_GLCheck();
     return (FSTUFF_Texture) (uintptr_t) id;
 }
@@ -728,24 +1658,166 @@ void FSTUFF_GLESRenderer::SetProjectionMatrix(const gbMat4 & matrix) {
     this->projectionMatrix = matrix;
 }
 
-void FSTUFF_GLESRenderer::SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 &matrix, const gbVec4 &color) {
-    switch (shape) {
-        case FSTUFF_ShapeCircle: {
-            this->circleMatrices[i] = matrix;
-            this->circleColors[i] = color;
-        } break;
-        case FSTUFF_ShapeBox: {
-            this->boxMatrices[i] = matrix;
-            this->boxColors[i] = color;
-        } break;
-        case FSTUFF_ShapeSegment: {
-            this->segmentMatrices[i] = matrix;
-            this->segmentColors[i] = color;
-        } break;
-        case FSTUFF_ShapeDebug: {
-            this->debugShapeMatrices[i] = matrix;
-            this->debugShapeColors[i] = color;
-        } break;
+void FSTUFF_GLESRenderer::SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 &matrix, FSTUFF_RGBA8 color) {
+    const FSTUFF_ShapeInstance instance = {matrix, color};
+    this->SetShapeInstances(shape, i, &instance, 1);
+}
+
+void FSTUFF_GLESRenderer::SetShapeInstances(FSTUFF_ShapeType shape, size_t offset, const FSTUFF_ShapeInstance * instances, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    FSTUFF_Assert((offset + count) <= FSTUFF_GL_MaxInstancesPerType[shape]);
+    this->instanceSources[shape] = {this->instanceBufIDs[shape], 0};
+    glBindBuffer(GL_ARRAY_BUFFER, this->instanceBufIDs[shape]);
+    glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(FSTUFF_ShapeInstance), count * sizeof(FSTUFF_ShapeInstance), instances);
+    FSTUFF_GLCheck();
+}
+
+FSTUFF_ShapeInstance * FSTUFF_GLESRenderer::MapShapeInstances() {
+    if ( ! this->frameInstancesBufID) {
+        return nullptr;
+    }
+#if __EMSCRIPTEN__
+    return nullptr;
+#else
+    // Invalidating the buffer lets the driver hand back fresh memory, rather
+    // than wait on last frame's draws.  Only what gets written, gets flushed.
+    glBindBuffer(GL_ARRAY_BUFFER, this->frameInstancesBufID);
+    void * mapped = glMapBufferRange(
+        GL_ARRAY_BUFFER,
+        0,
+        FSTUFF_FramePacket::kMaxInstances * sizeof(FSTUFF_ShapeInstance),
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    FSTUFF_GLCheck();
+    return (FSTUFF_ShapeInstance *) mapped;
+#endif
+}
+
+void FSTUFF_GLESRenderer::UnmapShapeInstances(size_t numWritten) {
+#if ! __EMSCRIPTEN__
+    glBindBuffer(GL_ARRAY_BUFFER, this->frameInstancesBufID);
+    if (numWritten > 0) {
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, numWritten * sizeof(FSTUFF_ShapeInstance));
+    }
+    if ( ! glUnmapBuffer(GL_ARRAY_BUFFER)) {
+        // The buffer's contents got lost (as can happen on a mode switch).
+        // The next frame will rebuild them.
+        FSTUFF_Log("Instance buffer's contents were lost, while mapped\n");
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    FSTUFF_GLCheck();
+#endif
+}
+
+// Frames spent timing each FSTUFF_GLInstanceFetch, when picking one
+// automatically.  The first few, of each, are left untimed, as warm-up.
+static const int FSTUFF_GL_InstanceFetchWarmupFrames = 5;
+static const int FSTUFF_GL_InstanceFetchFrames = 30;
+
+void FSTUFF_GLESRenderer::RenderFrame(const FSTUFF_FramePacket & packet) {
+    // Pick how instances get fetched, this frame.  Auto-selection times each
+    // way in turn, with the GPU drained before and after, so as to measure
+    // just this frame's work.
+    const int kFramesPerFetch = FSTUFF_GL_InstanceFetchWarmupFrames + FSTUFF_GL_InstanceFetchFrames;
+    const int calibrationFrame = this->instanceFetchCalibration.frame;
+    const bool isCalibrating = (this->instanceFetch == FSTUFF_GLInstanceFetch::Auto) && (calibrationFrame < (kFramesPerFetch * 2));
+    const bool isTimed = isCalibrating && ((calibrationFrame % kFramesPerFetch) >= FSTUFF_GL_InstanceFetchWarmupFrames);
+    double startS = 0.;
+    if (isCalibrating) {
+        this->activeInstanceFetch = (calibrationFrame < kFramesPerFetch) ?
+            FSTUFF_GLInstanceFetch::Attributes :
+            FSTUFF_GLInstanceFetch::Texture;
+        if (isTimed) {
+            glFinish();
+            startS = FSTUFF_GL_NowS();
+        }
+    }
+    const bool useTexture = (this->activeInstanceFetch == FSTUFF_GLInstanceFetch::Texture);
+
+    this->projectionMatrix = packet.projectionMatrix;
+    if (useTexture) {
+        glUseProgram(this->simTexProgram);
+        glUniformMatrix4fv(this->simTex_viewMatrix, 1, 0, (const GLfloat *)&(this->projectionMatrix));
+    } else {
+        glUseProgram(this->simProgram);
+        const int uniform_viewMatrix = glGetUniformLocation(this->simProgram, "viewMatrix");
+        glUniformMatrix4fv(uniform_viewMatrix, 1, 0, (const GLfloat *)&(this->projectionMatrix));
+    }
+
+    uint32_t first = 0;
+    if (useTexture) {
+        // Copy the frame's instances into instanceTex, by way of
+        // frameInstancesBufID, which gets filled first, if they weren't built
+        // in place.  Only rows that hold instances get copied.
+        const size_t numBytes = (size_t)this->instanceTexWidth * (size_t)this->instanceTexHeight * 16;
+        const size_t numInstances = packet.numInstances[0] + packet.numInstances[1] + packet.numInstances[2] + packet.numInstances[3];
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->frameInstancesBufID);
+        if ( ! packet.instancesInRenderer) {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, numBytes, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, numInstances * sizeof(FSTUFF_ShapeInstance), packet.instances);
+        }
+        const size_t numTexels = (((numInstances * sizeof(FSTUFF_ShapeInstance)) + 15) / 16) + 1;
+        const GLsizei numRows = (GLsizei)((numTexels + this->instanceTexWidth - 1) / this->instanceTexWidth);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, this->instanceTex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->instanceTexWidth, numRows, GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glActiveTexture(GL_TEXTURE0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (size_t type = 0; type < FSTUFF_NumShapeTypes; ++type) {
+            this->instanceSources[type] = {this->frameInstancesBufID, first};
+            first += packet.numInstances[type];
+        }
+
+        // Attribute-fetching's per-instance arrays aren't needed
+        glDisableVertexAttribArray(simVS_colorRGBX);
+        for (int i = 0; i < 4; ++i) {
+            glDisableVertexAttribArray(simVS_modelMatrix + i);
+        }
+        FSTUFF_GLCheck();
+    } else if (packet.instancesInRenderer) {
+        // Instances got built in place, via MapShapeInstances()
+        for (size_t type = 0; type < FSTUFF_NumShapeTypes; ++type) {
+            this->instanceSources[type] = {this->frameInstancesBufID, first};
+            first += packet.numInstances[type];
+        }
+    } else {
+        // Upload each type's instances at once.  Each buffer gets orphaned
+        // first, so that the upload needn't wait on last frame's draws.
+        for (size_t type = 0; type < FSTUFF_NumShapeTypes; ++type) {
+            const uint32_t count = packet.numInstances[type];
+            if (count > 0) {
+                glBindBuffer(GL_ARRAY_BUFFER, this->instanceBufIDs[type]);
+                glBufferData(GL_ARRAY_BUFFER, FSTUFF_GL_MaxInstancesPerType[type] * sizeof(FSTUFF_ShapeInstance), nullptr, GL_DYNAMIC_DRAW);
+                this->SetShapeInstances((FSTUFF_ShapeType)type, 0, packet.instances + first, count);
+            }
+            first += count;
+        }
+    }
+
+    for (uint32_t i = 0; i < packet.numDrawCommands; ++i) {
+        const FSTUFF_FramePacket::DrawCommand & command = packet.drawCommands[i];
+        this->FSTUFF_GLESRenderer::RenderShapes(sim->GetShape(command.shape), command.offset, command.count, command.alpha);
+    }
+
+    if (isTimed) {
+        glFinish();
+        this->instanceFetchCalibration.seconds[(calibrationFrame < kFramesPerFetch) ? 0 : 1] += (FSTUFF_GL_NowS() - startS);
+    }
+    if (isCalibrating) {
+        this->instanceFetchCalibration.frame += 1;
+        if (this->instanceFetchCalibration.frame == (kFramesPerFetch * 2)) {
+            const double attributesMS = (this->instanceFetchCalibration.seconds[0] * 1000.) / FSTUFF_GL_InstanceFetchFrames;
+            const double textureMS = (this->instanceFetchCalibration.seconds[1] * 1000.) / FSTUFF_GL_InstanceFetchFrames;
+            this->activeInstanceFetch = (textureMS < attributesMS) ?
+                FSTUFF_GLInstanceFetch::Texture :
+                FSTUFF_GLInstanceFetch::Attributes;
+            FSTUFF_Log("Instance fetching: vertex attributes, %.3f ms/frame; texture, %.3f ms/frame; using %s\n",
+                attributesMS,
+                textureMS,
+                (this->activeInstanceFetch == FSTUFF_GLInstanceFetch::Texture) ? "texture" : "vertex attributes");
+        }
     }
 }
 
@@ -780,71 +1852,132 @@ void FSTUFF_GLESRenderer::RenderShapes(FSTUFF_Shape * shape, size_t offset, size
     }
     
     //
-    // Copy data to OpenGL
+    // Point OpenGL at the shape type's instances; these got uploaded by
+    // SetShapeInstances(), or built in place, via MapShapeInstances().  Or,
+    // if they're fetched from instanceTex, just say where the draw's start.
     //
     FSTUFF_GLCheck();
-
-    // Send to OpenGL: color
-    switch (shape->type) {
-        case FSTUFF_ShapeCircle:
-            glBindBuffer(GL_ARRAY_BUFFER, this->circleColorsBufID);
-            glBufferData(GL_ARRAY_BUFFER, count * sizeof(float) * 4, this->circleColors + offset, GL_DYNAMIC_DRAW);
-            break;
-        case FSTUFF_ShapeBox:
-            glBindBuffer(GL_ARRAY_BUFFER, this->boxColorsBufID);
-            glBufferData(GL_ARRAY_BUFFER, count * sizeof(float) * 4, this->boxColors + offset, GL_DYNAMIC_DRAW);
-            break;
-        case FSTUFF_ShapeSegment:
-            glBindBuffer(GL_ARRAY_BUFFER, this->segmentColorsBufID);
-            glBufferData(GL_ARRAY_BUFFER, count * sizeof(float) * 4, this->segmentColors + offset, GL_DYNAMIC_DRAW);
-            break;
-        case FSTUFF_ShapeDebug:
-            glBindBuffer(GL_ARRAY_BUFFER, this->debugShapeColorsBufID);
-            glBufferData(GL_ARRAY_BUFFER, count * sizeof(float) * 4, this->debugShapeColors + offset, GL_DYNAMIC_DRAW);
-            break;
+    const bool useTexture = (this->activeInstanceFetch == FSTUFF_GLInstanceFetch::Texture);
+    const size_t firstInstance = this->instanceSources[shape->type].first + offset;
+    if (useTexture) {
+        glUniform1i(this->simTex_instanceBase, (GLint)firstInstance);
+    } else {
+        const GLsizei instanceStride = (GLsizei) sizeof(FSTUFF_ShapeInstance);
+        const uintptr_t instancesStart = firstInstance * sizeof(FSTUFF_ShapeInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, this->instanceSources[shape->type].bufID);
+
+        // Send to OpenGL: color
+        glVertexAttribPointer(simVS_colorRGBX, 4, GL_UNSIGNED_BYTE, GL_TRUE, instanceStride, (void *)(instancesStart + offsetof(FSTUFF_ShapeInstance, color)));
+        glEnableVertexAttribArray(simVS_colorRGBX);
+        this->glVertexAttribDivisor(simVS_colorRGBX, 1);
+
+        // Send to OpenGL: modelMatrix
+        for (int i = 0; i < 4; ++i) {
+            const int location = simVS_modelMatrix;
+            glVertexAttribPointer       (location + i, 4, GL_FLOAT, GL_FALSE, instanceStride, (void *)(instancesStart + offsetof(FSTUFF_ShapeInstance, transform) + (sizeof(float) * 4 * i)));
+            glEnableVertexAttribArray   (location + i);
+            this->glVertexAttribDivisor (location + i, 1);
+        }
     }
-    glVertexAttribPointer(simVS_colorRGBX, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glEnableVertexAttribArray(simVS_colorRGBX);
-    this->glVertexAttribDivisor(simVS_colorRGBX, 1);
 
     // Send to OpenGL: alpha
     glVertexAttrib1f(simVS_alpha, alpha);
 
-    // Send to OpenGL: modelMatrix
-    switch (shape->type) {
-        case FSTUFF_ShapeCircle:
-            glBindBuffer(GL_ARRAY_BUFFER, this->circleMatricesBufID);
-            glBufferData(GL_ARRAY_BUFFER, count * sizeof(gbMat4), this->circleMatrices + offset, GL_DYNAMIC_DRAW);
-            break;
-        case FSTUFF_ShapeBox:
-            glBindBuffer(GL_ARRAY_BUFFER, this->boxMatricesBufID);
-            glBufferData(GL_ARRAY_BUFFER, count * sizeof(gbMat4), this->boxMatrices + offset, GL_DYNAMIC_DRAW);
-            break;
-        case FSTUFF_ShapeSegment:
-            glBindBuffer(GL_ARRAY_BUFFER, this->segmentMatricesBufID);
-            glBufferData(GL_ARRAY_BUFFER, count * sizeof(gbMat4), this->segmentMatrices + offset, GL_DYNAMIC_DRAW);
-            break;
-        case FSTUFF_ShapeDebug:
-            glBindBuffer(GL_ARRAY_BUFFER, this->debugShapeMatricesBufID);
-            glBufferData(GL_ARRAY_BUFFER, count * sizeof(gbMat4), this->debugShapeMatrices + offset, GL_DYNAMIC_DRAW);
-            break;
-    }
-    for (int i = 0; i < 4; ++i) {
-        const int location = simVS_modelMatrix;
-        glVertexAttribPointer       (location + i, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void *)(sizeof(float) * 4 * i));
-        glEnableVertexAttribArray   (location + i);
-        this->glVertexAttribDivisor (location + i, 1);
-    }
-
     // Send to OpenGL: position
     glBindBuffer(GL_ARRAY_BUFFER, (GLuint)(uintptr_t) shape->gpuVertexBuffer);
     glVertexAttribPointer(simVS_position, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(simVS_position);
 
+    // SDF circles use their own program, albeit with the same attributes
+    const bool isSDF = (shape->appearance == FSTUFF_ShapeAppearanceSDF);
+    if (isSDF && useTexture) {
+        FSTUFF_Assert(this->sdfCircleTexProgram != 0);
+        glUseProgram(this->sdfCircleTexProgram);
+        glUniformMatrix4fv(this->sdfCircleTex_viewMatrix, 1, 0, (const GLfloat *)&(this->projectionMatrix));
+        glUniform2f(this->sdfCircleTex_viewportSize, (GLfloat)sim->viewSize.widthPixels, (GLfloat)sim->viewSize.heightPixels);
+        glUniform1f(this->sdfCircleTex_dotCount, (GLfloat)shape->circle.numDots);
+        glUniform1i(this->sdfCircleTex_instanceBase, (GLint)firstInstance);
+    } else if (isSDF) {
+        FSTUFF_Assert(this->sdfCircleProgram != 0);
+        glUseProgram(this->sdfCircleProgram);
+        glUniformMatrix4fv(this->sdfCircle_viewMatrix, 1, 0, (const GLfloat *)&(this->projectionMatrix));
+        glUniform2f(this->sdfCircle_viewportSize, (GLfloat)sim->viewSize.widthPixels, (GLfloat)sim->viewSize.heightPixels);
+        glUniform1f(this->sdfCircle_dotCount, (GLfloat)shape->circle.numDots);
+    }
+
     //
     // Draw!
     //
     FSTUFF_GLCheck();
     this->glDrawArraysInstanced(gpuPrimitiveType, 0, shape->numVertices, (int)count);
+    if (isSDF) {
+        glUseProgram(useTexture ? this->simTexProgram : this->simProgram);
+    }
+    FSTUFF_GLCheck();
+}
+
+void FSTUFF_GLESRenderer::ReadOffscreenPixels(uint64_t frame, const FSTUFF_GL_PixelsCallback & onPixels)
+{
+    FSTUFF_Assert(this->offscreenFBO);
+    FSTUFF_GLCheck();
+    const int w = this->offscreenWidth;
+    const int h = this->offscreenHeight;
+    glBindFramebuffer(GL_FRAMEBUFFER, this->offscreenFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // Synchronous readback
+    if ( ! this->offscreenPBOs[0]) {
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, this->offscreenPixels.data());
+        FSTUFF_GLCheck();
+        onPixels(this->offscreenPixels.data(), w, h, frame);
+        return;
+    }
+
+    // Asynchronous readback.  If the slot for this frame is still holding an
+    // older frame, that older frame gets handed off, first.
+#if ! __EMSCRIPTEN__
+    const int slot = (int)(frame % FSTUFF_GL_NumReadbackBuffers);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, this->offscreenPBOs[slot]);
+    if (this->offscreenPBOPending[slot]) {
+        const void * pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)w * h * 4, GL_MAP_READ_BIT);
+        FSTUFF_Assert(pixels != nullptr);
+        onPixels((const uint8_t *)pixels, w, h, this->offscreenPBOFrames[slot]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    this->offscreenPBOFrames[slot] = frame;
+    this->offscreenPBOPending[slot] = true;
     FSTUFF_GLCheck();
+#endif
+}
+
+void FSTUFF_GLESRenderer::FinishOffscreenReads(const FSTUFF_GL_PixelsCallback & onPixels)
+{
+#if ! __EMSCRIPTEN__
+    // Hand off any still-pending frames, oldest first
+    while (true) {
+        int oldest = -1;
+        for (int i = 0; i < FSTUFF_GL_NumReadbackBuffers; ++i) {
+            if (this->offscreenPBOPending[i] &&
+                (oldest < 0 || this->offscreenPBOFrames[i] < this->offscreenPBOFrames[oldest]))
+            {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+        const int w = this->offscreenWidth;
+        const int h = this->offscreenHeight;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->offscreenPBOs[oldest]);
+        const void * pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)w * h * 4, GL_MAP_READ_BIT);
+        FSTUFF_Assert(pixels != nullptr);
+        onPixels((const uint8_t *)pixels, w, h, this->offscreenPBOFrames[oldest]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        this->offscreenPBOPending[oldest] = false;
+    }
+    FSTUFF_GLCheck();
+#endif
 }
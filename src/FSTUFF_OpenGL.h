@@ -12,7 +12,10 @@
 #include "FSTUFF.h"
 #include "FSTUFF_Constants.h"
 #include "gb_math.h"
+#include <functional>
+#include <string>
 #include <unordered_set>
+#include <vector>
 
 #define GL_SILENCE_DEPRECATION
 #define GL_DO_NOT_WARN_IF_MULTI_GL_VERSION_HEADERS_INCLUDED
@@ -45,15 +48,36 @@ enum class FSTUFF_GLVersion {
     GLESv3,
 };
 
+// How vertex shaders get at per-instance data (transforms and colors)
+enum class FSTUFF_GLInstanceFetch {
+    Auto,           // time both, over the first few frames, then use the faster one
+    Attributes,     // instanced vertex attributes; the only option on GLESv2
+    Texture,        // texelFetch()es, via gl_InstanceID, from an integer texture
+};
+
 template <typename T>
 struct FSTUFF_GL_Shaders {
     T simulationVertex;
     T simulationFragment;
     T imGuiVertex;
     T imGuiFragment;
+    T sdfCircleVertex;
+    T sdfCircleFragment;
+    T simulationVertexTexFetch;     // as simulationVertex, but fetching instances via FSTUFF_GL_InstanceFetchCode
+    T sdfCircleVertexTexFetch;      // as sdfCircleVertex, likewise
+    T imGuiFragmentAlpha8;          // as imGuiFragment, for FSTUFF_TextureFormat::Alpha8 textures
 };
 typedef FSTUFF_GL_Shaders<const char *> FSTUFF_GL_ShaderCode;
 
+// Number of pixel-pack buffers used for asynchronous, offscreen readback.
+// Frame N gets mapped (and handed off) while frames N+1 .. N+(count-1) are
+// still in flight.
+#define FSTUFF_GL_NumReadbackBuffers 3
+
+// Receives offscreen pixels: tightly-packed RGBA8 rows, bottom row first
+// (i.e. in OpenGL's native orientation).
+typedef std::function<void(const uint8_t * rgba, int width, int height, uint64_t frame)> FSTUFF_GL_PixelsCallback;
+
 
 struct FSTUFF_GLESRenderer : public FSTUFF_Renderer {
     FSTUFF_GLVersion glVersion = FSTUFF_GLVersion::GLESv3;
@@ -69,28 +93,57 @@ struct FSTUFF_GLESRenderer : public FSTUFF_Renderer {
     void (FSTUFF_stdcall * glVertexAttribDivisor)(GLuint, GLuint) = nullptr;
     
     std::unordered_set<std::string> glExtensionsCache;
+    bool logExtensions = true;      // if false, Init() doesn't log glExtensionsCache; LogExtensions() can, later
+
+    // Set before Init().  If set, linked programs get cached in this
+    // directory, as driver-specific binaries, for faster startups.
+    std::string programCacheDir;
 
     gbMat4 projectionMatrix;
 
     GLuint mainVAO = 0;     // 'VAO' == 'Vertex Array Object'
 
-    gbMat4 circleMatrices[FSTUFF_MaxCircles];
-    GLuint circleMatricesBufID = -1;
-    gbVec4 circleColors[FSTUFF_MaxCircles];
-    GLuint circleColorsBufID = -1;
-    gbMat4 boxMatrices[FSTUFF_MaxBoxes];
-    GLuint boxMatricesBufID = -1;
-    gbVec4 boxColors[FSTUFF_MaxBoxes];
-    GLuint boxColorsBufID = -1;
-    gbMat4 segmentMatrices[FSTUFF_MaxSegments];
-    GLuint segmentMatricesBufID = -1;
-    gbVec4 segmentColors[FSTUFF_MaxSegments];
-    GLuint segmentColorsBufID = -1;
-
-    gbMat4 debugShapeMatrices[1];
-    GLuint debugShapeMatricesBufID = -1;
-    gbVec4 debugShapeColors[1];
-    GLuint debugShapeColorsBufID = -1;
+    // Per-instance data, one buffer per FSTUFF_ShapeType, each holding
+    // interleaved FSTUFF_ShapeInstances.  These get written directly from
+    // SetShapeInstances()'s source, with no CPU-side copy.
+    GLuint instanceBufIDs[FSTUFF_NumShapeTypes] = {0};
+
+    // A whole frame's instances, grouped by type, as built in place via
+    // MapShapeInstances(), or, on WebGL, uploaded from the frame packet.  0
+    // on GLESv2.  With attribute fetching, WebGL (which lacks buffer mapping)
+    // draws from the per-type buffers instead.  With texture fetching, this
+    // is the pixel-unpack source for instanceTex, and is sized to fill it.
+    GLuint frameInstancesBufID = 0;
+
+    // Set before Init().  activeInstanceFetch is what's in use for the
+    // current frame: never Auto, and always Attributes on GLESv2.
+    FSTUFF_GLInstanceFetch instanceFetch = FSTUFF_GLInstanceFetch::Auto;
+    FSTUFF_GLInstanceFetch activeInstanceFetch = FSTUFF_GLInstanceFetch::Attributes;
+
+    // Set before Init().  For testing fallbacks: if set, the optional
+    // programs (SDF circles, and texture-fetched instances) fail to link, as
+    // if the driver had rejected them.
+    bool failOptionalPrograms = false;
+
+    // Auto-selection's timings, in seconds, indexed by FSTUFF_GLInstanceFetch
+    // (less one).  Done once 'frame' reaches twice the frames-per-path.
+    struct {
+        int frame = 0;
+        double seconds[2] = {0., 0.};
+    } instanceFetchCalibration;
+
+    // Instances, for texture fetching: frameInstancesBufID's contents, as
+    // RGBA32UI texels (i.e. 4 raw words apiece), on texture unit 1
+    GLuint instanceTex = 0;
+    GLsizei instanceTexWidth = 0;
+    GLsizei instanceTexHeight = 0;
+
+    // Where RenderShapes() gets each type's instances from: a buffer, and
+    // the index, within it, of the type's first instance
+    struct {
+        GLuint bufID;
+        size_t first;
+    } instanceSources[FSTUFF_NumShapeTypes] = {};
 
     GLuint simProgram = 0;
     GLint simVS_position = -1;
@@ -98,6 +151,35 @@ struct FSTUFF_GLESRenderer : public FSTUFF_Renderer {
     GLint simVS_alpha = -1;
     GLint simVS_modelMatrix = -1;
 
+    // Circles drawn via signed distance fields, with the same vertex
+    // attributes (and attribute locations) as simProgram
+    GLuint sdfCircleProgram = 0;
+    GLint sdfCircle_viewMatrix = -1;
+    GLint sdfCircle_viewportSize = -1;
+    GLint sdfCircle_dotCount = -1;
+
+    // As simProgram and sdfCircleProgram, but with instances fetched from
+    // instanceTex.  Zero on GLESv2, or if they failed to build.
+    GLuint simTexProgram = 0;
+    GLint simTex_viewMatrix = -1;
+    GLint simTex_instanceBase = -1;
+    GLuint sdfCircleTexProgram = 0;
+    GLint sdfCircleTex_viewMatrix = -1;
+    GLint sdfCircleTex_viewportSize = -1;
+    GLint sdfCircleTex_dotCount = -1;
+    GLint sdfCircleTex_instanceBase = -1;
+
+    // Offscreen render-target, used in place of the default framebuffer,
+    // if InitOffscreen() gets called.
+    GLuint offscreenFBO = 0;
+    GLuint offscreenColorTex = 0;
+    int offscreenWidth = 0;
+    int offscreenHeight = 0;
+    GLuint offscreenPBOs[FSTUFF_GL_NumReadbackBuffers] = {0};    // 'PBO' == 'Pixel Buffer Object'; unused on GLESv2
+    uint64_t offscreenPBOFrames[FSTUFF_GL_NumReadbackBuffers] = {0};
+    bool offscreenPBOPending[FSTUFF_GL_NumReadbackBuffers] = {false};
+    std::vector<uint8_t> offscreenPixels;
+
     GLuint imGuiProgram = 0;
     GLuint imGuiVBO = 0;
     GLuint imGuiElements = 0;
@@ -106,24 +188,38 @@ struct FSTUFF_GLESRenderer : public FSTUFF_Renderer {
     GLint imGui_position = -1;
     GLint imGui_uv = -1;
     GLint imGui_color = -1;
+    GLuint imGuiAlpha8Program = 0;      // imGuiProgram, but for textures in 'alpha8Textures'
+    GLint imGuiAlpha8_tex = -1;
+    GLint imGuiAlpha8_projMtx = -1;
+    std::unordered_set<GLuint> alpha8Textures;
 
     FSTUFF_GLESRenderer();
     ~FSTUFF_GLESRenderer() override;
     void    Init();
+    void    LogExtensions() const;
+    void    InitOffscreen(int width, int height);
     void    BeginFrame() override;
 
     void *  NewVertexBuffer(void * src, size_t size) override;
     void    DestroyVertexBuffer(void * gpuVertexBuffer) override;
 
-    FSTUFF_Texture NewTexture(const uint8_t * srcRGBA32, int width, int height) override;
+    FSTUFF_Texture NewTexture(const uint8_t * src, int width, int height, FSTUFF_TextureFormat format) override;
     void    DestroyTexture(FSTUFF_Texture tex) override;
 
     void    ViewChanged() override;
     void    RenderShapes(FSTUFF_Shape * shape, size_t offset, size_t count, float alpha) override;
     void    RenderImGuiDrawData(ImDrawData * drawData);
     void    SetProjectionMatrix(const gbMat4 & matrix) override;
-    void    SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 & matrix, const gbVec4 & color) override;
+    void    SetShapeProperties(FSTUFF_ShapeType shape, size_t i, const gbMat4 & matrix, FSTUFF_RGBA8 color) override;
+    void    SetShapeInstances(FSTUFF_ShapeType shape, size_t offset, const FSTUFF_ShapeInstance * instances, size_t count) override;
+    FSTUFF_ShapeInstance * MapShapeInstances() override;
+    void    UnmapShapeInstances(size_t numWritten) override;
+    void    RenderFrame(const FSTUFF_FramePacket & packet) override;
     FSTUFF_CursorInfo GetCursorInfo() override;
+    bool    SupportsSDFCircles() const override { return this->sdfCircleProgram != 0; }
+
+    void    ReadOffscreenPixels(uint64_t frame, const FSTUFF_GL_PixelsCallback & onPixels);
+    void    FinishOffscreenReads(const FSTUFF_GL_PixelsCallback & onPixels);
 };
 
 
@@ -1,11 +1,25 @@
 
 #include "FSTUFF.h"
 #include "FSTUFF_OpenGL.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define SDL_MAIN_HANDLED
 #include <SDL.h>
 
+#if FSTUFF_USE_EGL_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 #if __EMSCRIPTEN__
 #include <emscripten.h>
 #include <emscripten/html5.h>
@@ -15,6 +29,22 @@ struct FSTUFF_SDLGLRenderer : public FSTUFF_GLESRenderer {
     SDL_Window * window = nullptr;
     SDL_GLContext gl = nullptr;
 
+#if FSTUFF_USE_EGL_HEADLESS
+    // Headless mode: a surfaceless EGL context, with no window (nor display)
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+
+    bool MakeCurrent()
+    {
+#if FSTUFF_USE_EGL_HEADLESS
+        if (this->eglContext != EGL_NO_CONTEXT) {
+            return eglMakeCurrent(this->eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, this->eglContext) == EGL_TRUE;
+        }
+#endif
+        return SDL_GL_MakeCurrent(this->window, this->gl) == 0;
+    }
+
     FSTUFF_ViewSize GetViewSize()
     {
         FSTUFF_ViewSize vs;
@@ -30,8 +60,20 @@ struct FSTUFF_SDLGLRenderer : public FSTUFF_GLESRenderer {
 
         #else
 
-        SDL_GetWindowSize(window, &vs.widthOS, &vs.heightOS);
-        SDL_GL_GetDrawableSize(window, &vs.widthPixels, &vs.heightPixels);
+        if (this->offscreenFBO) {
+            // Offscreen rendering is independent of the window's size
+            vs.widthPixels = this->offscreenWidth;
+            vs.heightPixels = this->offscreenHeight;
+            vs.widthOS = this->offscreenWidth;
+            vs.heightOS = this->offscreenHeight;
+        } else {
+            int widthOS = 0;
+            int heightOS = 0;
+            SDL_GetWindowSize(window, &widthOS, &heightOS);
+            vs.widthOS = widthOS;
+            vs.heightOS = heightOS;
+            SDL_GL_GetDrawableSize(window, &vs.widthPixels, &vs.heightPixels);
+        }
 
         #endif
 
@@ -43,10 +85,13 @@ struct FSTUFF_SDLGLRenderer : public FSTUFF_GLESRenderer {
     }
 
     FSTUFF_CursorInfo GetCursorInfo() override {
+        FSTUFF_CursorInfo cur;
+        if ( ! this->window) {
+            return cur;
+        }
         int x = 0.f;
         int y = 0.f;
         const Uint32 sdlButtons = SDL_GetMouseState(&x, &y);
-        FSTUFF_CursorInfo cur;
         cur.xOS = (int)x;
         cur.yOS = (int)y;
         cur.pressed = (sdlButtons != 0);
@@ -58,6 +103,76 @@ FSTUFF_SDLGLRenderer * renderer = nullptr;
 FSTUFF_Simulation * sim = nullptr;
 static bool didHideLoadingUI = false;
 
+enum class FSTUFF_SDLPresentMode : uint8_t {
+    Default = 0,    // leave the swap interval up to the driver
+    VSync,          // swap interval 1
+    Uncapped,       // swap interval 0; as fast as possible, for benchmarking
+    FixedFPS,       // swap interval 0, then sleep until the next frame is due
+    AdaptiveVSync,  // swap interval -1: vsync, unless a frame is late; falls back to VSync
+};
+
+static const char * FSTUFF_SDLPresentModeName(FSTUFF_SDLPresentMode mode) {
+    switch (mode) {
+        case FSTUFF_SDLPresentMode::Default:        return "default";
+        case FSTUFF_SDLPresentMode::VSync:          return "vsync";
+        case FSTUFF_SDLPresentMode::Uncapped:       return "uncapped";
+        case FSTUFF_SDLPresentMode::FixedFPS:       return "fixed";
+        case FSTUFF_SDLPresentMode::AdaptiveVSync:  return "adaptive";
+    }
+    return "?";
+}
+
+// Host configuration, as set from the command line and/or environment
+// variables; see FSTUFF_SDLOptions.  Settings for the simulation itself get
+// applied directly to 'sim'.
+//
+// Offscreen, render-to-file mode renders a fixed number of frames into an
+// offscreen framebuffer (of any size, regardless of the window's size),
+// without presenting anything.  Frames may optionally get written to disk.
+
+// An --output pattern, split around its one frame-number field
+struct FSTUFF_OutputPattern {
+    std::string prefix;
+    std::string suffix;
+    int digits = 0;             // zero-pad frame numbers to this many digits; 0 == no padding
+};
+
+struct FSTUFF_SDLConfig {
+    int width = 1024;           // window size, or offscreen framebuffer size
+    int height = 768;
+    bool fullscreen = false;
+    FSTUFF_SDLPresentMode presentMode = FSTUFF_SDLPresentMode::Default;
+    double targetFPS = 30.;     // for FSTUFF_SDLPresentMode::FixedFPS
+    double idleFPS = 4.;        // frame rate while the scene is idle (see FSTUFF_SimulationStats); 0 == no throttling
+    int64_t numFrames = -1;     // -1 == unset: unlimited when windowed, 600 when offscreen; 0 == unlimited
+    int64_t seed = -1;          // -1 == unset: random when windowed, 1 when offscreen
+    double fixedTimeStepS = -1; // -1 == unset: system clock when windowed, 1/60 when offscreen
+    bool offscreen = false;
+    std::string outputPattern;  // pattern for output files, as given; "" == no output
+    FSTUFF_OutputPattern output;    // outputPattern, parsed
+    bool headless = false;      // if true, no window gets created; a surfaceless EGL context is used instead
+    bool glVersionSet = false;  // if false, the best available GL version gets used; see FSTUFF_GLVersionsToTry()
+    bool fastStartup = false;   // if true, defer work that the first frame doesn't need
+    std::string programCache = "on";    // "on" == SDL's per-user pref dir; "off" == none; otherwise, a directory
+    std::string pegCache = "on";        // as with programCache
+    std::string benchmark;      // if set, run this CPU benchmark (see FSTUFF_RunBenchmark), then exit
+    std::string trajectoryPath; // when offscreen, write marbles' trajectories to this file; "" == no output
+    std::string comparePaths;   // if set, "A,B": compare two trajectory files, then exit
+    std::string capturePath;    // write every frame's FSTUFF_FramePacket to this file; "" == no capture
+    std::string replayPath;     // draw FSTUFF_FramePackets from this file, looping, rather than simulating
+};
+static FSTUFF_SDLConfig config;
+static FILE * captureFile = nullptr;
+static FILE * replayFile = nullptr;
+
+// Windowed-mode frame timing
+static FSTUFF_FrameTimeStats frameTimes;
+static std::chrono::steady_clock::time_point lastFrameTime;     // when the previous frame finished presenting
+static std::chrono::steady_clock::time_point nextFrameDeadline; // for FSTUFF_SDLPresentMode::FixedFPS
+static bool quitRequested = false;
+static bool idleThisFrame = false;                              // true if the current frame started after an idle wait
+static uint64_t numIdleFrames = 0;
+
 void tick();
 
 #if __EMSCRIPTEN__
@@ -73,6 +188,24 @@ CanvasState canvasState;
 EM_BOOL onRender(double time, void *userData) {
     // FSTUFF_Log("onRender: time=%f\n", time);
 
+    // Browsers present at their own rate; a fixed FPS is approximated by
+    // skipping animation frames.  (A few milliseconds of slack avoid skipping
+    // frames that are due, but arrive slightly early.)
+    // The same goes for idle scenes.
+    static double lastTickTime = 0.;
+    double minFrameTimeMS = 0.;
+    if (config.presentMode == FSTUFF_SDLPresentMode::FixedFPS) {
+        minFrameTimeMS = (1000. / config.targetFPS) - 8.;
+    }
+    if (sim && sim->stats.idle && config.idleFPS > 0.) {
+        minFrameTimeMS = std::max(minFrameTimeMS, std::min(1000. / config.idleFPS, sim->stats.nextChangeInS * 1000.) - 8.);
+    }
+    if (lastTickTime > 0. && (time - lastTickTime) < minFrameTimeMS) {
+        emscripten_request_animation_frame(onRender, nullptr);
+        return EM_TRUE;
+    }
+    lastTickTime = time;
+
     if (canvasState.needsResize)
     {
         emscripten_set_canvas_element_size("#canvas", 
@@ -177,7 +310,7 @@ void process_event(SDL_Event & e) {
         } break;
 
         case SDL_QUIT:
-            std::exit(0);
+            quitRequested = true;
             break;
         case SDL_WINDOWEVENT:
             switch (e.window.event) {
@@ -216,21 +349,76 @@ int FSTUFF_SDL_EventWatcher(void * userdata, SDL_Event * event) {
     return 1;
 }
 
-void tick() {
-    // FSTUFF_Log("tick\n");
-
+void draw() {
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
         process_event(e);
     }
 
-    if (SDL_GL_MakeCurrent(renderer->window, renderer->gl) != 0) {
-        FSTUFF_FatalError("SDL_GL_MakeCurrent failed: %s\n", SDL_GetError());
+    if ( ! renderer->MakeCurrent()) {
+        FSTUFF_FatalError("Unable to make GL context current: %s\n", SDL_GetError());
+    }
+    if (replayFile) {
+        if ( ! FSTUFF_ReadFramePacket(replayFile, sim->FramePacket())) {
+            rewind(replayFile);
+            if ( ! FSTUFF_ReadFramePacket(replayFile, sim->FramePacket())) {
+                FSTUFF_FatalError("Unable to replay frames from \"%s\"\n", config.replayPath.c_str());
+            }
+        }
+        sim->UpdateFromPacket();
+    } else {
+        sim->Update();
     }
-    sim->Update();
     sim->Render();
-    ImDrawData * imGuiDrawData = ImGui::GetDrawData();
+    if (captureFile && ! FSTUFF_WriteFramePacket(captureFile, sim->FramePacket())) {
+        FSTUFF_Log("Unable to write to \"%s\"; capture stopped\n", config.capturePath.c_str());
+        fclose(captureFile);
+        captureFile = nullptr;
+    }
+    ImDrawData * imGuiDrawData = sim->GetGUIDrawData();
     renderer->RenderImGuiDrawData(imGuiDrawData);
+}
+
+// Waits, while the scene is idle, for either the idle frame rate's next frame,
+// the scene's next scheduled change, or for an event, whichever comes first.
+static void FSTUFF_WaitWhileIdle() {
+    idleThisFrame = false;
+    if (config.idleFPS <= 0. || ! sim->stats.idle || lastFrameTime.time_since_epoch().count() == 0) {
+        return;
+    }
+    const double sinceLastFrameS = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastFrameTime).count();
+    const double waitS = std::min(1. / config.idleFPS, sim->stats.nextChangeInS) - sinceLastFrameS;
+    idleThisFrame = true;
+    if (waitS <= 0.) {
+        return;
+    }
+    SDL_Event e;
+    if (SDL_WaitEventTimeout(&e, (int) std::ceil(waitS * 1000.))) {
+        process_event(e);
+    }
+}
+
+// Call once the first frame is up, to log the startup profile, then do what
+// got deferred until now
+static void FSTUFF_DidPresentFirstFrame() {
+    if ( ! FSTUFF_GetStartupProfile().IsRecording()) {
+        return;
+    }
+    FSTUFF_GetStartupProfile().FirstFrame();
+    if ( ! renderer->logExtensions) {
+        renderer->LogExtensions();
+    }
+}
+
+void tick() {
+    // FSTUFF_Log("tick\n");
+
+#if ! __EMSCRIPTEN__
+    FSTUFF_WaitWhileIdle();
+#endif
+    const size_t drawStep = FSTUFF_GetStartupProfile().StartStep("first frame");
+    draw();
+    FSTUFF_GetStartupProfile().EndStep(drawStep);
     if (!didHideLoadingUI) {
 #if __EMSCRIPTEN__
         EM_ASM(
@@ -242,29 +430,936 @@ void tick() {
 #endif
         didHideLoadingUI = true;
     }
-    SDL_GL_SwapWindow(renderer->window);
+    {
+        FSTUFF_StartupStep step("first present");
+        SDL_GL_SwapWindow(renderer->window);
+    }
+    FSTUFF_DidPresentFirstFrame();
+
+#if ! __EMSCRIPTEN__
+    if (config.presentMode == FSTUFF_SDLPresentMode::FixedFPS) {
+        // Sleep, rather than spin, to keep CPU (and GPU) duty cycles low.  If
+        // the deadline was missed by over a frame, start pacing anew, rather
+        // than rushing to catch up.
+        const auto now = std::chrono::steady_clock::now();
+        const auto framePeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1. / config.targetFPS));
+        nextFrameDeadline += framePeriod;
+        if (nextFrameDeadline < now - framePeriod || nextFrameDeadline > now + framePeriod) {
+            nextFrameDeadline = now + framePeriod;
+        }
+        std::this_thread::sleep_until(nextFrameDeadline);
+    }
+#endif
+
+    // Idle frames are slow on purpose, and get counted separately
+    const auto now = std::chrono::steady_clock::now();
+    if (idleThisFrame) {
+        numIdleFrames += 1;
+    } else if (lastFrameTime.time_since_epoch().count() != 0) {
+        frameTimes.Add(std::chrono::duration<double>(now - lastFrameTime).count());
+    }
+    lastFrameTime = now;
 }
 
-int main(int, char **) {
-    renderer = new FSTUFF_SDLGLRenderer;
-#if TARGET_OS_OSX
-    renderer->glVersion = FSTUFF_GLVersion::GLCorev3;
-#else
-    renderer->glVersion = FSTUFF_GLVersion::GLESv2;
+#pragma mark - Offscreen Rendering
+
+static void FSTUFF_PutU32BE(std::string & dest, uint32_t value) {
+    dest.push_back((char)((value >> 24) & 0xff));
+    dest.push_back((char)((value >> 16) & 0xff));
+    dest.push_back((char)((value >> 8) & 0xff));
+    dest.push_back((char)(value & 0xff));
+}
+
+static uint32_t FSTUFF_CRC32(const uint8_t * data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256] = {0};
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void FSTUFF_PutPNGChunk(FILE * file, const char * type, const std::string & data) {
+    std::string chunk;
+    FSTUFF_PutU32BE(chunk, (uint32_t)data.size());
+    chunk.append(type, 4);
+    chunk.append(data);
+    const uint32_t crc = FSTUFF_CRC32((const uint8_t *)chunk.data() + 4, chunk.size() - 4);
+    FSTUFF_PutU32BE(chunk, crc);
+    fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+// Writes RGBA8 pixels, given bottom-row-first, to either a binary PPM or a
+// PNG file (chosen by file extension).  Alpha gets dropped.  PNG data is
+// stored uncompressed, to avoid needing zlib.
+static bool FSTUFF_WriteImage(const char * path, const uint8_t * rgba, int width, int height) {
+    FILE * file = fopen(path, "wb");
+    if ( ! file) {
+        FSTUFF_Log("Unable to open \"%s\" for writing\n", path);
+        return false;
+    }
+
+    const size_t pathLength = strlen(path);
+    const bool isPNG = (pathLength >= 4 && strcmp(path + pathLength - 4, ".png") == 0);
+    if ( ! isPNG) {
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        std::vector<uint8_t> row(width * 3);
+        for (int y = height - 1; y >= 0; --y) {
+            const uint8_t * src = rgba + ((size_t)y * width * 4);
+            for (int x = 0; x < width; ++x) {
+                row[(x * 3) + 0] = src[(x * 4) + 0];
+                row[(x * 3) + 1] = src[(x * 4) + 1];
+                row[(x * 3) + 2] = src[(x * 4) + 2];
+            }
+            fwrite(row.data(), 1, row.size(), file);
+        }
+    } else {
+        static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        fwrite(signature, 1, sizeof(signature), file);
+
+        std::string header;
+        FSTUFF_PutU32BE(header, (uint32_t)width);
+        FSTUFF_PutU32BE(header, (uint32_t)height);
+        header.push_back(8);    // bit depth
+        header.push_back(2);    // color type: RGB
+        header.push_back(0);    // compression: deflate
+        header.push_back(0);    // filter: adaptive
+        header.push_back(0);    // interlace: none
+        FSTUFF_PutPNGChunk(file, "IHDR", header);
+
+        // Raw scanlines, each prefixed by filter-type 0 ('None')
+        std::string raw;
+        raw.reserve((size_t)height * ((width * 3) + 1));
+        for (int y = height - 1; y >= 0; --y) {
+            const uint8_t * src = rgba + ((size_t)y * width * 4);
+            raw.push_back(0);
+            for (int x = 0; x < width; ++x) {
+                raw.append((const char *)src + (x * 4), 3);
+            }
+        }
+
+        // zlib stream, made of 'stored' (uncompressed) deflate blocks
+        std::string zlib;
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        uint32_t adlerA = 1;
+        uint32_t adlerB = 0;
+        for (size_t i = 0; i < raw.size(); ++i) {
+            adlerA = (adlerA + (uint8_t)raw[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+        size_t offset = 0;
+        do {
+            const size_t blockSize = std::min<size_t>(raw.size() - offset, 65535);
+            const bool isFinal = (offset + blockSize) == raw.size();
+            zlib.push_back(isFinal ? 1 : 0);
+            zlib.push_back((char)(blockSize & 0xff));
+            zlib.push_back((char)((blockSize >> 8) & 0xff));
+            zlib.push_back((char)(~blockSize & 0xff));
+            zlib.push_back((char)((~blockSize >> 8) & 0xff));
+            zlib.append(raw, offset, blockSize);
+            offset += blockSize;
+        } while (offset < raw.size());
+        FSTUFF_PutU32BE(zlib, (adlerB << 16) | adlerA);
+        FSTUFF_PutPNGChunk(file, "IDAT", zlib);
+        FSTUFF_PutPNGChunk(file, "IEND", std::string());
+    }
+
+    const bool didWrite = ! ferror(file);
+    if ((fclose(file) != 0) || ! didWrite) {
+        FSTUFF_Log("Unable to write to \"%s\"\n", path);
+        return false;
+    }
+    return true;
+}
+
+static bool outputFailed = false;   // set once a frame fails to get written; ends offscreen runs
+
+static void FSTUFF_WriteOffscreenFrame(const uint8_t * rgba, int width, int height, uint64_t frame) {
+    if (outputFailed) {
+        return;
+    }
+    char number[32];
+    snprintf(number, sizeof(number), "%0*llu", config.output.digits, (unsigned long long)frame);
+    const std::string path = config.output.prefix + number + config.output.suffix;
+    if ( ! FSTUFF_WriteImage(path.c_str(), rgba, width, height)) {
+        FSTUFF_Log("Unable to write frame %llu to \"%s\"; stopping\n", (unsigned long long)frame, path.c_str());
+        outputFailed = true;
+    }
+}
+
+#pragma mark - Trajectories
+
+// Trajectory files are text.  A header line is followed by one line per
+// marble, per frame:
+//
+//   # FallingStuff trajectory: cpFloat=<float|double> world=<width>x<height>
+//   <frame> <marble> <x> <y> <angle>
+//
+// Two runs, made with the same seed and fixed time-step (as offscreen runs
+// are, by default), can then be compared, for example, to check that a
+// single-precision physics build behaves like a double-precision one.
+
+struct FSTUFF_TrajectoryPoint {
+    double x;
+    double y;
+    double angle;
+};
+
+struct FSTUFF_Trajectory {
+    std::string precision;
+    double worldWidth = 0.;
+    double worldHeight = 0.;
+    std::vector<std::vector<FSTUFF_TrajectoryPoint>> frames;     // indexed by frame, then by marble
+};
+
+static const char * FSTUFF_CPFloatName() {
+    return (sizeof(cpFloat) == sizeof(float)) ? "float" : "double";
+}
+
+static void FSTUFF_WriteTrajectoryHeader(FILE * file) {
+    fprintf(file, "# FallingStuff trajectory: cpFloat=%s world=%.9gx%.9g\n",
+        FSTUFF_CPFloatName(), (double)sim->GetWorldWidth(), (double)sim->GetWorldHeight());
+}
+
+static void FSTUFF_WriteTrajectoryFrame(FILE * file, uint64_t frame) {
+    for (size_t i = sim->game.numPegs; i < sim->game.numCircles; ++i) {
+        const cpBody * body = cpShapeGetBody((cpShape *)sim->GetCircle(i));
+        const cpVect position = cpBodyGetPosition(body);
+        fprintf(file, "%llu %zu %.9g %.9g %.9g\n",
+            (unsigned long long)frame, i - sim->game.numPegs,
+            (double)position.x, (double)position.y, (double)cpBodyGetAngle(body));
+    }
+}
+
+static bool FSTUFF_ReadTrajectory(const char * path, FSTUFF_Trajectory * trajectory) {
+    FILE * file = fopen(path, "r");
+    if ( ! file) {
+        FSTUFF_Log("Unable to open trajectory file, \"%s\"\n", path);
+        return false;
+    }
+
+    char precision[16] = {0};
+    if (fscanf(file, "# FallingStuff trajectory: cpFloat=%15s world=%lfx%lf", precision, &trajectory->worldWidth, &trajectory->worldHeight) != 3) {
+        FSTUFF_Log("\"%s\" is not a trajectory file\n", path);
+        fclose(file);
+        return false;
+    }
+    trajectory->precision = precision;
+
+    unsigned long long frame = 0;
+    size_t marble = 0;
+    FSTUFF_TrajectoryPoint point;
+    while (fscanf(file, "%llu %zu %lf %lf %lf", &frame, &marble, &point.x, &point.y, &point.angle) == 5) {
+        if (trajectory->frames.size() <= frame) {
+            trajectory->frames.resize(frame + 1);
+        }
+        std::vector<FSTUFF_TrajectoryPoint> & marbles = trajectory->frames[frame];
+        if (marbles.size() <= marble) {
+            marbles.resize(marble + 1, FSTUFF_TrajectoryPoint{NAN, NAN, NAN});
+        }
+        marbles[marble] = point;
+    }
+    fclose(file);
+    return true;
+}
+
+// Compares two trajectories, logging how far they diverge.  Chaotic systems
+// like this one diverge, marble by marble, from any change at all, but only
+// after a while.  So, over the first kMatchingFrames frames that have
+// marbles, every marble must stay within kMatchingTolerance (of the world's
+// height) of its counterpart.  After that, plausibility is judged on
+// aggregates: both runs must keep the same number of marbles, every position
+// must be finite and inside the walls, and the marbles' mean height must stay
+// within 10% of the world's height.
+static bool FSTUFF_CompareTrajectories(const std::string & paths) {
+    const size_t kMatchingFrames = 60;
+    const double kMatchingTolerance = 0.001;
+
+    const size_t comma = paths.find(',');
+    if (comma == std::string::npos) {
+        FSTUFF_Log("Expected two trajectory files, as \"A,B\"\n");
+        return false;
+    }
+    const std::string pathA = paths.substr(0, comma);
+    const std::string pathB = paths.substr(comma + 1);
+    FSTUFF_Trajectory a, b;
+    if ( ! FSTUFF_ReadTrajectory(pathA.c_str(), &a) || ! FSTUFF_ReadTrajectory(pathB.c_str(), &b)) {
+        return false;
+    }
+
+    const size_t numFrames = std::min(a.frames.size(), b.frames.size());
+    size_t countMismatches = 0;
+    size_t badPositions = 0;
+    int64_t firstDivergedFrame = -1;
+    double finalMeanDivergence = 0.;
+    double maxMeanHeightDifference = 0.;
+    size_t numMatchingFrames = 0;           // frames, with marbles, in the matching window
+    double maxMatchingError = 0.;           // largest single marble's position error, over those
+    double sumSquaredMatchingError = 0.;
+    size_t numMatchingErrors = 0;
+    auto isBad = [] (const FSTUFF_TrajectoryPoint & p, const FSTUFF_Trajectory & t) {
+        return ! std::isfinite(p.x) || ! std::isfinite(p.y) || ! std::isfinite(p.angle) ||
+            p.x < 0. || p.x > t.worldWidth || p.y < 0.;
+    };
+    for (size_t frame = 0; frame < numFrames; ++frame) {
+        const std::vector<FSTUFF_TrajectoryPoint> & marblesA = a.frames[frame];
+        const std::vector<FSTUFF_TrajectoryPoint> & marblesB = b.frames[frame];
+        if (marblesA.size() != marblesB.size()) {
+            ++countMismatches;
+        }
+        const size_t numMarbles = std::min(marblesA.size(), marblesB.size());
+        if (numMarbles == 0) {
+            continue;
+        }
+        double sumHeightA = 0.;
+        double sumHeightB = 0.;
+        double sumDivergence = 0.;
+        for (size_t i = 0; i < numMarbles; ++i) {
+            badPositions += (isBad(marblesA[i], a) ? 1 : 0) + (isBad(marblesB[i], b) ? 1 : 0);
+            sumHeightA += marblesA[i].y;
+            sumHeightB += marblesB[i].y;
+            sumDivergence += hypot(marblesA[i].x - marblesB[i].x, marblesA[i].y - marblesB[i].y);
+        }
+        if (numMatchingFrames < kMatchingFrames) {
+            ++numMatchingFrames;
+            for (size_t i = 0; i < numMarbles; ++i) {
+                const double error = hypot(marblesA[i].x - marblesB[i].x, marblesA[i].y - marblesB[i].y);
+                maxMatchingError = std::isnan(error) ? INFINITY : std::max(maxMatchingError, error);
+                sumSquaredMatchingError += error * error;
+                ++numMatchingErrors;
+            }
+        }
+        const double meanDivergence = sumDivergence / (double)numMarbles;
+        if (firstDivergedFrame < 0 && meanDivergence > 1.) {
+            firstDivergedFrame = (int64_t)frame;
+        }
+        finalMeanDivergence = meanDivergence;
+        maxMeanHeightDifference = std::max(maxMeanHeightDifference, std::abs(sumHeightA - sumHeightB) / (double)numMarbles);
+    }
+
+    const double heightTolerance = 0.1 * std::max(a.worldHeight, b.worldHeight);
+    const double matchingTolerance = kMatchingTolerance * std::max(a.worldHeight, b.worldHeight);
+    const double rmsMatchingError = (numMatchingErrors > 0) ? sqrt(sumSquaredMatchingError / (double)numMatchingErrors) : 0.;
+    const bool plausible =
+        (numFrames > 0) &&
+        (a.frames.size() == b.frames.size()) &&
+        (countMismatches == 0) &&
+        (badPositions == 0) &&
+        (numMatchingFrames > 0) &&
+        (maxMatchingError <= matchingTolerance) &&
+        (maxMeanHeightDifference <= heightTolerance);
+
+    FSTUFF_Log("Trajectories: %s (cpFloat=%s) vs %s (cpFloat=%s); %zu frames compared\n",
+        pathA.c_str(), a.precision.c_str(), pathB.c_str(), b.precision.c_str(), numFrames);
+    FSTUFF_Log("  mean divergence first exceeded 1 world unit at frame %lld; %.3f at the last frame\n",
+        (long long)firstDivergedFrame, finalMeanDivergence);
+    FSTUFF_Log("  first %zu frames with marbles: max position error %.6f, RMS %.6f (tolerance: %.6f)\n",
+        numMatchingFrames, maxMatchingError, rmsMatchingError, matchingTolerance);
+    FSTUFF_Log("  max difference in mean height: %.3f (tolerance: %.3f)\n", maxMeanHeightDifference, heightTolerance);
+    FSTUFF_Log("  frames with differing marble counts: %zu; non-finite or escaped positions: %zu\n", countMismatches, badPositions);
+    FSTUFF_Log("  verdict: %s\n", plausible ? "plausible" : "IMPLAUSIBLE");
+    return plausible;
+}
+
+// Renders config.numFrames frames, as fast as possible, then reports timings.
+// Returns false if frames were to be written, but one couldn't be.
+static bool FSTUFF_RunOffscreen() {
+    const uint64_t numFrames = (uint64_t)config.numFrames;
+    FSTUFF_Log("Offscreen: rendering %llu frames at %dx%d; cpFloat is %s\n",
+        (unsigned long long)numFrames, config.width, config.height, FSTUFF_CPFloatName());
+
+    FILE * trajectoryFile = nullptr;
+    if ( ! config.trajectoryPath.empty()) {
+        trajectoryFile = fopen(config.trajectoryPath.c_str(), "w");
+        if ( ! trajectoryFile) {
+            FSTUFF_Log("Unable to open \"%s\" for writing\n", config.trajectoryPath.c_str());
+        }
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    auto frameStartTime = startTime;
+    uint64_t instanceBytes = 0;
+    uint64_t instanceBytesInPlace = 0;
+    for (uint64_t frame = 0; frame < numFrames; ++frame) {
+        if (frame == 0) {
+            // Nothing gets presented; the first frame's pixels are "up" once
+            // the GPU has finished them.
+            {
+                FSTUFF_StartupStep step("first frame");
+                draw();
+                glFinish();
+            }
+            FSTUFF_DidPresentFirstFrame();
+        } else {
+            draw();
+        }
+        instanceBytes += sim->stats.instanceBytes;
+        instanceBytesInPlace += sim->stats.instanceBytesInPlace;
+        if ( ! config.outputPattern.empty()) {
+            renderer->ReadOffscreenPixels(frame, FSTUFF_WriteOffscreenFrame);
+            if (outputFailed) {
+                break;
+            }
+        }
+        if (trajectoryFile) {
+            if (frame == 0) {
+                FSTUFF_WriteTrajectoryHeader(trajectoryFile);
+            }
+            FSTUFF_WriteTrajectoryFrame(trajectoryFile, frame);
+        }
+        const auto frameEndTime = std::chrono::steady_clock::now();
+        frameTimes.Add(std::chrono::duration<double>(frameEndTime - frameStartTime).count());
+        frameStartTime = frameEndTime;
+    }
+    if ( ! config.outputPattern.empty()) {
+        renderer->FinishOffscreenReads(FSTUFF_WriteOffscreenFrame);
+    }
+    if (trajectoryFile) {
+        fclose(trajectoryFile);
+    }
+    if (outputFailed) {
+        return false;
+    }
+    glFinish();
+    const double elapsedS = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    FSTUFF_Log("Offscreen: %llu frames in %.3f s; %.2f ms/frame; %.1f frames/s\n",
+        (unsigned long long)numFrames,
+        elapsedS,
+        (elapsedS * 1000.) / (double)numFrames,
+        (double)numFrames / elapsedS);
+    FSTUFF_Log("Offscreen: instances, %.1f KB/frame; built in place (copies avoided), %.1f KB/frame\n",
+        ((double)instanceBytes / 1024.) / (double)numFrames,
+        ((double)instanceBytesInPlace / 1024.) / (double)numFrames);
+    frameTimes.Log("Offscreen frame times (CPU; GPU work is pipelined)");
+    return true;
+}
+
+#pragma mark - Configuration
+
+static bool FSTUFF_ParseBool(const char * value, bool * out) {
+    if ( ! *value || strcmp(value, "1") == 0 || strcmp(value, "on") == 0 || strcmp(value, "true") == 0 || strcmp(value, "yes") == 0) {
+        *out = true;
+    } else if (strcmp(value, "0") == 0 || strcmp(value, "off") == 0 || strcmp(value, "false") == 0 || strcmp(value, "no") == 0) {
+        *out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool FSTUFF_ParseInt(const char * value, int64_t minimum, int64_t maximum, int64_t * out) {
+    char * end = nullptr;
+    const long long parsed = strtoll(value, &end, 10);
+    if (end == value || *end != '\0' || parsed < minimum || parsed > maximum) {
+        return false;
+    }
+    *out = (int64_t)parsed;
+    return true;
+}
+
+static bool FSTUFF_ParseDouble(const char * value, double minimum, double maximum, double * out) {
+    char * end = nullptr;
+    const double parsed = strtod(value, &end);
+    if (end == value || *end != '\0' || !(parsed >= minimum && parsed <= maximum)) {
+        return false;
+    }
+    *out = parsed;
+    return true;
+}
+
+// Splits an --output pattern around its one frame-number field, either %d,
+// or %0Nd (zero-padded to N digits).  "%%" is a literal '%'.  Patterns with
+// any other field, or with no field, or with more than one, are rejected.
+static bool FSTUFF_ParseOutputPattern(const char * value, FSTUFF_OutputPattern * out) {
+    FSTUFF_OutputPattern pattern;
+    std::string * dest = &pattern.prefix;
+    bool hasField = false;
+    for (const char * c = value; *c; ++c) {
+        if (*c != '%') {
+            dest->push_back(*c);
+            continue;
+        }
+        ++c;
+        if (*c == '%') {
+            dest->push_back('%');
+            continue;
+        }
+        if (hasField) {
+            return false;
+        }
+        if (*c == '0') {
+            ++c;
+            if (*c < '1' || *c > '9') {
+                return false;
+            }
+            while (*c >= '0' && *c <= '9') {
+                pattern.digits = (pattern.digits * 10) + (*c - '0');
+                if (pattern.digits > 20) {
+                    return false;
+                }
+                ++c;
+            }
+        }
+        if (*c != 'd') {
+            return false;
+        }
+        hasField = true;
+        dest = &pattern.suffix;
+    }
+    if ( ! hasField) {
+        return false;
+    }
+    *out = pattern;
+    return true;
+}
+
+static bool FSTUFF_ParseSize(const char * value, int * width, int * height) {
+    int w = 0;
+    int h = 0;
+    char trailing = 0;
+    if (sscanf(value, "%dx%d%c", &w, &h, &trailing) != 2 || w <= 0 || h <= 0) {
+        return false;
+    }
+    *width = w;
+    *height = h;
+    return true;
+}
+
+// An option may be set on the command line, as "--name=value" (or as "--name",
+// for on/off options), or via an environment variable, named "FSTUFF_NAME"
+// (upper-cased, with dashes replaced by underscores).  Command-line values
+// take precedence over environment variables, which take precedence over
+// defaults.
+struct FSTUFF_SDLOption {
+    const char * name;
+    const char * valueHint;     // shown in --help; nullptr for options that take no value
+    const char * help;
+    bool (*apply)(const char * value);
+};
+
+static const FSTUFF_SDLOption FSTUFF_SDLOptions[] = {
+    {"size", "WxH", "window size; or, offscreen framebuffer size (default: 1024x768)", [] (const char * value) {
+        return FSTUFF_ParseSize(value, &config.width, &config.height);
+    }},
+    {"fullscreen", nullptr, "use a fullscreen window", [] (const char * value) {
+        return FSTUFF_ParseBool(value, &config.fullscreen);
+    }},
+    {"fast-startup", nullptr, "defer work the first frame doesn't need (GL extension logging) until after it", [] (const char * value) {
+        return FSTUFF_ParseBool(value, &config.fastStartup);
+    }},
+    {"gl", "core3|es2|es3", "OpenGL profile to render with (default: the best available, of core3, es3, then es2)", [] (const char * value) {
+        if (strcmp(value, "core3") == 0) {
+            renderer->glVersion = FSTUFF_GLVersion::GLCorev3;
+        } else if (strcmp(value, "es2") == 0) {
+            renderer->glVersion = FSTUFF_GLVersion::GLESv2;
+        } else if (strcmp(value, "es3") == 0) {
+            renderer->glVersion = FSTUFF_GLVersion::GLESv3;
+        } else {
+            return false;
+        }
+        config.glVersionSet = true;
+        return true;
+    }},
+    {"program-cache", "on|off|DIR", "cache linked GL programs on disk, for faster startups; 'on' uses the per-user app data dir (default: on)", [] (const char * value) {
+        if ( ! *value) {
+            return false;
+        }
+        config.programCache = value;
+        return true;
+    }},
+    {"peg-cache", "on|off|DIR", "cache peg layouts on disk, when --seed is set, for reuse across runs and window sizes; 'on' uses the per-user app data dir (default: on)", [] (const char * value) {
+        if ( ! *value) {
+            return false;
+        }
+        config.pegCache = value;
+        return true;
+    }},
+    {"instance-fetch", "auto|attributes|texture", "how shaders get per-shape data, on core3 and es3; 'auto' times both, then picks (default: auto)", [] (const char * value) {
+        if (strcmp(value, "auto") == 0) {
+            renderer->instanceFetch = FSTUFF_GLInstanceFetch::Auto;
+        } else if (strcmp(value, "attributes") == 0) {
+            renderer->instanceFetch = FSTUFF_GLInstanceFetch::Attributes;
+        } else if (strcmp(value, "texture") == 0) {
+            renderer->instanceFetch = FSTUFF_GLInstanceFetch::Texture;
+        } else {
+            return false;
+        }
+        return true;
+    }},
+    {"gl-fail-optional", "on|off", "for testing: make the optional GL programs (SDF circles, texture-fetched instances) fail to link, exercising their fallbacks (default: off)", [] (const char * value) {
+        return FSTUFF_ParseBool(value, &renderer->failOptionalPrograms);
+    }},
+    {"present", "vsync|uncapped|fixed|adaptive", "presentation mode (default: driver's choice); 'fixed' paces to --target-fps", [] (const char * value) {
+        for (FSTUFF_SDLPresentMode mode : {
+            FSTUFF_SDLPresentMode::Default,
+            FSTUFF_SDLPresentMode::VSync,
+            FSTUFF_SDLPresentMode::Uncapped,
+            FSTUFF_SDLPresentMode::FixedFPS,
+            FSTUFF_SDLPresentMode::AdaptiveVSync })
+        {
+            if (strcmp(value, FSTUFF_SDLPresentModeName(mode)) == 0) {
+                config.presentMode = mode;
+                return true;
+            }
+        }
+        return false;
+    }},
+    {"vsync", "on|off", "shorthand for --present=vsync, or --present=uncapped", [] (const char * value) {
+        bool vsync = false;
+        if ( ! FSTUFF_ParseBool(value, &vsync)) {
+            return false;
+        }
+        config.presentMode = (vsync ? FSTUFF_SDLPresentMode::VSync : FSTUFF_SDLPresentMode::Uncapped);
+        return true;
+    }},
+    {"target-fps", "N", "frame rate for --present=fixed, which this implies (default: 30)", [] (const char * value) {
+        if ( ! FSTUFF_ParseDouble(value, 1., 1000., &config.targetFPS)) {
+            return false;
+        }
+        config.presentMode = FSTUFF_SDLPresentMode::FixedFPS;
+        return true;
+    }},
+    {"idle-fps", "N", "frame rate while no marbles move, nor get added; 0 == don't throttle (default: 4)", [] (const char * value) {
+        return FSTUFF_ParseDouble(value, 0., 1000., &config.idleFPS);
+    }},
+    {"marbles-max", "N", "maximum number of marbles", [] (const char * value) {
+        int64_t marblesMax = 0;
+        if ( ! FSTUFF_ParseInt(value, 0, FSTUFF_MaxCircles, &marblesMax)) {
+            return false;
+        }
+        sim->marblesMax = (int32_t)marblesMax;
+        return true;
+    }},
+    {"spawn-rate", "N", "marbles added per second", [] (const char * value) {
+        double spawnRate = 0.;
+        if ( ! FSTUFF_ParseDouble(value, 0.001, 1000000., &spawnRate)) {
+            return false;
+        }
+        sim->addNumMarblesPerSecond = (float)spawnRate;
+        return true;
+    }},
+    {"sdf-circles", "on|off", "draw circles as signed distance fields, rather than as meshes (default: on)", [] (const char * value) {
+        return FSTUFF_ParseBool(value, &sim->useSDFCircles);
+    }},
+    {"cull", "on|off", "skip sending shapes that are outside of the view to the renderer (default: on)", [] (const char * value) {
+        return FSTUFF_ParseBool(value, &sim->cullInstances);
+    }},
+    {"seed", "N", "random number seed; 0 == random (default: 0; or, 1 when offscreen)", [] (const char * value) {
+        return FSTUFF_ParseInt(value, 0, UINT32_MAX, &config.seed);
+    }},
+    {"frames", "N", "exit after rendering this many frames; 0 == unlimited (default: 0; or, 600 when offscreen)", [] (const char * value) {
+        return FSTUFF_ParseInt(value, 0, INT64_MAX, &config.numFrames);
+    }},
+    {"physics-step", "SECONDS", "duration of each physics step (default: 1/600)", [] (const char * value) {
+        double stepS = 0.;
+        if ( ! FSTUFF_ParseDouble(value, 0.00001, 1., &stepS)) {
+            return false;
+        }
+        sim->physicsStepS = stepS;
+        return true;
+    }},
+    {"broadphase", "bbtree|hash", "physics broadphase: bounding-box tree, or spatial hash", [] (const char * value) {
+        if (strcmp(value, "bbtree") == 0) {
+            sim->broadphase = FSTUFF_BroadphaseBBTree;
+        } else if (strcmp(value, "hash") == 0) {
+            sim->broadphase = FSTUFF_BroadphaseSpatialHash;
+        } else {
+            return false;
+        }
+        return true;
+    }},
+    {"peg-layout", "uniform|poisson", "how pegs get placed: uniformly at random, or Poisson-disk, with no overlaps (default: poisson)", [] (const char * value) {
+        if (strcmp(value, "uniform") == 0) {
+            sim->pegLayout = FSTUFF_PegLayoutUniform;
+        } else if (strcmp(value, "poisson") == 0) {
+            sim->pegLayout = FSTUFF_PegLayoutPoissonDisk;
+        } else {
+            return false;
+        }
+        return true;
+    }},
+    {"peg-spacing", "N", "Poisson-disk pegs' min gap, in largest-marble diameters (default: 1)", [] (const char * value) {
+        double spacing = 0.;
+        if ( ! FSTUFF_ParseDouble(value, 0., 100., &spacing)) {
+            return false;
+        }
+        sim->pegSpacing = spacing;
+        return true;
+    }},
+    {"physics-threads", "N", "physics solver threads; 0 == one per CPU (default: 1)", [] (const char * value) {
+        int64_t threads = 0;
+        if ( ! FSTUFF_ParseInt(value, 0, 64, &threads)) {
+            return false;
+        }
+#if ! FSTUFF_USE_HASTY_SPACE
+        if (threads != 1) {
+            FSTUFF_Log("Multithreaded physics is not supported by this build\n");
+            return false;
+        }
 #endif
-    renderer->getProcAddress = SDL_GL_GetProcAddress;
-	sim = new FSTUFF_Simulation();
-	sim->renderer = renderer;
-    renderer->sim = sim;
+        sim->physicsThreads = (int32_t)threads;
+        return true;
+    }},
+    {"instance-threads", "N", "threads that cull + gather instances, each frame; 0 == one per CPU (default: 1)", [] (const char * value) {
+        int64_t threads = 0;
+        if ( ! FSTUFF_ParseInt(value, 0, 64, &threads)) {
+            return false;
+        }
+#if ! FSTUFF_USE_JOB_THREADS
+        if (threads != 1) {
+            FSTUFF_Log("Multithreaded instance gathering is not supported by this build\n");
+            return false;
+        }
+#endif
+        sim->instanceThreads = (int32_t)threads;
+        return true;
+    }},
+    {"physics-thread", "on|off", "run physics on its own thread, decoupled from rendering; not with --fixed-dt (default: off)", [] (const char * value) {
+        if ( ! FSTUFF_ParseBool(value, &sim->threadedPhysics)) {
+            return false;
+        }
+#if ! FSTUFF_ENABLE_PHYSICS_THREAD
+        if (sim->threadedPhysics) {
+            FSTUFF_Log("Threaded physics is not supported by this build\n");
+            return false;
+        }
+#endif
+        return true;
+    }},
+    {"offscreen", "on|off|WxH", "render into an offscreen framebuffer, as fast as possible, optionally of size WxH", [] (const char * value) {
+        if (FSTUFF_ParseSize(value, &config.width, &config.height)) {
+            config.offscreen = true;
+            return true;
+        }
+        return FSTUFF_ParseBool(value, &config.offscreen);
+    }},
+    {"output", "PATTERN", "when offscreen, write frames to files; PATTERN holds one %d, or %0Nd, for the frame number (.png, else .ppm)", [] (const char * value) {
+        if ( ! FSTUFF_ParseOutputPattern(value, &config.output)) {
+            return false;
+        }
+        config.outputPattern = value;
+        return true;
+    }},
+    {"trajectory", "PATH", "when offscreen, write each marble's position, every frame, to a text file", [] (const char * value) {
+        config.trajectoryPath = value;
+        return true;
+    }},
+    {"trajectory-compare", "A,B", "compare two trajectory files (say, from float and double physics builds), then exit", [] (const char * value) {
+        config.comparePaths = value;
+        return (strchr(value, ',') != nullptr);
+    }},
+    {"capture", "PATH", "write every frame's shapes and draws to a file, for --replay", [] (const char * value) {
+        config.capturePath = value;
+        return true;
+    }},
+    {"replay", "PATH", "draw frames from a --capture file, looping, rather than simulating", [] (const char * value) {
+        config.replayPath = value;
+        return true;
+    }},
+    {"fixed-dt", "SECONDS", "advance the simulation by this much per frame; 0 == use the system clock (default: 0; or, 1/60 when offscreen)", [] (const char * value) {
+        return FSTUFF_ParseDouble(value, 0., 10., &config.fixedTimeStepS);
+    }},
+    {"headless", nullptr, "render offscreen, with no window nor display server, via EGL", [] (const char * value) {
+        if ( ! FSTUFF_ParseBool(value, &config.headless)) {
+            return false;
+        }
+#if ! FSTUFF_USE_EGL_HEADLESS
+        if (config.headless) {
+            FSTUFF_Log("Headless mode is not supported by this build (see FSTUFF_ENABLE_EGL_HEADLESS)\n");
+            return false;
+        }
+#endif
+        return true;
+    }},
+    {"benchmark", "NAME|all|list", "run a CPU benchmark, log its results, then exit", [] (const char * value) {
+        config.benchmark = value;
+        return ( ! config.benchmark.empty());
+    }},
+};
 
-	SDL_SetHint(SDL_HINT_OPENGL_ES_DRIVER, "1");
-	SDL_SetHint(SDL_HINT_VIDEO_WIN_D3DCOMPILER, "none");
+static std::string FSTUFF_SDLOptionEnvName(const FSTUFF_SDLOption & option) {
+    std::string envName = "FSTUFF_";
+    for (const char * c = option.name; *c; ++c) {
+        envName += (*c == '-') ? '_' : (char)toupper((unsigned char)*c);
+    }
+    return envName;
+}
 
-	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-		FSTUFF_Log("SDL_Init failed with error: \"%s\"\n", SDL_GetError());
-		return 1;
-	}
+static void FSTUFF_PrintUsage(const char * programName) {
+    printf("Usage: %s [--OPTION[=VALUE]]...\n\nOptions (each may also be set via its environment variable):\n", programName);
+    for (const FSTUFF_SDLOption & option : FSTUFF_SDLOptions) {
+        const std::string left = std::string("--") + option.name + (option.valueHint ? std::string("=") + option.valueHint : "");
+        printf("  %-32s %s\n  %-32s [%s]\n", left.c_str(), option.help, "", FSTUFF_SDLOptionEnvName(option).c_str());
+    }
+    printf("  %-32s %s\n", "--help", "show this message, then exit");
+}
+
+static bool FSTUFF_ApplyOption(const FSTUFF_SDLOption & option, const char * value, const char * source) {
+    if ( ! option.apply(value)) {
+        FSTUFF_Log("Invalid value for %s (from %s), \"%s\"; expected %s\n",
+            option.name, source, value, (option.valueHint ? option.valueHint : "on|off"));
+        return false;
+    }
+    return true;
+}
+
+// Applies options from the environment, then from the command line.  Returns
+// false if the program should exit, with *exitCode set to its exit code.
+static bool FSTUFF_Configure(int argc, char ** argv, int * exitCode) {
+    *exitCode = 1;
+
+    for (const FSTUFF_SDLOption & option : FSTUFF_SDLOptions) {
+        const std::string envName = FSTUFF_SDLOptionEnvName(option);
+        if (const char * value = getenv(envName.c_str())) {
+            if ( ! FSTUFF_ApplyOption(option, value, envName.c_str())) {
+                return false;
+            }
+        }
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const char * arg = argv[i];
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            FSTUFF_PrintUsage(argv[0]);
+            *exitCode = 0;
+            return false;
+        }
+
+        const FSTUFF_SDLOption * match = nullptr;
+        const char * value = "";
+        if (strncmp(arg, "--", 2) == 0) {
+            const char * name = arg + 2;
+            const char * equals = strchr(name, '=');
+            const size_t nameLength = (equals ? (size_t)(equals - name) : strlen(name));
+            for (const FSTUFF_SDLOption & option : FSTUFF_SDLOptions) {
+                if (strlen(option.name) == nameLength && strncmp(option.name, name, nameLength) == 0) {
+                    match = &option;
+                    value = (equals ? equals + 1 : "");
+                    break;
+                }
+            }
+        }
+        if ( ! match) {
+            FSTUFF_Log("Unknown argument, \"%s\"; see --help\n", arg);
+            return false;
+        }
+        if ( ! FSTUFF_ApplyOption(*match, value, "command line")) {
+            return false;
+        }
+    }
+
+    // Comparisons and benchmarks run instead of the simulation, and need no
+    // window
+    if ( ! config.comparePaths.empty()) {
+        *exitCode = FSTUFF_CompareTrajectories(config.comparePaths) ? 0 : 1;
+        return false;
+    }
+    if ( ! config.benchmark.empty()) {
+        if ( ! FSTUFF_RunBenchmark(config.benchmark.c_str())) {
+            FSTUFF_Log("Unknown benchmark, \"%s\"; see --benchmark=list\n", config.benchmark.c_str());
+            return false;
+        }
+        *exitCode = 0;
+        return false;
+    }
 
+    // Headless mode has no default framebuffer, and thus renders offscreen
+    if (config.headless) {
+        config.offscreen = true;
+    }
+
+    // Offscreen runs default to being finite, and reproducible
+    if (config.offscreen) {
+        if (config.numFrames < 0) {
+            config.numFrames = 600;
+        } else if (config.numFrames == 0) {
+            FSTUFF_Log("Offscreen rendering requires a frame limit\n");
+            return false;
+        }
+        if (config.seed < 0) {
+            config.seed = 1;
+        }
+        if (config.fixedTimeStepS < 0) {
+            config.fixedTimeStepS = 1. / 60.;
+        }
+    }
+    if (config.seed >= 0) {
+        sim->seed = (uint32_t)config.seed;
+    }
+    if (config.fixedTimeStepS >= 0) {
+        sim->fixedTimeStepS = config.fixedTimeStepS;
+    }
+    return true;
+}
+
+
+#pragma mark - GL Context Creation
+
+// Sets the current context's swap interval, as needed by config.presentMode
+static void FSTUFF_ApplyPresentMode() {
+    int swapInterval = 0;
+    switch (config.presentMode) {
+        case FSTUFF_SDLPresentMode::Default:
+            return;
+        case FSTUFF_SDLPresentMode::VSync:
+            swapInterval = 1;
+            break;
+        case FSTUFF_SDLPresentMode::Uncapped:
+        case FSTUFF_SDLPresentMode::FixedFPS:
+            swapInterval = 0;
+            break;
+        case FSTUFF_SDLPresentMode::AdaptiveVSync:
+            if (SDL_GL_SetSwapInterval(-1) == 0) {
+                return;
+            }
+            FSTUFF_Log("Adaptive vsync is unsupported (\"%s\"); using vsync\n", SDL_GetError());
+            config.presentMode = FSTUFF_SDLPresentMode::VSync;
+            swapInterval = 1;
+            break;
+    }
+    if (SDL_GL_SetSwapInterval(swapInterval) != 0) {
+        FSTUFF_Log("SDL_GL_SetSwapInterval(%d) failed with error: \"%s\"\n", swapInterval, SDL_GetError());
+    }
+}
+
+static const char * FSTUFF_GLVersionName(FSTUFF_GLVersion version) {
+    switch (version) {
+        case FSTUFF_GLVersion::GLCorev3:    return "core3";
+        case FSTUFF_GLVersion::GLESv2:      return "es2";
+        case FSTUFF_GLVersion::GLESv3:      return "es3";
+    }
+    return "?";
+}
+
+// GL versions to create a context for, best first, until one works.  Only
+// the one from --gl, if that got used.
+static std::vector<FSTUFF_GLVersion> FSTUFF_GLVersionsToTry() {
+    if (config.glVersionSet) {
+        return { renderer->glVersion };
+    }
+#if TARGET_OS_OSX
+    return { FSTUFF_GLVersion::GLCorev3 };     // macOS has no GLES
+#elif __EMSCRIPTEN__
+    return { FSTUFF_GLVersion::GLESv3, FSTUFF_GLVersion::GLESv2 };     // WebGL 2, then WebGL 1
+#else
+    return { FSTUFF_GLVersion::GLCorev3, FSTUFF_GLVersion::GLESv3, FSTUFF_GLVersion::GLESv2 };
+#endif
+}
+
+static void FSTUFF_SetGLContextAttributes() {
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);   // in case a prior attempt set some
     switch (renderer->glVersion) {
         case FSTUFF_GLVersion::GLCorev3:
 #if __APPLE__
@@ -285,42 +1380,293 @@ int main(int, char **) {
             SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
             break;
     }
-	
-	renderer->window = SDL_CreateWindow(
-        "Falling Stuff",
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        1024, 768,
-        SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
-    if (!renderer->window) {
-		FSTUFF_Log("SDL_CreateWindow failed with error: \"%s\"\n", SDL_GetError());
-        return 1;
-    }
+}
+
+// Creates the window, and the best GL context that it can get (see
+// FSTUFF_GLVersionsToTry()), setting renderer->glVersion to match.  The
+// window gets recreated for each GL version tried, as SDL picks its pixel
+// format (and, with EGL, its config and library) when creating it.
+static bool FSTUFF_CreateWindowAndContext() {
+    for (FSTUFF_GLVersion version : FSTUFF_GLVersionsToTry()) {
+        renderer->glVersion = version;
+        FSTUFF_SetGLContextAttributes();
 
-    renderer->gl = SDL_GL_CreateContext(renderer->window);
+        renderer->window = SDL_CreateWindow(
+            "Falling Stuff",
+            SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+            config.width, config.height,
+            SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI | (config.offscreen ? SDL_WINDOW_HIDDEN : (config.fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0)));
+        if ( ! renderer->window) {
+            FSTUFF_Log("Unable to create a window for --gl=%s: \"%s\"\n", FSTUFF_GLVersionName(version), SDL_GetError());
+            continue;
+        }
+
+        renderer->gl = SDL_GL_CreateContext(renderer->window);
+        if (renderer->gl) {
+            break;
+        }
+        FSTUFF_Log("Unable to create a GL context for --gl=%s: \"%s\"\n", FSTUFF_GLVersionName(version), SDL_GetError());
+        SDL_DestroyWindow(renderer->window);
+        renderer->window = nullptr;
+    }
     if (!renderer->gl) {
-		FSTUFF_Log("SDL_GL_CreateContext failed with error: \"%s\"\n", SDL_GetError());
-        return 1;
+        FSTUFF_Log("Unable to create a window and GL context, for any GL version\n");
+        return false;
     }
 
 	if (SDL_GL_MakeCurrent(renderer->window, renderer->gl) != 0) {
 		FSTUFF_Log("SDL_GL_MakeCurrent failed with error: \"%s\"\n", SDL_GetError());
+		return false;
+	}
+
+    FSTUFF_ApplyPresentMode();
+
+    renderer->getProcAddress = SDL_GL_GetProcAddress;
+    FSTUFF_Log("GL context: --gl=%s, GL_VERSION=\"%s\"\n", FSTUFF_GLVersionName(renderer->glVersion), (const char *) glGetString(GL_VERSION));
+    return true;
+}
+
+#if FSTUFF_USE_EGL_HEADLESS
+static bool FSTUFF_HasEGLExtension(const char * extensions, const char * name) {
+    const size_t nameLength = strlen(name);
+    for (const char * found = (extensions ? strstr(extensions, name) : nullptr); found; found = strstr(found + 1, name)) {
+        const bool atStart = (found == extensions) || (found[-1] == ' ');
+        const bool atEnd = (found[nameLength] == '\0') || (found[nameLength] == ' ');
+        if (atStart && atEnd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Creates a surfaceless context, for renderer->glVersion, on renderer->eglDisplay
+static bool FSTUFF_CreateHeadlessContextForVersion(const char * displayExtensions) {
+    EGLenum api = EGL_OPENGL_ES_API;
+    EGLint renderableType = EGL_OPENGL_ES2_BIT;
+    std::vector<EGLint> contextAttributes;
+    switch (renderer->glVersion) {
+        case FSTUFF_GLVersion::GLCorev3:
+            api = EGL_OPENGL_API;
+            renderableType = EGL_OPENGL_BIT;
+            contextAttributes = {
+                EGL_CONTEXT_MAJOR_VERSION, 3,
+                EGL_CONTEXT_MINOR_VERSION, 3,
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            };
+            break;
+        case FSTUFF_GLVersion::GLESv2:
+            contextAttributes = { EGL_CONTEXT_CLIENT_VERSION, 2 };
+            break;
+        case FSTUFF_GLVersion::GLESv3:
+            renderableType = EGL_OPENGL_ES3_BIT;
+            contextAttributes = { EGL_CONTEXT_CLIENT_VERSION, 3 };
+            break;
+    }
+    contextAttributes.push_back(EGL_NONE);
+
+    if ( ! eglBindAPI(api)) {
+        FSTUFF_Log("eglBindAPI failed for --gl=%s, error=0x%x\n", FSTUFF_GLVersionName(renderer->glVersion), (unsigned int)eglGetError());
+        return false;
+    }
+
+    // No config is needed, as there is no surface.  EGLs that don't support
+    // config-less contexts get the first config that can render GL.  (Some,
+    // such as Mesa's surfaceless platform on llvmpipe, expose zero configs.)
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if ( ! FSTUFF_HasEGLExtension(displayExtensions, "EGL_KHR_no_config_context")) {
+        const EGLint configAttributes[] = {
+            EGL_RENDERABLE_TYPE, renderableType,
+            EGL_NONE
+        };
+        EGLint numConfigs = 0;
+        if ( ! eglChooseConfig(renderer->eglDisplay, configAttributes, &config, 1, &numConfigs) || numConfigs < 1) {
+            FSTUFF_Log("eglChooseConfig failed for --gl=%s, error=0x%x\n", FSTUFF_GLVersionName(renderer->glVersion), (unsigned int)eglGetError());
+            return false;
+        }
+    }
+
+    renderer->eglContext = eglCreateContext(renderer->eglDisplay, config, EGL_NO_CONTEXT, contextAttributes.data());
+    if (renderer->eglContext == EGL_NO_CONTEXT) {
+        FSTUFF_Log("eglCreateContext failed for --gl=%s, error=0x%x\n", FSTUFF_GLVersionName(renderer->glVersion), (unsigned int)eglGetError());
+        return false;
+    }
+    return true;
+}
+
+// Creates a GL context with no window, no surface, and no connection to a
+// display server (X11, Wayland, etc.), via EGL_MESA_platform_surfaceless.
+// Rendering then needs to go to an FBO; see FSTUFF_GLESRenderer::InitOffscreen().
+static bool FSTUFF_CreateHeadlessContext() {
+    const char * clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto eglGetPlatformDisplayEXT = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (eglGetPlatformDisplayEXT && FSTUFF_HasEGLExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        renderer->eglDisplay = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    } else {
+        renderer->eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (renderer->eglDisplay == EGL_NO_DISPLAY) {
+        FSTUFF_Log("Unable to get an EGL display, error=0x%x\n", (unsigned int)eglGetError());
+        return false;
+    }
+
+    EGLint major = 0;
+    EGLint minor = 0;
+    if ( ! eglInitialize(renderer->eglDisplay, &major, &minor)) {
+        FSTUFF_Log("eglInitialize failed, error=0x%x\n", (unsigned int)eglGetError());
+        return false;
+    }
+    const char * displayExtensions = eglQueryString(renderer->eglDisplay, EGL_EXTENSIONS);
+    if ( ! FSTUFF_HasEGLExtension(displayExtensions, "EGL_KHR_surfaceless_context")) {
+        FSTUFF_Log("EGL %d.%d lacks EGL_KHR_surfaceless_context\n", (int)major, (int)minor);
+        return false;
+    }
+
+    // Try each GL version, best first, until a context gets created
+    for (FSTUFF_GLVersion version : FSTUFF_GLVersionsToTry()) {
+        renderer->glVersion = version;
+        if (FSTUFF_CreateHeadlessContextForVersion(displayExtensions)) {
+            break;
+        }
+    }
+    if (renderer->eglContext == EGL_NO_CONTEXT) {
+        return false;
+    }
+    if ( ! renderer->MakeCurrent()) {
+        FSTUFF_Log("eglMakeCurrent failed, error=0x%x\n", (unsigned int)eglGetError());
+        return false;
+    }
+
+    renderer->getProcAddress = [] (const char * name) {
+        return (void *) eglGetProcAddress(name);
+    };
+    FSTUFF_Log("Headless: EGL %d.%d, --gl=%s, GL_RENDERER=\"%s\"\n", (int)major, (int)minor, FSTUFF_GLVersionName(renderer->glVersion), (const char *) glGetString(GL_RENDERER));
+    return true;
+}
+#endif
+
+
+// Returns the directory that an "on|off|DIR" cache option names: "on" is
+// SDL's per-user pref dir; "off" (or a failure to get that dir) is "".
+static std::string FSTUFF_CacheDir(const std::string & option, const char * what) {
+    if (option == "off") {
+        return "";
+    }
+    if (option != "on") {
+        return option;
+    }
+    std::string dir;
+    if (char * prefPath = SDL_GetPrefPath("dll.software", "FallingStuff")) {
+        dir = prefPath;
+        SDL_free(prefPath);
+    } else {
+        FSTUFF_Log("SDL_GetPrefPath failed with error: \"%s\"; %s will not get cached\n", SDL_GetError(), what);
+    }
+    return dir;
+}
+
+int main(int argc, char ** argv) {
+    FSTUFF_GetStartupProfile().Begin();
+    renderer = new FSTUFF_SDLGLRenderer;     // its glVersion gets picked along with its context
+	sim = new FSTUFF_Simulation();
+	sim->renderer = renderer;
+    renderer->sim = sim;
+#if __EMSCRIPTEN__ && FSTUFF_USE_HASTY_SPACE
+    // Threaded web builds exist to spread physics over the CPU's cores
+    sim->physicsThreads = 0;
+#endif
+
+    int exitCode = 0;
+    if ( ! FSTUFF_Configure(argc, argv, &exitCode)) {
+        return exitCode;
+    }
+
+	SDL_SetHint(SDL_HINT_OPENGL_ES_DRIVER, "1");
+	SDL_SetHint(SDL_HINT_VIDEO_WIN_D3DCOMPILER, "none");
+
+    // Headless runs don't initialize SDL's video subsystem, which would
+    // otherwise need a display server.
+    const size_t sdlInitStep = FSTUFF_GetStartupProfile().StartStep("SDL_Init");
+    if (SDL_Init(config.headless ? 0 : SDL_INIT_VIDEO) != 0) {
+		FSTUFF_Log("SDL_Init failed with error: \"%s\"\n", SDL_GetError());
 		return 1;
 	}
+    FSTUFF_GetStartupProfile().EndStep(sdlInitStep);
+
+    const size_t contextStep = FSTUFF_GetStartupProfile().StartStep("window + GL context");
+#if FSTUFF_USE_EGL_HEADLESS
+    if (config.headless) {
+        if ( ! FSTUFF_CreateHeadlessContext()) {
+            return 1;
+        }
+    } else
+#endif
+    if ( ! FSTUFF_CreateWindowAndContext()) {
+        return 1;
+    }
+    FSTUFF_GetStartupProfile().EndStep(contextStep);
+
+    if (config.offscreen) {
+        FSTUFF_StartupStep step("InitOffscreen");
+        renderer->InitOffscreen(config.width, config.height);
+    }
 
     {
         const FSTUFF_ViewSize viewSize = renderer->GetViewSize();
         sim->ViewChanged(viewSize);
     }
-    renderer->Init();
-    sim->Init();
+    renderer->programCacheDir = FSTUFF_CacheDir(config.programCache, "programs");
+    sim->pegLayouts.dir = FSTUFF_CacheDir(config.pegCache, "peg layouts");
+    if (config.fastStartup) {
+        renderer->logExtensions = false;
+    }
+    {
+        FSTUFF_StartupStep step("renderer Init");
+        renderer->Init();
+    }
+    {
+        FSTUFF_StartupStep step("simulation Init");
+        sim->Init();
+    }
+
+    if ( ! config.capturePath.empty()) {
+        captureFile = fopen(config.capturePath.c_str(), "wb");
+        if ( ! captureFile) {
+            FSTUFF_Log("Unable to open \"%s\" for writing\n", config.capturePath.c_str());
+            return 1;
+        }
+        sim->buildInstancesInPlace = false;     // captures need each packet's own copy of its instances
+    }
+    if ( ! config.replayPath.empty()) {
+        replayFile = fopen(config.replayPath.c_str(), "rb");
+        if ( ! replayFile) {
+            FSTUFF_Log("Unable to open \"%s\" for reading\n", config.replayPath.c_str());
+            return 1;
+        }
+    }
+
+    if (config.offscreen) {
+        const bool didRun = FSTUFF_RunOffscreen();
+        if (captureFile) {
+            fclose(captureFile);
+        }
+        return didRun ? 0 : 1;
+    }
 
 #if __EMSCRIPTEN__
     start_application();
     // emscripten_set_main_loop(tick, 0, 1);
 #else
-    while (true) {
+    for (int64_t frame = 0; ! quitRequested && (config.numFrames <= 0 || frame < config.numFrames); ++frame) {
         tick();
     }
+
+    char label[64];
+    snprintf(label, sizeof(label), "Frame times (present=%s)", FSTUFF_SDLPresentModeName(config.presentMode));
+    frameTimes.Log(label);
+    FSTUFF_Log("Idle frames (excluded from frame times): %llu\n", (unsigned long long)numIdleFrames);
+    if (captureFile) {
+        fclose(captureFile);
+    }
 #endif
 
 	return 0;
@@ -0,0 +1,307 @@
+//
+//  FSTUFF_SIMD.h
+//  FallingStuff
+//
+//  Copyright © 2018 David Ludwig. All rights reserved.
+//
+
+#ifndef FSTUFF_SIMD_h
+#define FSTUFF_SIMD_h
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "gb_math.h"
+
+//
+// Vector instruction sets.  FSTUFF_USE_SIMD can be set to 0 to force use of
+// the scalar code paths, regardless of what the compiler supports.
+//
+
+#ifndef FSTUFF_USE_SIMD
+    #define FSTUFF_USE_SIMD 1
+#endif
+
+#if FSTUFF_USE_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define FSTUFF_SIMD_SSE2 1
+    #include <emmintrin.h>
+#elif FSTUFF_USE_SIMD && defined(__ARM_NEON) && defined(__aarch64__)
+    #define FSTUFF_SIMD_NEON 1
+    #include <arm_neon.h>
+#elif FSTUFF_USE_SIMD && defined(__wasm_simd128__)
+    #define FSTUFF_SIMD_WASM 1
+    #include <wasm_simd128.h>
+#endif
+
+#if FSTUFF_SIMD_SSE2 || FSTUFF_SIMD_NEON || FSTUFF_SIMD_WASM
+    #define FSTUFF_SIMD_WIDTH 4
+#else
+    #define FSTUFF_SIMD_WIDTH 1
+#endif
+
+inline const char * FSTUFF_SIMDName() {
+#if FSTUFF_SIMD_SSE2
+    return "SSE2";
+#elif FSTUFF_SIMD_NEON
+    return "NEON";
+#elif FSTUFF_SIMD_WASM
+    return "WASM SIMD128";
+#else
+    return "none";
+#endif
+}
+
+
+#pragma mark - Fast Sine + Cosine
+
+// Sine and cosine, computed together.  Angles get reduced to [-pi/4, pi/4],
+// via a three-part pi/2 (so that the reduction stays exact for all angles a
+// simulation is likely to reach), then approximated with Cephes' minimax
+// polynomials.  Max error, versus libm, is a few ULPs.
+
+#define FSTUFF_SinCos_TwoOverPi     0.636619772367581343f
+#define FSTUFF_SinCos_PiOver2_A     1.5703125f
+#define FSTUFF_SinCos_PiOver2_B     4.837512969970703125e-4f
+#define FSTUFF_SinCos_PiOver2_C     7.54978995489188216e-8f
+#define FSTUFF_SinCos_S1           -1.6666654611e-1f
+#define FSTUFF_SinCos_S2            8.3321608736e-3f
+#define FSTUFF_SinCos_S3           -1.9515295891e-4f
+#define FSTUFF_SinCos_C1            4.166664568298827e-2f
+#define FSTUFF_SinCos_C2           -1.388731625493765e-3f
+#define FSTUFF_SinCos_C3            2.443315711809948e-5f
+
+inline void FSTUFF_SinCos(float angle, float * outSin, float * outCos) {
+    const float qf = std::nearbyint(angle * FSTUFF_SinCos_TwoOverPi);   // ties-to-even, as with the vector paths
+    const int32_t q = (int32_t)qf;
+    float r = angle - (qf * FSTUFF_SinCos_PiOver2_A);
+    r = r - (qf * FSTUFF_SinCos_PiOver2_B);
+    r = r - (qf * FSTUFF_SinCos_PiOver2_C);
+
+    const float r2 = r * r;
+    const float s = r + ((r * r2) * (FSTUFF_SinCos_S1 + (r2 * (FSTUFF_SinCos_S2 + (r2 * FSTUFF_SinCos_S3)))));
+    const float c = (1.0f - (0.5f * r2)) + ((r2 * r2) * (FSTUFF_SinCos_C1 + (r2 * (FSTUFF_SinCos_C2 + (r2 * FSTUFF_SinCos_C3)))));
+
+    // Quadrant 0: ( s,  c); 1: ( c, -s); 2: (-s, -c); 3: (-c,  s)
+    const bool swap = (q & 1) != 0;
+    const float sinValue = swap ? c : s;
+    const float cosValue = swap ? s : c;
+    *outSin = (q & 2)       ? -sinValue : sinValue;
+    *outCos = ((q + 1) & 2) ? -cosValue : cosValue;
+}
+
+
+#pragma mark - Instance Transforms
+
+// Instance transforms, in structure-of-arrays form.  Each instance's matrix
+// is Translate(x, y) * RotateZ(angle) * Scale(scaleX, scaleY, 1), as
+// would be built with gb_mat4_translate, gb_mat4_rotate, and gb_mat4_scale.
+struct FSTUFF_TransformInputs {
+    const float * x;
+    const float * y;
+    const float * angle;
+    const float * scaleX;
+    const float * scaleY;
+};
+
+// Returns the elements of the i'th matrix in a run of them, 'stride' bytes
+// apart, as when each one lives inside a larger, per-instance struct.
+inline float * FSTUFF_StridedMatrix(gbMat4 * base, size_t i, size_t stride) {
+    return reinterpret_cast<gbMat4 *>(reinterpret_cast<uint8_t *>(base) + (i * stride))->e;
+}
+
+// Reference implementation, built via gb_math, exactly as instance
+// transforms were once built, one at a time.  Slow, but useful for testing.
+inline void FSTUFF_BuildTransforms_Reference(const FSTUFF_TransformInputs & in, size_t count, gbMat4 * out) {
+    for (size_t i = 0; i < count; ++i) {
+        gbMat4 dest, tmp;
+        gb_mat4_identity(&dest);
+        gb_mat4_translate(&tmp, {in.x[i], in.y[i], 0.});
+        dest *= tmp;
+        gb_mat4_rotate(&tmp, {0., 0., 1.}, in.angle[i]);
+        dest *= tmp;
+        gb_mat4_scale(&tmp, {in.scaleX[i], in.scaleY[i], 1.});
+        dest *= tmp;
+        out[i] = dest;
+    }
+}
+
+// Scalar implementation; used for whatever doesn't fit into a full vector.
+// 'outStride' is the number of bytes from one output matrix to the next.
+inline void FSTUFF_BuildTransforms_Scalar(const FSTUFF_TransformInputs & in, size_t count, gbMat4 * out, size_t outStride = sizeof(gbMat4)) {
+    for (size_t i = 0; i < count; ++i) {
+        float s, c;
+        FSTUFF_SinCos(in.angle[i], &s, &c);
+        float * e = FSTUFF_StridedMatrix(out, i, outStride);
+        e[0]  = c * in.scaleX[i];   e[1]  = s * in.scaleX[i];   e[2]  = 0.f;    e[3]  = 0.f;
+        e[4]  = -s * in.scaleY[i];  e[5]  = c * in.scaleY[i];   e[6]  = 0.f;    e[7]  = 0.f;
+        e[8]  = 0.f;                e[9]  = 0.f;                e[10] = 1.f;    e[11] = 0.f;
+        e[12] = in.x[i];            e[13] = in.y[i];            e[14] = 0.f;    e[15] = 1.f;
+    }
+}
+
+#if FSTUFF_SIMD_WIDTH > 1
+
+//
+// A thin, 4-wide abstraction over each instruction set.  Only what the
+// kernels need is here.
+//
+
+#if FSTUFF_SIMD_SSE2
+typedef __m128  FSTUFF_F4;
+typedef __m128i FSTUFF_I4;
+inline FSTUFF_F4 FSTUFF_F4_Load(const float * p)                    { return _mm_loadu_ps(p); }
+inline void      FSTUFF_F4_Store(float * p, FSTUFF_F4 a)            { _mm_storeu_ps(p, a); }
+inline FSTUFF_F4 FSTUFF_F4_Set(float a, float b, float c, float d)  { return _mm_setr_ps(a, b, c, d); }
+inline FSTUFF_F4 FSTUFF_F4_Splat(float a)                           { return _mm_set1_ps(a); }
+inline FSTUFF_F4 FSTUFF_F4_Add(FSTUFF_F4 a, FSTUFF_F4 b)            { return _mm_add_ps(a, b); }
+inline FSTUFF_F4 FSTUFF_F4_Sub(FSTUFF_F4 a, FSTUFF_F4 b)            { return _mm_sub_ps(a, b); }
+inline FSTUFF_F4 FSTUFF_F4_Mul(FSTUFF_F4 a, FSTUFF_F4 b)            { return _mm_mul_ps(a, b); }
+inline FSTUFF_I4 FSTUFF_F4_RoundToInt(FSTUFF_F4 a)                  { return _mm_cvtps_epi32(a); }      // rounds to nearest, per MXCSR's default
+inline FSTUFF_F4 FSTUFF_I4_ToFloat(FSTUFF_I4 a)                     { return _mm_cvtepi32_ps(a); }
+inline FSTUFF_I4 FSTUFF_I4_Splat(int32_t a)                         { return _mm_set1_epi32(a); }
+inline FSTUFF_I4 FSTUFF_I4_Add(FSTUFF_I4 a, FSTUFF_I4 b)            { return _mm_add_epi32(a, b); }
+inline FSTUFF_I4 FSTUFF_I4_And(FSTUFF_I4 a, FSTUFF_I4 b)            { return _mm_and_si128(a, b); }
+inline FSTUFF_I4 FSTUFF_I4_CmpEq(FSTUFF_I4 a, FSTUFF_I4 b)          { return _mm_cmpeq_epi32(a, b); }
+template <int N>
+inline FSTUFF_I4 FSTUFF_I4_ShiftLeft(FSTUFF_I4 a)                   { return _mm_slli_epi32(a, N); }
+inline FSTUFF_F4 FSTUFF_F4_Xor(FSTUFF_F4 a, FSTUFF_I4 bits)         { return _mm_xor_ps(a, _mm_castsi128_ps(bits)); }
+inline FSTUFF_F4 FSTUFF_F4_Select(FSTUFF_I4 mask, FSTUFF_F4 a, FSTUFF_F4 b) {
+    const __m128 m = _mm_castsi128_ps(mask);
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+inline FSTUFF_F4 FSTUFF_F4_ZipLo(FSTUFF_F4 a, FSTUFF_F4 b)          { return _mm_unpacklo_ps(a, b); }   // a0 b0 a1 b1
+inline FSTUFF_F4 FSTUFF_F4_ZipHi(FSTUFF_F4 a, FSTUFF_F4 b)          { return _mm_unpackhi_ps(a, b); }   // a2 b2 a3 b3
+inline FSTUFF_F4 FSTUFF_F4_CombineLo(FSTUFF_F4 a, FSTUFF_F4 b)      { return _mm_movelh_ps(a, b); }     // a0 a1 b0 b1
+inline FSTUFF_F4 FSTUFF_F4_CombineHi(FSTUFF_F4 a, FSTUFF_F4 b)      { return _mm_movehl_ps(b, a); }     // a2 a3 b2 b3
+
+#elif FSTUFF_SIMD_NEON
+typedef float32x4_t FSTUFF_F4;
+typedef int32x4_t   FSTUFF_I4;
+inline FSTUFF_F4 FSTUFF_F4_Load(const float * p)                    { return vld1q_f32(p); }
+inline void      FSTUFF_F4_Store(float * p, FSTUFF_F4 a)            { vst1q_f32(p, a); }
+inline FSTUFF_F4 FSTUFF_F4_Set(float a, float b, float c, float d)  { const float v[4] = {a, b, c, d}; return vld1q_f32(v); }
+inline FSTUFF_F4 FSTUFF_F4_Splat(float a)                           { return vdupq_n_f32(a); }
+inline FSTUFF_F4 FSTUFF_F4_Add(FSTUFF_F4 a, FSTUFF_F4 b)            { return vaddq_f32(a, b); }
+inline FSTUFF_F4 FSTUFF_F4_Sub(FSTUFF_F4 a, FSTUFF_F4 b)            { return vsubq_f32(a, b); }
+inline FSTUFF_F4 FSTUFF_F4_Mul(FSTUFF_F4 a, FSTUFF_F4 b)            { return vmulq_f32(a, b); }
+inline FSTUFF_I4 FSTUFF_F4_RoundToInt(FSTUFF_F4 a)                  { return vcvtnq_s32_f32(a); }
+inline FSTUFF_F4 FSTUFF_I4_ToFloat(FSTUFF_I4 a)                     { return vcvtq_f32_s32(a); }
+inline FSTUFF_I4 FSTUFF_I4_Splat(int32_t a)                         { return vdupq_n_s32(a); }
+inline FSTUFF_I4 FSTUFF_I4_Add(FSTUFF_I4 a, FSTUFF_I4 b)            { return vaddq_s32(a, b); }
+inline FSTUFF_I4 FSTUFF_I4_And(FSTUFF_I4 a, FSTUFF_I4 b)            { return vandq_s32(a, b); }
+inline FSTUFF_I4 FSTUFF_I4_CmpEq(FSTUFF_I4 a, FSTUFF_I4 b)          { return vreinterpretq_s32_u32(vceqq_s32(a, b)); }
+template <int N>
+inline FSTUFF_I4 FSTUFF_I4_ShiftLeft(FSTUFF_I4 a)                   { return vshlq_n_s32(a, N); }
+inline FSTUFF_F4 FSTUFF_F4_Xor(FSTUFF_F4 a, FSTUFF_I4 bits)         { return vreinterpretq_f32_s32(veorq_s32(vreinterpretq_s32_f32(a), bits)); }
+inline FSTUFF_F4 FSTUFF_F4_Select(FSTUFF_I4 mask, FSTUFF_F4 a, FSTUFF_F4 b) { return vbslq_f32(vreinterpretq_u32_s32(mask), a, b); }
+inline FSTUFF_F4 FSTUFF_F4_ZipLo(FSTUFF_F4 a, FSTUFF_F4 b)          { return vzip1q_f32(a, b); }
+inline FSTUFF_F4 FSTUFF_F4_ZipHi(FSTUFF_F4 a, FSTUFF_F4 b)          { return vzip2q_f32(a, b); }
+inline FSTUFF_F4 FSTUFF_F4_CombineLo(FSTUFF_F4 a, FSTUFF_F4 b)      { return vcombine_f32(vget_low_f32(a), vget_low_f32(b)); }
+inline FSTUFF_F4 FSTUFF_F4_CombineHi(FSTUFF_F4 a, FSTUFF_F4 b)      { return vcombine_f32(vget_high_f32(a), vget_high_f32(b)); }
+
+#elif FSTUFF_SIMD_WASM
+typedef v128_t FSTUFF_F4;
+typedef v128_t FSTUFF_I4;
+inline FSTUFF_F4 FSTUFF_F4_Load(const float * p)                    { return wasm_v128_load(p); }
+inline void      FSTUFF_F4_Store(float * p, FSTUFF_F4 a)            { wasm_v128_store(p, a); }
+inline FSTUFF_F4 FSTUFF_F4_Set(float a, float b, float c, float d)  { return wasm_f32x4_make(a, b, c, d); }
+inline FSTUFF_F4 FSTUFF_F4_Splat(float a)                           { return wasm_f32x4_splat(a); }
+inline FSTUFF_F4 FSTUFF_F4_Add(FSTUFF_F4 a, FSTUFF_F4 b)            { return wasm_f32x4_add(a, b); }
+inline FSTUFF_F4 FSTUFF_F4_Sub(FSTUFF_F4 a, FSTUFF_F4 b)            { return wasm_f32x4_sub(a, b); }
+inline FSTUFF_F4 FSTUFF_F4_Mul(FSTUFF_F4 a, FSTUFF_F4 b)            { return wasm_f32x4_mul(a, b); }
+inline FSTUFF_I4 FSTUFF_F4_RoundToInt(FSTUFF_F4 a)                  { return wasm_i32x4_trunc_sat_f32x4(wasm_f32x4_nearest(a)); }
+inline FSTUFF_F4 FSTUFF_I4_ToFloat(FSTUFF_I4 a)                     { return wasm_f32x4_convert_i32x4(a); }
+inline FSTUFF_I4 FSTUFF_I4_Splat(int32_t a)                         { return wasm_i32x4_splat(a); }
+inline FSTUFF_I4 FSTUFF_I4_Add(FSTUFF_I4 a, FSTUFF_I4 b)            { return wasm_i32x4_add(a, b); }
+inline FSTUFF_I4 FSTUFF_I4_And(FSTUFF_I4 a, FSTUFF_I4 b)            { return wasm_v128_and(a, b); }
+inline FSTUFF_I4 FSTUFF_I4_CmpEq(FSTUFF_I4 a, FSTUFF_I4 b)          { return wasm_i32x4_eq(a, b); }
+template <int N>
+inline FSTUFF_I4 FSTUFF_I4_ShiftLeft(FSTUFF_I4 a)                   { return wasm_i32x4_shl(a, N); }
+inline FSTUFF_F4 FSTUFF_F4_Xor(FSTUFF_F4 a, FSTUFF_I4 bits)         { return wasm_v128_xor(a, bits); }
+inline FSTUFF_F4 FSTUFF_F4_Select(FSTUFF_I4 mask, FSTUFF_F4 a, FSTUFF_F4 b) { return wasm_v128_bitselect(a, b, mask); }
+inline FSTUFF_F4 FSTUFF_F4_ZipLo(FSTUFF_F4 a, FSTUFF_F4 b)          { return wasm_i32x4_shuffle(a, b, 0, 4, 1, 5); }
+inline FSTUFF_F4 FSTUFF_F4_ZipHi(FSTUFF_F4 a, FSTUFF_F4 b)          { return wasm_i32x4_shuffle(a, b, 2, 6, 3, 7); }
+inline FSTUFF_F4 FSTUFF_F4_CombineLo(FSTUFF_F4 a, FSTUFF_F4 b)      { return wasm_i32x4_shuffle(a, b, 0, 1, 4, 5); }
+inline FSTUFF_F4 FSTUFF_F4_CombineHi(FSTUFF_F4 a, FSTUFF_F4 b)      { return wasm_i32x4_shuffle(a, b, 2, 3, 6, 7); }
+#endif
+
+// FSTUFF_SinCos(), four angles at a time
+inline void FSTUFF_SinCos4(FSTUFF_F4 angle, FSTUFF_F4 * outSin, FSTUFF_F4 * outCos) {
+    const FSTUFF_I4 q = FSTUFF_F4_RoundToInt(FSTUFF_F4_Mul(angle, FSTUFF_F4_Splat(FSTUFF_SinCos_TwoOverPi)));
+    const FSTUFF_F4 qf = FSTUFF_I4_ToFloat(q);
+    FSTUFF_F4 r = FSTUFF_F4_Sub(angle, FSTUFF_F4_Mul(qf, FSTUFF_F4_Splat(FSTUFF_SinCos_PiOver2_A)));
+    r = FSTUFF_F4_Sub(r, FSTUFF_F4_Mul(qf, FSTUFF_F4_Splat(FSTUFF_SinCos_PiOver2_B)));
+    r = FSTUFF_F4_Sub(r, FSTUFF_F4_Mul(qf, FSTUFF_F4_Splat(FSTUFF_SinCos_PiOver2_C)));
+
+    const FSTUFF_F4 r2 = FSTUFF_F4_Mul(r, r);
+    FSTUFF_F4 s = FSTUFF_F4_Add(FSTUFF_F4_Splat(FSTUFF_SinCos_S2), FSTUFF_F4_Mul(r2, FSTUFF_F4_Splat(FSTUFF_SinCos_S3)));
+    s = FSTUFF_F4_Add(FSTUFF_F4_Splat(FSTUFF_SinCos_S1), FSTUFF_F4_Mul(r2, s));
+    s = FSTUFF_F4_Add(r, FSTUFF_F4_Mul(FSTUFF_F4_Mul(r, r2), s));
+    FSTUFF_F4 c = FSTUFF_F4_Add(FSTUFF_F4_Splat(FSTUFF_SinCos_C2), FSTUFF_F4_Mul(r2, FSTUFF_F4_Splat(FSTUFF_SinCos_C3)));
+    c = FSTUFF_F4_Add(FSTUFF_F4_Splat(FSTUFF_SinCos_C1), FSTUFF_F4_Mul(r2, c));
+    c = FSTUFF_F4_Add(
+        FSTUFF_F4_Sub(FSTUFF_F4_Splat(1.0f), FSTUFF_F4_Mul(FSTUFF_F4_Splat(0.5f), r2)),
+        FSTUFF_F4_Mul(FSTUFF_F4_Mul(r2, r2), c)
+    );
+
+    // Quadrant selection, as in FSTUFF_SinCos(), but branch-free: odd
+    // quadrants swap sine and cosine, and bit 1 of q (or of q + 1, for
+    // cosine) moves into each lane's sign bit.
+    const FSTUFF_I4 one = FSTUFF_I4_Splat(1);
+    const FSTUFF_I4 two = FSTUFF_I4_Splat(2);
+    const FSTUFF_I4 swap = FSTUFF_I4_CmpEq(FSTUFF_I4_And(q, one), one);
+    const FSTUFF_F4 sinValue = FSTUFF_F4_Select(swap, c, s);
+    const FSTUFF_F4 cosValue = FSTUFF_F4_Select(swap, s, c);
+    *outSin = FSTUFF_F4_Xor(sinValue, FSTUFF_I4_ShiftLeft<30>(FSTUFF_I4_And(q, two)));
+    *outCos = FSTUFF_F4_Xor(cosValue, FSTUFF_I4_ShiftLeft<30>(FSTUFF_I4_And(FSTUFF_I4_Add(q, one), two)));
+}
+
+#endif // FSTUFF_SIMD_WIDTH > 1
+
+// Builds 'count' instance transforms, FSTUFF_SIMD_WIDTH at a time, if vector
+// instructions are available.  Results match FSTUFF_BuildTransforms_Scalar(),
+// and are within a few ULPs of FSTUFF_BuildTransforms_Reference().  Output
+// matrices are 'outStride' bytes apart.
+inline void FSTUFF_BuildTransforms(const FSTUFF_TransformInputs & in, size_t count, gbMat4 * out, size_t outStride = sizeof(gbMat4)) {
+    size_t i = 0;
+#if FSTUFF_SIMD_WIDTH > 1
+    const FSTUFF_F4 zero     = FSTUFF_F4_Splat(0.f);
+    const FSTUFF_F4 zeroOne  = FSTUFF_F4_Set(0.f, 1.f, 0.f, 1.f);
+    const FSTUFF_F4 column2  = FSTUFF_F4_Set(0.f, 0.f, 1.f, 0.f);
+    for ( ; (i + 4) <= count; i += 4) {
+        const FSTUFF_F4 x  = FSTUFF_F4_Load(in.x + i);
+        const FSTUFF_F4 y  = FSTUFF_F4_Load(in.y + i);
+        const FSTUFF_F4 sx = FSTUFF_F4_Load(in.scaleX + i);
+        const FSTUFF_F4 sy = FSTUFF_F4_Load(in.scaleY + i);
+        FSTUFF_F4 s, c;
+        FSTUFF_SinCos4(FSTUFF_F4_Load(in.angle + i), &s, &c);
+
+        // Column 0 is (c*sx, s*sx, 0, 0); column 1, (-s*sy, c*sy, 0, 0);
+        // column 3, (x, y, 0, 1).  Interleave pairs, then append each
+        // column's constant half.
+        const FSTUFF_F4 col0 = FSTUFF_F4_Mul(c, sx);
+        const FSTUFF_F4 col0y = FSTUFF_F4_Mul(s, sx);
+        const FSTUFF_F4 col1 = FSTUFF_F4_Sub(zero, FSTUFF_F4_Mul(s, sy));
+        const FSTUFF_F4 col1y = FSTUFF_F4_Mul(c, sy);
+        const FSTUFF_F4 pairs0[2] = {FSTUFF_F4_ZipLo(col0, col0y), FSTUFF_F4_ZipHi(col0, col0y)};
+        const FSTUFF_F4 pairs1[2] = {FSTUFF_F4_ZipLo(col1, col1y), FSTUFF_F4_ZipHi(col1, col1y)};
+        const FSTUFF_F4 pairs3[2] = {FSTUFF_F4_ZipLo(x, y),        FSTUFF_F4_ZipHi(x, y)};
+        for (int half = 0; half < 2; ++half) {
+            float * e0 = FSTUFF_StridedMatrix(out, i + (half * 2) + 0, outStride);
+            float * e1 = FSTUFF_StridedMatrix(out, i + (half * 2) + 1, outStride);
+            FSTUFF_F4_Store(e0 + 0,  FSTUFF_F4_CombineLo(pairs0[half], zero));
+            FSTUFF_F4_Store(e0 + 4,  FSTUFF_F4_CombineLo(pairs1[half], zero));
+            FSTUFF_F4_Store(e0 + 8,  column2);
+            FSTUFF_F4_Store(e0 + 12, FSTUFF_F4_CombineLo(pairs3[half], zeroOne));
+            FSTUFF_F4_Store(e1 + 0,  FSTUFF_F4_CombineHi(pairs0[half], zero));
+            FSTUFF_F4_Store(e1 + 4,  FSTUFF_F4_CombineHi(pairs1[half], zero));
+            FSTUFF_F4_Store(e1 + 8,  column2);
+            FSTUFF_F4_Store(e1 + 12, FSTUFF_F4_CombineHi(pairs3[half], zeroOne));
+        }
+    }
+#endif
+    const FSTUFF_TransformInputs rest = {in.x + i, in.y + i, in.angle + i, in.scaleX + i, in.scaleY + i};
+    FSTUFF_BuildTransforms_Scalar(rest, count - i, reinterpret_cast<gbMat4 *>(FSTUFF_StridedMatrix(out, i, outStride)), outStride);
+}
+
+#endif /* FSTUFF_SIMD_h */
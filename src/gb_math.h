@@ -401,6 +401,14 @@ GB_MATH_DEF void gb_float44_transpose(float (*vec)[4]);
 GB_MATH_DEF void gb_float44_mul      (float (*out)[4], float (*mat1)[4], float (*mat2)[4]);
 GB_MATH_DEF void gb_float44_mul_vec4 (gbVec4 *out, float m[4][4], gbVec4 in);
 
+/* NOTE: The above, and gb_mat4_rotate, use SSE2, NEON (AArch64), or WASM
+ * SIMD128, when the compiler targets one of them, unless GB_MATH_NO_SIMD
+ * is defined.  The _scalar variants are always scalar, for comparison. */
+GB_MATH_DEF char const *gb_math_simd_name(void);
+GB_MATH_DEF void gb_float44_mul_scalar     (float (*out)[4], float (*mat1)[4], float (*mat2)[4]);
+GB_MATH_DEF void gb_float44_mul_vec4_scalar(gbVec4 *out, float m[4][4], gbVec4 in);
+GB_MATH_DEF void gb_mat4_rotate_scalar     (gbMat4 *out, gbVec3 v, float angle_radians);
+
 
 GB_MATH_DEF void gb_mat4_translate           (gbMat4 *out, gbVec3 v);
 GB_MATH_DEF void gb_mat4_rotate              (gbMat4 *out, gbVec3 v, float angle_radians);
@@ -794,6 +802,51 @@ static void gb__memcpy_4byte(void *dest, void const *src, size_t size) {
 }
 
 
+/* NOTE: 4-wide SIMD backends, for gbMat4 operations.  Sums are evaluated
+ * in the same order as the scalar code, so results match it exactly. */
+#if !defined(GB_MATH_NO_SIMD)
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#include <emmintrin.h>
+		#define GB_MATH_SIMD "SSE2"
+		typedef __m128 gb__f4;
+		#define gb__f4_load(p)           _mm_loadu_ps(p)
+		#define gb__f4_store(p, a)       _mm_storeu_ps((p), (a))
+		#define gb__f4_set(a, b, c, d)   _mm_setr_ps((a), (b), (c), (d))
+		#define gb__f4_splat(a)          _mm_set1_ps(a)
+		#define gb__f4_add(a, b)         _mm_add_ps((a), (b))
+		#define gb__f4_mul(a, b)         _mm_mul_ps((a), (b))
+	#elif defined(__ARM_NEON) && defined(__aarch64__)
+		#include <arm_neon.h>
+		#define GB_MATH_SIMD "NEON"
+		typedef float32x4_t gb__f4;
+		static gb__f4 gb__f4_set(float a, float b, float c, float d) { float v[4]; v[0] = a; v[1] = b; v[2] = c; v[3] = d; return vld1q_f32(v); }
+		#define gb__f4_load(p)           vld1q_f32(p)
+		#define gb__f4_store(p, a)       vst1q_f32((p), (a))
+		#define gb__f4_splat(a)          vdupq_n_f32(a)
+		#define gb__f4_add(a, b)         vaddq_f32((a), (b))
+		#define gb__f4_mul(a, b)         vmulq_f32((a), (b))
+	#elif defined(__wasm_simd128__)
+		#include <wasm_simd128.h>
+		#define GB_MATH_SIMD "WASM SIMD128"
+		typedef v128_t gb__f4;
+		#define gb__f4_load(p)           wasm_v128_load(p)
+		#define gb__f4_store(p, a)       wasm_v128_store((p), (a))
+		#define gb__f4_set(a, b, c, d)   wasm_f32x4_make((a), (b), (c), (d))
+		#define gb__f4_splat(a)          wasm_f32x4_splat(a)
+		#define gb__f4_add(a, b)         wasm_f32x4_add((a), (b))
+		#define gb__f4_mul(a, b)         wasm_f32x4_mul((a), (b))
+	#endif
+#endif
+
+char const *gb_math_simd_name(void) {
+#if defined(GB_MATH_SIMD)
+	return GB_MATH_SIMD;
+#else
+	return "none";
+#endif
+}
+
+
 float gb_to_radians(float degrees) { return degrees * GB_MATH_TAU / 360.0f; }
 float gb_to_degrees(float radians) { return radians * 360.0f / GB_MATH_TAU; }
 
@@ -1501,6 +1554,27 @@ void gb_float44_transpose(float (*vec)[4]) {
 }
 
 void gb_float44_mul(float (*out)[4], float (*mat1)[4], float (*mat2)[4]) {
+#if defined(GB_MATH_SIMD)
+	/* NOTE: All of mat1, and each of mat2's columns, gets read before the
+	 * matching column of out gets written, so out may alias either one. */
+	int j;
+	gb__f4 c0 = gb__f4_load(mat1[0]);
+	gb__f4 c1 = gb__f4_load(mat1[1]);
+	gb__f4 c2 = gb__f4_load(mat1[2]);
+	gb__f4 c3 = gb__f4_load(mat1[3]);
+	for (j = 0; j < 4; j++) {
+		gb__f4 r = gb__f4_mul(c0, gb__f4_splat(mat2[j][0]));
+		r = gb__f4_add(r, gb__f4_mul(c1, gb__f4_splat(mat2[j][1])));
+		r = gb__f4_add(r, gb__f4_mul(c2, gb__f4_splat(mat2[j][2])));
+		r = gb__f4_add(r, gb__f4_mul(c3, gb__f4_splat(mat2[j][3])));
+		gb__f4_store(out[j], r);
+	}
+#else
+	gb_float44_mul_scalar(out, mat1, mat2);
+#endif
+}
+
+void gb_float44_mul_scalar(float (*out)[4], float (*mat1)[4], float (*mat2)[4]) {
 	int i, j;
 	float temp1[4][4], temp2[4][4];
 	if (mat1 == out) { gb__memcpy_4byte(temp1, mat1, sizeof(temp1)); mat1 = temp1; }
@@ -1516,6 +1590,18 @@ void gb_float44_mul(float (*out)[4], float (*mat1)[4], float (*mat2)[4]) {
 }
 
 void gb_float44_mul_vec4(gbVec4 *out, float m[4][4], gbVec4 v) {
+#if defined(GB_MATH_SIMD)
+	gb__f4 r = gb__f4_mul(gb__f4_load(m[0]), gb__f4_splat(v.x));
+	r = gb__f4_add(r, gb__f4_mul(gb__f4_load(m[1]), gb__f4_splat(v.y)));
+	r = gb__f4_add(r, gb__f4_mul(gb__f4_load(m[2]), gb__f4_splat(v.z)));
+	r = gb__f4_add(r, gb__f4_mul(gb__f4_load(m[3]), gb__f4_splat(v.w)));
+	gb__f4_store(out->e, r);
+#else
+	gb_float44_mul_vec4_scalar(out, m, v);
+#endif
+}
+
+void gb_float44_mul_vec4_scalar(gbVec4 *out, float m[4][4], gbVec4 v) {
 	out->x = m[0][0]*v.x + m[1][0]*v.y + m[2][0]*v.z + m[3][0]*v.w;
 	out->y = m[0][1]*v.x + m[1][1]*v.y + m[2][1]*v.z + m[3][1]*v.w;
 	out->z = m[0][2]*v.x + m[1][2]*v.y + m[2][2]*v.z + m[3][2]*v.w;
@@ -1604,6 +1690,29 @@ void gb_mat4_translate(gbMat4 *out, gbVec3 v) {
 }
 
 void gb_mat4_rotate(gbMat4 *out, gbVec3 v, float angle_radians) {
+#if defined(GB_MATH_SIMD)
+	/* NOTE: Each column is axis*t[i], plus a cross-product-ish term */
+	float c, s;
+	gbVec3 axis, t;
+	gb__f4 a;
+
+	c = gb_cos(angle_radians);
+	s = gb_sin(angle_radians);
+
+	gb_vec3_norm(&axis, v);
+	gb_vec3_mul(&t, axis, 1.0f-c);
+	a = gb__f4_set(axis.x, axis.y, axis.z, 0);
+
+	gb__f4_store(out->col[0].e, gb__f4_add(gb__f4_set(c, 0, 0, 0), gb__f4_add(gb__f4_mul(a, gb__f4_splat(t.x)), gb__f4_set(0, s*axis.z, -s*axis.y, 0))));
+	gb__f4_store(out->col[1].e, gb__f4_add(gb__f4_set(0, c, 0, 0), gb__f4_add(gb__f4_mul(a, gb__f4_splat(t.y)), gb__f4_set(-s*axis.z, 0, s*axis.x, 0))));
+	gb__f4_store(out->col[2].e, gb__f4_add(gb__f4_set(0, 0, c, 0), gb__f4_add(gb__f4_mul(a, gb__f4_splat(t.z)), gb__f4_set(s*axis.y, -s*axis.x, 0, 0))));
+	gb__f4_store(out->col[3].e, gb__f4_set(0, 0, 0, 1));
+#else
+	gb_mat4_rotate_scalar(out, v, angle_radians);
+#endif
+}
+
+void gb_mat4_rotate_scalar(gbMat4 *out, gbVec3 v, float angle_radians) {
 	float c, s;
 	gbVec3 axis, t;
 	gbFloat4 *rot;